@@ -1,9 +1,14 @@
 ; boot.asm - Multiboot bootloader
+MB_FLAGS equ 0x00000007                    ; Page-align modules, memory info, video mode
+
 section .multiboot
 align 4
     dd 0x1BADB002                          ; Magic number
-    dd 0x00000003                          ; Flags
-    dd -(0x1BADB002 + 0x00000003)         ; Checksum
+    dd MB_FLAGS                            ; Flags
+    dd -(0x1BADB002 + MB_FLAGS)            ; Checksum
+    dd 0, 0, 0, 0, 0                       ; Load addresses (unused: ELF kernel)
+    dd 0                                   ; Linear framebuffer (fbcon.c)...
+    dd 1280, 1024, 32                      ; ...of FBCON_WIDTH x FBCON_HEIGHT x 32 bpp
 
 section .bss
 align 16
@@ -11,12 +16,60 @@ stack_bottom:
     resb 16384                             ; 16KB stack
 stack_top:
 
+; Boot timestamps (boottime.c), written after the BSS is cleared
+global boot_tsc_entry
+global boot_tsc_bss
+align 8
+boot_tsc_entry:
+    resq 1
+boot_tsc_bss:
+    resq 1
+
 section .text
 global start
 extern kernel_main
+extern bss_start
+extern bss_end
 
 start:
+    mov ebp, eax                           ; Keep the multiboot magic
+    rdtsc                                  ; Entry time in edx:esi
+    mov esi, eax
+    
+    mov edi, bss_start                     ; Clear the BSS
+    mov ecx, bss_end
+    sub ecx, edi
+    shr ecx, 2
+    xor eax, eax
+    cld
+    rep stosd
+    
     mov esp, stack_top                     ; Set up stack
+    mov [boot_tsc_entry], esi
+    mov [boot_tsc_entry + 4], edx
+    rdtsc
+    mov [boot_tsc_bss], eax
+    mov [boot_tsc_bss + 4], edx
+    
+    push ebx                               ; Multiboot info pointer
+    push ebp                               ; Multiboot magic
+    
+    ; FPU on; SSE too if CPUID reports SSE and FXSAVE (klib uses SSE2)
+    mov eax, cr0
+    and eax, ~((1 << 2) | (1 << 3))        ; Clear EM (emulation) and TS
+    or eax, (1 << 1) | (1 << 5)            ; Set MP and NE
+    mov cr0, eax
+    fninit
+    mov eax, 1
+    cpuid
+    and edx, (1 << 24) | (1 << 25)         ; FXSR and SSE
+    cmp edx, (1 << 24) | (1 << 25)
+    jne .no_sse
+    mov eax, cr4
+    or eax, (1 << 9) | (1 << 10)           ; OSFXSR and OSXMMEXCPT
+    mov cr4, eax
+.no_sse:
+    
     call kernel_main                       ; Call C kernel
 .hang:
     cli
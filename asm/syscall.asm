@@ -0,0 +1,209 @@
+; syscall.asm - Descriptor table loading, interrupt and system call entries,
+; ring 3 entry
+section .text
+global gdt_flush
+global tss_flush
+global idt_flush
+global exception_stubs
+global irq_stubs
+global syscall_int80
+global syscall_sysenter
+global user_enter
+global user_return
+extern syscall_dispatch
+extern syscall_fault
+extern irq_dispatch
+
+KERNEL_CS equ 0x08
+KERNEL_DS equ 0x10
+USER_CS   equ 0x1B
+USER_DS   equ 0x23
+
+; void gdt_flush(gdt_ptr_t* ptr)
+gdt_flush:
+    mov eax, [esp + 4]
+    lgdt [eax]
+    mov ax, KERNEL_DS                      ; Reload every segment register
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    jmp KERNEL_CS:.reload_cs               ; Far jump reloads CS
+.reload_cs:
+    ret
+
+; void tss_flush(unsigned short selector)
+tss_flush:
+    mov ax, [esp + 4]
+    ltr ax
+    ret
+
+; void idt_flush(gdt_ptr_t* ptr)
+idt_flush:
+    mov eax, [esp + 4]
+    lidt [eax]
+    ret
+
+; CPU exceptions: stub N pushes N and jumps to the common handler.
+; Stubs are 8 bytes apart so idt.c can compute their addresses.
+; Every entry clears DF before calling C: the ABI requires it, and klib's
+; rep string routines would otherwise run backwards over kernel memory.
+; int 0x80 and IRQs get the caller's DF back from iret.
+align 8
+exception_stubs:
+%assign vector 0
+%rep 32
+    align 8
+    push byte vector
+    jmp exception_common
+%assign vector vector + 1
+%endrep
+
+exception_common:
+    cld
+    mov ax, KERNEL_DS
+    mov ds, ax
+    mov es, ax
+    call syscall_fault                     ; Vector is the argument
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+; Hardware interrupts: stub N pushes IRQ N, 8 bytes apart like the
+; exception stubs. The handler gets the IRQ and the interrupted EIP.
+align 8
+irq_stubs:
+%assign irq 0
+%rep 16
+    align 8
+    push byte irq
+    jmp irq_common
+%assign irq irq + 1
+%endrep
+
+irq_common:
+    pushad
+    push ds
+    push es
+    cld                                    ; May have hit rep_memmove's std
+    mov ax, KERNEL_DS
+    mov ds, ax
+    mov es, ax
+    push dword [esp + 44]                  ; Interrupted EIP
+    push dword [esp + 44]                  ; IRQ number
+    call irq_dispatch
+    add esp, 8
+    pop es
+    pop ds
+    popad
+    add esp, 4                             ; Drop the IRQ number
+    iret
+
+; int 0x80: eax = call number, ebx/esi/edi = arguments, result in eax
+syscall_int80:
+    push ebp
+    push edi
+    push esi
+    push edx
+    push ecx
+    push ebx
+    push ds
+    push es
+    cld
+    mov cx, KERNEL_DS
+    mov ds, cx
+    mov es, cx
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+    pop es
+    pop ds
+    pop ebx
+    pop ecx
+    pop edx
+    pop esi
+    pop edi
+    pop ebp
+    iret
+
+; sysenter: same registers as int 0x80, plus the caller's resume
+; address in edx and stack pointer in ecx for sysexit
+syscall_sysenter:
+    push ecx
+    push edx
+    push ds
+    push es
+    cld                                    ; sysexit leaves DF clear for ring 3
+    mov dx, KERNEL_DS
+    mov ds, dx
+    mov es, dx
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+    pop es
+    pop ds
+    pop edx                                ; sysexit: EIP = edx
+    pop ecx                                ;          ESP = ecx
+    test dword [user_eflags], 0x200        ; sysenter cleared IF: restore it
+    jz .exit
+    sti                                    ; Takes effect after sysexit
+.exit:
+    sysexit
+
+; int user_enter(void (*entry)(), unsigned int user_esp)
+; Runs entry in ring 3. Returns the code passed to user_return.
+user_enter:
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushfd                                 ; user_return restores IF
+    mov [kernel_esp], esp
+    mov eax, [esp + 24]                    ; entry
+    mov ecx, [esp + 28]                    ; user_esp
+    mov edx, [esp]
+    and edx, 0x200                         ; Ring 3 keeps the kernel's IF
+    or edx, 0x002
+    mov [user_eflags], edx
+    mov dx, USER_DS
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    mov gs, dx
+    push dword USER_DS                     ; ss
+    push ecx                               ; esp
+    push dword [user_eflags]               ; eflags
+    push dword USER_CS                     ; cs
+    push eax                               ; eip
+    iret
+
+; void user_return(int code)
+; Abandons the ring 3 task and returns from user_enter with code
+user_return:
+    mov eax, [esp + 4]
+    mov dx, KERNEL_DS
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    mov gs, dx
+    mov esp, [kernel_esp]
+    popfd
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+section .bss
+kernel_esp:
+    resd 1
+user_eflags:
+    resd 1
@@ -0,0 +1,147 @@
+// ata.c - ATA PIO disk driver (primary master, polled, LBA28)
+#include "kernel.h"
+#include "ata.h"
+
+static ata_drive_t drive;
+
+// Give the drive 400ns to update its status
+static void ata_delay() {
+    for (int i = 0; i < 4; i++) inb(ATA_CONTROL);
+}
+
+// Wait for BSY to clear. Returns the final status, or -1 on timeout.
+static int ata_wait_ready() {
+    for (int spin = 0; spin < 1000000; spin++) {
+        unsigned char status = inb(ATA_STATUS);
+        if (!(status & ATA_SR_BSY)) return status;
+    }
+    return -1;
+}
+
+// Wait until the drive wants data. Returns 0, or -1 on error.
+static int ata_wait_drq() {
+    for (int spin = 0; spin < 1000000; spin++) {
+        unsigned char status = inb(ATA_STATUS);
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+        if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) return 0;
+    }
+    return -1;
+}
+
+// Probe the primary master with IDENTIFY. Returns 1 if a disk is present.
+int ata_init() {
+    unsigned short id[256];
+    
+    drive.present = 0;
+    drive.sectors = 0;
+    drive.model[0] = '\0';
+    drive.commands = 0;
+    drive.sectors_read = 0;
+    drive.sectors_written = 0;
+    drive.errors = 0;
+    
+    // Floating bus: no controller
+    if (inb(ATA_STATUS) == 0xFF) return 0;
+    
+    outb(ATA_CONTROL, 0x02);           // Polled mode: no interrupts
+    outb(ATA_DRIVE, 0xA0);
+    ata_delay();
+    outb(ATA_COUNT, 0);
+    outb(ATA_LBA_LO, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HI, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+    
+    if (inb(ATA_STATUS) == 0) return 0;
+    if (ata_wait_ready() < 0) return 0;
+    
+    // ATAPI and SATA devices answer with a signature instead
+    if (inb(ATA_LBA_MID) || inb(ATA_LBA_HI)) return 0;
+    if (ata_wait_drq() < 0) return 0;
+    
+    insw(ATA_DATA, id, 256);
+    
+    drive.sectors = id[60] | ((unsigned int)id[61] << 16);
+    
+    // Model string: byte-swapped words, space padded
+    for (int i = 0; i < 20; i++) {
+        drive.model[i * 2] = id[27 + i] >> 8;
+        drive.model[i * 2 + 1] = id[27 + i] & 0xFF;
+    }
+    int len = 40;
+    while (len > 0 && drive.model[len - 1] == ' ') len--;
+    drive.model[len] = '\0';
+    
+    drive.present = drive.sectors > 0;
+    return drive.present;
+}
+
+const ata_drive_t* ata_drive() {
+    return &drive;
+}
+
+// Transfer count consecutive sectors starting at lba with one command.
+// Sector i goes to or from bufs[i], so merged requests need not share
+// a buffer. Returns 0, or -1 on error.
+int ata_transfer(unsigned int lba, int count, char** bufs, int write) {
+    if (!drive.present || count <= 0 || count > ATA_MAX_SECTORS ||
+        lba + count > drive.sectors || lba >= 0x10000000) {
+        return -1;
+    }
+    
+    if (ata_wait_ready() < 0) {
+        drive.errors++;
+        return -1;
+    }
+    
+    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+    ata_delay();
+    outb(ATA_COUNT, count == ATA_MAX_SECTORS ? 0 : count);
+    outb(ATA_LBA_LO, lba & 0xFF);
+    outb(ATA_LBA_MID, (lba >> 8) & 0xFF);
+    outb(ATA_LBA_HI, (lba >> 16) & 0xFF);
+    outb(ATA_COMMAND, write ? ATA_CMD_WRITE : ATA_CMD_READ);
+    drive.commands++;
+    
+    for (int i = 0; i < count; i++) {
+        ata_delay();
+        if (ata_wait_drq() < 0) {
+            drive.errors++;
+            return -1;
+        }
+        if (write) {
+            outsw(ATA_DATA, bufs[i], SECTOR_SIZE / 2);
+        } else {
+            insw(ATA_DATA, bufs[i], SECTOR_SIZE / 2);
+        }
+    }
+    
+    if (write) {
+        drive.sectors_written += count;
+        if (ata_wait_ready() < 0) {
+            drive.errors++;
+            return -1;
+        }
+    } else {
+        drive.sectors_read += count;
+    }
+    return 0;
+}
+
+// Flush the drive's write cache
+int ata_flush() {
+    if (!drive.present) return -1;
+    
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_COMMAND, ATA_CMD_FLUSH);
+    drive.commands++;
+    ata_delay();
+    
+    int status = ata_wait_ready();
+    if (status < 0 || (status & ATA_SR_ERR)) {
+        drive.errors++;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// ata.h - ATA PIO disk driver (primary master)
+#ifndef ATA_H
+#define ATA_H
+
+#define SECTOR_SIZE 512
+#define ATA_MAX_SECTORS 256            // Sectors per command (LBA28)
+
+// Primary bus ports
+#define ATA_DATA        0x1F0
+#define ATA_ERROR       0x1F1
+#define ATA_COUNT       0x1F2
+#define ATA_LBA_LO      0x1F3
+#define ATA_LBA_MID     0x1F4
+#define ATA_LBA_HI      0x1F5
+#define ATA_DRIVE       0x1F6
+#define ATA_STATUS      0x1F7
+#define ATA_COMMAND     0x1F7
+#define ATA_CONTROL     0x3F6
+
+// Status bits
+#define ATA_SR_BSY  0x80
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_DF   0x20
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_ERR  0x01
+
+// Commands
+#define ATA_CMD_READ     0x20
+#define ATA_CMD_WRITE    0x30
+#define ATA_CMD_FLUSH    0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+// Drive information from IDENTIFY
+typedef struct {
+    int present;
+    unsigned int sectors;      // LBA28 addressable sectors
+    char model[41];
+    int commands;              // Commands issued
+    int sectors_read;
+    int sectors_written;
+    int errors;
+} ata_drive_t;
+
+// Driver functions
+int ata_init();
+const ata_drive_t* ata_drive();
+int ata_transfer(unsigned int lba, int count, char** bufs, int write);
+int ata_flush();
+
+#endif
@@ -0,0 +1,488 @@
+// bcache.c - Block buffer cache and elevator request queue
+#include "kernel.h"
+#include "bcache.h"
+
+// Buffer cache: LRU list of sectors with a hash on the LBA
+static buffer_t buffers[BCACHE_BUFFERS];
+static int lru_head = -1;              // Most recently used
+static int lru_tail = -1;              // Eviction candidate
+static int hash_heads[BCACHE_HASH_BUCKETS];
+static int cache_enabled = 1;
+
+// Elevator queue
+static blk_request_t queue[BLK_QUEUE_DEPTH];
+static int queued = 0;
+static unsigned int head_pos = 0;      // Sector after the last transfer
+static int dispatches = 0;
+
+// Statistics
+static int cache_hits = 0;
+static int cache_misses = 0;
+static int readahead_sectors = 0;
+static int writeback_sectors = 0;
+static int evictions = 0;
+static int blk_requests = 0;
+static int blk_commands = 0;
+static int blk_merged = 0;
+static int blk_expired = 0;
+
+// Detach a buffer from the LRU list
+static void lru_remove(int b) {
+    if (buffers[b].prev != -1) buffers[buffers[b].prev].next = buffers[b].next;
+    else lru_head = buffers[b].next;
+    if (buffers[b].next != -1) buffers[buffers[b].next].prev = buffers[b].prev;
+    else lru_tail = buffers[b].prev;
+}
+
+// Make a buffer the most recently used
+static void lru_touch(int b) {
+    if (lru_head == b) return;
+    lru_remove(b);
+    buffers[b].prev = -1;
+    buffers[b].next = lru_head;
+    if (lru_head != -1) buffers[lru_head].prev = b;
+    lru_head = b;
+    if (lru_tail == -1) lru_tail = b;
+}
+
+static int hash_bucket(unsigned int lba) {
+    return lba & (BCACHE_HASH_BUCKETS - 1);
+}
+
+static void hash_remove(int b) {
+    int* link = &hash_heads[hash_bucket(buffers[b].lba)];
+    while (*link != -1) {
+        if (*link == b) {
+            *link = buffers[b].hash_next;
+            return;
+        }
+        link = &buffers[*link].hash_next;
+    }
+}
+
+// Find the buffer caching a sector (-1 if none)
+static int bcache_find(unsigned int lba) {
+    for (int b = hash_heads[hash_bucket(lba)]; b != -1; b = buffers[b].hash_next) {
+        if (buffers[b].lba == lba) return b;
+    }
+    return -1;
+}
+
+// Drop a buffer's contents
+static void buffer_forget(int b) {
+    if (buffers[b].lba != 0xFFFFFFFF) hash_remove(b);
+    buffers[b].lba = 0xFFFFFFFF;
+    buffers[b].valid = 0;
+    buffers[b].dirty = 0;
+}
+
+// Take the least recently used buffer for a sector. A dirty victim
+// writes back every dirty buffer at once so the elevator can merge them.
+static int bcache_alloc(unsigned int lba) {
+    int b = lru_tail;
+    
+    if (buffers[b].dirty) {
+        bcache_sync();
+    }
+    if (buffers[b].lba != 0xFFFFFFFF) evictions++;
+    buffer_forget(b);
+    
+    buffers[b].lba = lba;
+    int bucket = hash_bucket(lba);
+    buffers[b].hash_next = hash_heads[bucket];
+    hash_heads[bucket] = b;
+    lru_touch(b);
+    return b;
+}
+
+// Initialize the cache and the request queue
+void bcache_init() {
+    for (int i = 0; i < BCACHE_HASH_BUCKETS; i++) {
+        hash_heads[i] = -1;
+    }
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        buffers[i].lba = 0xFFFFFFFF;
+        buffers[i].valid = 0;
+        buffers[i].dirty = 0;
+        buffers[i].hash_next = -1;
+        buffers[i].prev = i - 1;
+        buffers[i].next = (i + 1 < BCACHE_BUFFERS) ? i + 1 : -1;
+    }
+    lru_head = 0;
+    lru_tail = BCACHE_BUFFERS - 1;
+    
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        queue[i].used = 0;
+    }
+    queued = 0;
+}
+
+// Read a sector. A miss also queues up to BCACHE_READAHEAD following
+// sectors, which the elevator merges into a single command.
+int bcache_read(unsigned int lba, char* buf) {
+    if (!cache_enabled) {
+        blk_submit(lba, buf, 0);
+        return blk_run();
+    }
+    
+    int b = bcache_find(lba);
+    if (b != -1 && buffers[b].valid) {
+        cache_hits++;
+        lru_touch(b);
+        memcpy(buf, buffers[b].data, SECTOR_SIZE);
+        return 0;
+    }
+    cache_misses++;
+    
+    int fetched[BCACHE_READAHEAD + 1];
+    int count = 0;
+    unsigned int sectors = ata_drive()->sectors;
+    
+    b = bcache_alloc(lba);
+    fetched[count++] = b;
+    blk_submit(lba, buffers[b].data, 0);
+    
+    for (int i = 1; i <= BCACHE_READAHEAD; i++) {
+        unsigned int next = lba + i;
+        if (next >= sectors || bcache_find(next) != -1) break;
+        int ra = bcache_alloc(next);
+        fetched[count++] = ra;
+        blk_submit(next, buffers[ra].data, 0);
+        readahead_sectors++;
+    }
+    
+    if (blk_run() < 0) {
+        for (int i = 0; i < count; i++) buffer_forget(fetched[i]);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) buffers[fetched[i]].valid = 1;
+    
+    memcpy(buf, buffers[b].data, SECTOR_SIZE);
+    return 0;
+}
+
+// Write a sector into the cache; it reaches the disk on write-back
+int bcache_write(unsigned int lba, const char* buf) {
+    if (!cache_enabled) {
+        blk_submit(lba, (char*)buf, 1);
+        return blk_run();
+    }
+    
+    int b = bcache_find(lba);
+    if (b == -1) b = bcache_alloc(lba);
+    lru_touch(b);
+    
+    memcpy(buffers[b].data, buf, SECTOR_SIZE);
+    buffers[b].valid = 1;
+    buffers[b].dirty = 1;
+    return 0;
+}
+
+// Write back every dirty buffer. Returns sectors written, or -1.
+int bcache_sync() {
+    int written[BCACHE_BUFFERS];
+    int count = 0;
+    
+    for (int b = 0; b < BCACHE_BUFFERS; b++) {
+        if (buffers[b].valid && buffers[b].dirty) {
+            buffers[b].dirty = 0;
+            written[count++] = b;
+            blk_submit(buffers[b].lba, buffers[b].data, 1);
+        }
+    }
+    if (count == 0) return 0;
+    
+    if (blk_run() < 0 || ata_flush() < 0) {
+        for (int i = 0; i < count; i++) buffers[written[i]].dirty = 1;
+        return -1;
+    }
+    writeback_sectors += count;
+    return count;
+}
+
+// Drop all clean buffers
+void bcache_invalidate() {
+    for (int b = 0; b < BCACHE_BUFFERS; b++) {
+        if (!buffers[b].dirty) buffer_forget(b);
+    }
+}
+
+// Turn the cache on or off (off: every access goes to the disk)
+void bcache_set_enabled(int enabled) {
+    if (!enabled) {
+        bcache_sync();
+        bcache_invalidate();
+    }
+    cache_enabled = enabled;
+}
+
+// Queue a sector request. A full queue is drained first.
+int blk_submit(unsigned int lba, char* buf, int write) {
+    if (queued == BLK_QUEUE_DEPTH && blk_run() < 0) {
+        return -1;
+    }
+    
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        if (!queue[i].used) {
+            queue[i].lba = lba;
+            queue[i].buf = buf;
+            queue[i].write = write;
+            queue[i].deadline = dispatches + BLK_EXPIRE;
+            queue[i].used = 1;
+            queued++;
+            blk_requests++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Find a queued request for a sector
+static int blk_find(unsigned int lba, int write) {
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        if (queue[i].used && queue[i].lba == lba && queue[i].write == write) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Choose the next request: an expired one if any (deadline), otherwise
+// the lowest sector at or past the head, wrapping to the lowest (C-LOOK)
+static int blk_pick() {
+    int best = -1;
+    
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        if (queue[i].used && queue[i].deadline <= dispatches &&
+            (best == -1 || queue[i].deadline < queue[best].deadline)) {
+            best = i;
+        }
+    }
+    if (best != -1) {
+        blk_expired++;
+        return best;
+    }
+    
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        if (queue[i].used && queue[i].lba >= head_pos &&
+            (best == -1 || queue[i].lba < queue[best].lba)) {
+            best = i;
+        }
+    }
+    if (best != -1) return best;
+    
+    for (int i = 0; i < BLK_QUEUE_DEPTH; i++) {
+        if (queue[i].used && (best == -1 || queue[i].lba < queue[best].lba)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Dispatch the whole queue, merging runs of adjacent sectors in the same
+// direction into one command. Returns 0, or -1 if any transfer failed.
+int blk_run() {
+    int result = 0;
+    
+    while (queued > 0) {
+        int first = blk_pick();
+        unsigned int lba = queue[first].lba;
+        int write = queue[first].write;
+        int count = 1;
+        
+        // Extend the run backwards, then forwards
+        while (count < BLK_MAX_MERGE && lba > 0 && blk_find(lba - 1, write) != -1) {
+            lba--;
+            count++;
+        }
+        while (count < BLK_MAX_MERGE && blk_find(lba + count, write) != -1) {
+            count++;
+        }
+        
+        char* bufs[BLK_MAX_MERGE];
+        for (int i = 0; i < count; i++) {
+            int r = blk_find(lba + i, write);
+            bufs[i] = queue[r].buf;
+            queue[r].used = 0;
+            queued--;
+        }
+        
+        if (ata_transfer(lba, count, bufs, write) < 0) {
+            result = -1;
+        }
+        blk_commands++;
+        blk_merged += count - 1;
+        dispatches++;
+        head_pos = lba + count;
+    }
+    
+    return result;
+}
+
+// Print a number right-aligned in a column
+static void print_padded(int value, int width) {
+    int digits = 1;
+    for (int n = value; n >= 10; n /= 10) digits++;
+    for (int i = digits; i < width; i++) print(" ");
+    print_int(value);
+}
+
+// Show disk, cache and elevator state
+void bcache_show_info() {
+    const ata_drive_t* disk = ata_drive();
+    
+    print("\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("               Disk Information\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    if (!disk->present) {
+        print("  No ATA disk on the primary channel\n\n");
+        return;
+    }
+    
+    print("  Model: ");
+    print(disk->model);
+    print("\n  Sectors: ");
+    print_int(disk->sectors);
+    print(" (");
+    print_int(disk->sectors / 2048);
+    print(" MB)\n  ATA commands: ");
+    print_int(disk->commands);
+    print(", sectors read ");
+    print_int(disk->sectors_read);
+    print(", written ");
+    print_int(disk->sectors_written);
+    print(", errors ");
+    print_int(disk->errors);
+    
+    int valid = 0;
+    int dirty = 0;
+    for (int b = 0; b < BCACHE_BUFFERS; b++) {
+        if (buffers[b].valid) valid++;
+        if (buffers[b].dirty) dirty++;
+    }
+    
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("\n\n  Buffer Cache (");
+    print(cache_enabled ? "on" : "off");
+    print("):\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  Buffers: ");
+    print_int(valid);
+    print("/");
+    print_int(BCACHE_BUFFERS);
+    print(" in use, ");
+    print_int(dirty);
+    print(" dirty\n  Hits: ");
+    print_int(cache_hits);
+    print("  Misses: ");
+    print_int(cache_misses);
+    if (cache_hits + cache_misses > 0) {
+        print("  Hit rate: ");
+        print_int(cache_hits * 100 / (cache_hits + cache_misses));
+        print("%");
+    }
+    print("\n  Read-ahead sectors: ");
+    print_int(readahead_sectors);
+    print("  Written back: ");
+    print_int(writeback_sectors);
+    print("  Evictions: ");
+    print_int(evictions);
+    
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("\n\n  Elevator (C-LOOK + deadline):\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  Requests: ");
+    print_int(blk_requests);
+    print("  Commands: ");
+    print_int(blk_commands);
+    print("  Merged: ");
+    print_int(blk_merged);
+    print("  Expired: ");
+    print_int(blk_expired);
+    print("\n\n");
+}
+
+// Benchmark PRNG (fixed seed so runs are comparable)
+static unsigned int bench_seed;
+
+static unsigned int bench_random() {
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return (bench_seed >> 16) & 0x7FFF;
+}
+
+// Time BENCH_OPS single-sector operations starting from a cold cache.
+// Returns IOPS, or -1 on a disk error.
+static int bench_pattern(int write, int random) {
+    char buf[SECTOR_SIZE];
+    for (int i = 0; i < SECTOR_SIZE; i++) buf[i] = (char)i;
+    
+    bench_seed = 12345;
+    bcache_sync();
+    bcache_invalidate();
+    
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < BENCH_OPS; i++) {
+        unsigned int lba = BENCH_LBA + (random ? bench_random() % BENCH_SPAN : (unsigned int)i % BENCH_SPAN);
+        int rc = write ? bcache_write(lba, buf) : bcache_read(lba, buf);
+        if (rc < 0) return -1;
+    }
+    if (write && bcache_sync() < 0) return -1;
+    
+    unsigned int us = tsc_to_us(rdtsc() - start);
+    if (us == 0) us = 1;
+    return (int)udiv64((unsigned long long)BENCH_OPS * 1000000, us);
+}
+
+// diskbench: sequential and random IOPS with the cache on and off
+void bcache_benchmark() {
+    static const char* names[4] = {"seq read  ", "rand read ", "seq write ", "rand write"};
+    const ata_drive_t* disk = ata_drive();
+    
+    if (!disk->present || disk->sectors < BENCH_LBA + BENCH_SPAN) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: No ATA disk large enough for the benchmark\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return;
+    }
+    
+    int saved = cache_enabled;
+    int iops[4][2];
+    
+    for (int mode = 0; mode < 2; mode++) {
+        bcache_set_enabled(mode == 0);
+        for (int test = 0; test < 4; test++) {
+            iops[test][mode] = bench_pattern(test >= 2, test & 1);
+        }
+    }
+    bcache_set_enabled(saved);
+    
+    print("\n  ");
+    print_int(BENCH_OPS);
+    print(" ops per test, sectors ");
+    print_int(BENCH_LBA);
+    print("-");
+    print_int(BENCH_LBA + BENCH_SPAN - 1);
+    print("\n\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("  Test          Cache on   Cache off   (IOPS)\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    for (int test = 0; test < 4; test++) {
+        print("  ");
+        print(names[test]);
+        for (int mode = 0; mode < 2; mode++) {
+            if (iops[test][mode] < 0) {
+                print("       error");
+            } else {
+                print_padded(iops[test][mode], 12);
+            }
+        }
+        print("\n");
+    }
+    print("\n");
+}
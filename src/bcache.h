@@ -0,0 +1,58 @@
+// bcache.h - Block buffer cache and elevator request queue
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "ata.h"
+
+// Buffer cache
+#define BCACHE_BUFFERS 64
+#define BCACHE_HASH_BUCKETS 32         // Power of two
+#define BCACHE_READAHEAD 8             // Sectors fetched with a read miss
+
+// Elevator
+#define BLK_QUEUE_DEPTH 64
+#define BLK_MAX_MERGE 32               // Sectors per merged command
+#define BLK_EXPIRE 8                   // Dispatches a request may be passed over
+
+// Disk benchmark scratch area (overwritten by diskbench)
+#define BENCH_LBA 2048
+#define BENCH_SPAN 256
+#define BENCH_OPS 256
+
+// Cached sector
+typedef struct {
+    unsigned int lba;
+    int valid;
+    int dirty;
+    int prev;          // LRU list: towards most recently used
+    int next;          // LRU list: towards least recently used
+    int hash_next;     // Next buffer in the same hash bucket
+    char data[SECTOR_SIZE];
+} buffer_t;
+
+// Queued sector request
+typedef struct {
+    unsigned int lba;
+    char* buf;
+    int write;
+    int deadline;      // Dispatch count after which it is served first
+    int used;
+} blk_request_t;
+
+// Block layer functions
+void bcache_init();
+int bcache_read(unsigned int lba, char* buf);
+int bcache_write(unsigned int lba, const char* buf);
+int bcache_sync();
+void bcache_invalidate();
+void bcache_set_enabled(int enabled);
+
+// Elevator functions
+int blk_submit(unsigned int lba, char* buf, int write);
+int blk_run();
+
+// Shell commands
+void bcache_show_info();
+void bcache_benchmark();
+
+#endif
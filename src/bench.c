@@ -0,0 +1,227 @@
+// bench.c - Benchmark registry: cycles per iteration for kernel hot paths
+#include "kernel.h"
+#include "bench.h"
+#include "scheduler.h"
+#include "memory.h"
+#include "shell.h"
+
+#define SCHED_BENCH_PROCS 16           // Processes the scheduler rotates through
+#define FAULT_BENCH_PROCS 2            // Processes sharing the frames
+#define LONG_BURST 0x40000000          // Never completes during a benchmark
+
+// console_line: one full-width line through print(), scrolling the screen
+
+static void console_body(int i) {
+    (void)i;
+    print("bench: the quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJKLMNO\n");
+}
+
+// sched_tick: scheduler_tick() with a full run queue
+
+static int bench_pids[SCHED_BENCH_PROCS];
+static int bench_procs = 0;
+
+static void sched_setup() {
+    bench_procs = 0;
+    for (int i = 0; i < SCHED_BENCH_PROCS; i++) {
+        int pid = scheduler_create_process(LONG_BURST, i % 4);
+        if (pid == -1) break;
+        bench_pids[bench_procs++] = pid;
+    }
+}
+
+static void sched_body(int i) {
+    (void)i;
+    scheduler_tick();
+}
+
+static void bench_kill_all() {
+    for (int i = 0; i < bench_procs; i++) {
+        scheduler_kill_process(bench_pids[i]);
+    }
+    bench_procs = 0;
+}
+
+// page_fault: random accesses to more pages than there are frames, so
+// most accesses fault and many evict
+
+static unsigned int fault_seed;
+
+static void fault_setup() {
+    bench_procs = 0;
+    fault_seed = 12345;
+    for (int i = 0; i < FAULT_BENCH_PROCS; i++) {
+        int pid = scheduler_create_process(1, 1);
+        if (pid == -1) break;
+        memory_allocate_pages(pid, MAX_PAGES_PER_PROCESS);
+        bench_pids[bench_procs++] = pid;
+    }
+}
+
+static void fault_body(int i) {
+    if (bench_procs == 0) return;
+    fault_seed = fault_seed * 1103515245 + 12345;
+    unsigned int r = fault_seed >> 8;
+    memory_access_page(bench_pids[r % bench_procs], (r >> 4) % MAX_PAGES_PER_PROCESS, i & 1);
+}
+
+// proc_lifecycle: create, look up and kill one process
+
+static void lifecycle_body(int i) {
+    int pid = scheduler_create_process(1, i % 4);
+    if (scheduler_get_process(pid)) {
+        scheduler_kill_process(pid);
+    }
+}
+
+// shell_dispatch: parse, table lookup and a trivial handler
+
+static const char dispatch_line[] = "echo hello world";
+
+static void dispatch_body(int i) {
+    char input[MAX_INPUT];
+    (void)i;
+    memcpy(input, dispatch_line, sizeof(dispatch_line));
+    shell_execute(input);
+}
+
+static const bench_t benches[] = {
+    {"console_line",   "print() of an 80-column line",      200,  0, 0,           console_body,   0},
+    {"sched_tick",     "scheduler_tick, 16 processes",      2000, 1, sched_setup, sched_body,     bench_kill_all},
+    {"page_fault",     "random access, 64 pages/16 frames", 2000, 1, fault_setup, fault_body,     bench_kill_all},
+    {"proc_lifecycle", "create + get + kill a process",     2000, 0, 0,           lifecycle_body, 0},
+    {"shell_dispatch", "shell_execute(\"echo ...\")",       1000, 1, 0,           dispatch_body,  0},
+};
+
+#define BENCH_COUNT ((int)(sizeof(benches) / sizeof(benches[0])))
+
+// Machine-readable results go to COM1, one "BENCH key=value ..." line each
+
+static void serial_uint(unsigned int value) {
+    char buf[11];
+    int i = 10;
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    serial_print(&buf[i]);
+}
+
+// Print a number right-aligned in a column
+static void print_padded(unsigned int value, int width) {
+    int digits = 1;
+    for (unsigned int v = value; v >= 10; v /= 10) digits++;
+    for (int i = digits; i < width; i++) print(" ");
+    print_int(value);
+}
+
+// One warmup round, then BENCH_ROUNDS timed rounds. Reports the best
+// and the mean round, in cycles per iteration.
+static void run_one(const bench_t* b, unsigned int* min, unsigned int* mean) {
+    unsigned long long best = 0;
+    unsigned long long total = 0;
+    
+    if (b->setup) b->setup();
+    console_quiet += b->quiet;
+    for (int round = 0; round <= BENCH_ROUNDS; round++) {
+        unsigned long long start = rdtsc();
+        for (int i = 0; i < b->iterations; i++) {
+            b->body(i);
+        }
+        unsigned long long cycles = rdtsc() - start;
+    
+        if (round == 0) continue;      // Warmup: caches, page tables, swap
+        total += cycles;
+        if (best == 0 || cycles < best) best = cycles;
+    }
+    console_quiet -= b->quiet;
+    if (b->teardown) b->teardown();
+    
+    *min = (unsigned int)udiv64(best, b->iterations);
+    *mean = (unsigned int)udiv64(total, b->iterations * BENCH_ROUNDS);
+}
+
+// Benchmark name, indented and padded to a column
+static void print_name(const char* name) {
+    print("  ");
+    print(name);
+    for (int i = strlen(name); i < 16; i++) print(" ");
+}
+
+// List the registered benchmarks
+void bench_list() {
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("\n  Benchmark       Iters  Measures\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        print_name(benches[i].name);
+        print_padded(benches[i].iterations, 5);
+        print("  ");
+        print(benches[i].help);
+        print("\n");
+    }
+    print("\n");
+}
+
+// Run one benchmark by name, or all of them (name 0 or ""). Results
+// are printed once all have run, so console_line cannot scroll them
+// away. Returns the number run: 0 if the name is unknown.
+int bench_run(const char* name) {
+    int all = (!name || name[0] == '\0');
+    unsigned int min[BENCH_COUNT];
+    unsigned int mean[BENCH_COUNT];
+    int done[BENCH_COUNT];
+    int ran = 0;
+    
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        done[i] = all || strcmp(benches[i].name, name) == 0;
+        if (done[i]) {
+            run_one(&benches[i], &min[i], &mean[i]);
+            ran++;
+        }
+    }
+    if (ran == 0) {
+        print("Error: Unknown benchmark (try 'bench list')\n");
+        return 0;
+    }
+    
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("\n  Benchmark results (cycles per iteration, best and mean of ");
+    print_int(BENCH_ROUNDS);
+    print(" rounds)\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("  Benchmark        Iters         min        mean\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    serial_print("BENCH-BEGIN tsc_khz=");
+    serial_uint(tsc_khz);
+    serial_print("\n");
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        if (!done[i]) continue;
+    
+        print_name(benches[i].name);
+        print_padded(benches[i].iterations, 5);
+        print_padded(min[i], 12);
+        print_padded(mean[i], 12);
+        print("\n");
+    
+        serial_print("BENCH name=");
+        serial_print(benches[i].name);
+        serial_print(" iters=");
+        serial_uint(benches[i].iterations);
+        serial_print(" rounds=");
+        serial_uint(BENCH_ROUNDS);
+        serial_print(" min=");
+        serial_uint(min[i]);
+        serial_print(" mean=");
+        serial_uint(mean[i]);
+        serial_print(" unit=cycles\n");
+    }
+    serial_print("BENCH-END count=");
+    serial_uint(ran);
+    serial_print("\n");
+    
+    print("\n");
+    return ran;
+}
@@ -0,0 +1,23 @@
+// bench.h - In-kernel benchmark registry
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_ROUNDS 5                 // Timed rounds per benchmark (after one warmup)
+#define BENCH_OPTION "bench"           // Boot option: "bench" or "bench=<name>"
+
+// One benchmark: setup, an iteration body timed with the TSC, teardown
+typedef struct {
+    const char* name;
+    const char* help;
+    int iterations;                    // Body calls per round
+    int quiet;                         // Console output dropped while timing
+    void (*setup)();
+    void (*body)(int i);
+    void (*teardown)();
+} bench_t;
+
+// bench functions
+void bench_list();
+int bench_run(const char* name);
+
+#endif
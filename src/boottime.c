@@ -0,0 +1,61 @@
+// boottime.c - Boot phase timestamps for the boottime command
+#include "kernel.h"
+#include "boottime.h"
+
+static boot_phase_t phases[BOOT_MAX_PHASES];
+static int phase_count = 0;
+
+// Record that a boot phase has just finished
+void boot_phase(const char* name) {
+    if (phase_count == BOOT_MAX_PHASES) return;
+    phases[phase_count].name = name;
+    phases[phase_count].tsc = rdtsc();
+    phase_count++;
+}
+
+// Print one row: phase name, its duration and the time since entry
+static void print_phase(const char* name, unsigned long long start, unsigned long long end) {
+    print("  ");
+    print(name);
+    for (int i = strlen(name); i < 24; i++) print(" ");
+    
+    unsigned int took = tsc_to_us(end - start);
+    unsigned int since = tsc_to_us(end - boot_tsc_entry);
+    for (unsigned int v = 10000000; v > 1 && took < v; v /= 10) print(" ");
+    print_int(took);
+    print(" us ");
+    for (unsigned int v = 10000000; v > 1 && since < v; v /= 10) print(" ");
+    print_int(since);
+    print(" us\n");
+}
+
+// Show how long each boot phase took, from the multiboot entry point
+// to the first shell prompt
+void boot_show_times() {
+    print("\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("                  Boot Timeline\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n");
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("  Phase                       Took   Since entry\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    print_phase("BSS cleared", boot_tsc_entry, boot_tsc_bss);
+    unsigned long long prev = boot_tsc_bss;
+    for (int i = 0; i < phase_count; i++) {
+        print_phase(phases[i].name, prev, phases[i].tsc);
+        prev = phases[i].tsc;
+    }
+    
+    print("\n  Time to prompt: ");
+    set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
+    print_int(tsc_to_us(prev - boot_tsc_entry));
+    print(" us");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (TSC at ");
+    print_int(tsc_khz / 1000);
+    print(" MHz)\n\n");
+}
@@ -0,0 +1,21 @@
+// boottime.h - Boot phase timestamps
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#define BOOT_MAX_PHASES 24
+
+// A boot phase and the TSC when it finished
+typedef struct {
+    const char* name;
+    unsigned long long tsc;
+} boot_phase_t;
+
+// Boot timing functions
+void boot_phase(const char* name);
+void boot_show_times();
+
+// asm/boot.asm
+extern unsigned long long boot_tsc_entry;   // First instruction after GRUB
+extern unsigned long long boot_tsc_bss;     // BSS cleared, about to call C
+
+#endif
@@ -0,0 +1,302 @@
+// checkpoint.c - Checkpoint images of scheduler, pager and IPC state
+#include "kernel.h"
+#include "checkpoint.h"
+#include "scheduler.h"
+#include "memory.h"
+#include "ipc.h"
+#include "bcache.h"
+#include "ramfs.h"
+
+// The image is built in a heap buffer allocated on first use, then
+// copied to a fixed disk region so it outlives a reboot. The buffer
+// keeps the last image, so restore needs no disk within one boot.
+static unsigned char* image = 0;
+static int image_valid = 0;
+
+#define CKPT_PAYLOAD (CKPT_BYTES - sizeof(ckpt_header_t))
+
+void ckpt_put(ckpt_t* c, const void* src, unsigned int len) {
+    if (c->error || len > CKPT_PAYLOAD - c->size) {
+        c->error = 1;
+        return;
+    }
+    memcpy(c->data + c->size, src, len);
+    c->size += len;
+}
+
+void ckpt_get(ckpt_t* c, void* dst, unsigned int len) {
+    if (c->error || len > c->size - c->pos) {
+        c->error = 1;
+        memset(dst, 0, len);
+        return;
+    }
+    memcpy(dst, c->data + c->pos, len);
+    c->pos += len;
+}
+
+// Step over data a check pass does not need to look at
+void ckpt_skip(ckpt_t* c, unsigned int len) {
+    if (c->error || len > c->size - c->pos) {
+        c->error = 1;
+        return;
+    }
+    c->pos += len;
+}
+
+void ckpt_put_int(ckpt_t* c, int value) {
+    ckpt_put(c, &value, sizeof(value));
+}
+
+int ckpt_get_int(ckpt_t* c) {
+    int value;
+    ckpt_get(c, &value, sizeof(value));
+    return value;
+}
+
+// Sections start with a tag, so a loader that reads too much or too
+// little fails at the next one instead of misreading the rest
+void ckpt_section(ckpt_t* c, unsigned int tag) {
+    ckpt_put_int(c, tag);
+}
+
+void ckpt_expect(ckpt_t* c, unsigned int tag) {
+    if ((unsigned int)ckpt_get_int(c) != tag) c->error = 1;
+}
+
+// FNV-1a over 32-bit words, then the odd bytes
+static unsigned int checksum(const unsigned char* data, unsigned int len) {
+    unsigned int hash = 2166136261u;
+    unsigned int i = 0;
+    for (; i + 4 <= len; i += 4) {
+        hash ^= *(const unsigned int*)(data + i);
+        hash *= 16777619u;
+    }
+    for (; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Sections copy tables whole, so an image only fits a kernel built
+// with the same table sizes and structure layouts
+static unsigned int config_hash() {
+    static const unsigned int params[] = {
+        FRAME_COUNT, PAGE_SIZE, SWAP_SLOTS, PROC_CHUNK, MAX_PAGES_PER_PROCESS,
+        MEMGROUP_COUNT, SHM_SEGMENTS, SHM_MAX_PAGES, KSM_BUCKETS,
+        SCHED_LAT_BUCKETS, IPC_QUEUE_SLOTS, IPC_MSG_MAX, HUGE_PAGE_PAGES,
+        sizeof(frame_t), sizeof(page_entry_t), sizeof(memgroup_t),
+        sizeof(shm_segment_t), sizeof(readahead_t), sizeof(sched_stats_t)
+    };
+    return checksum((const unsigned char*)params, sizeof(params));
+}
+
+// File-backed pages are saved as offsets into the initrd, so an image
+// is only valid with the initrd it was taken with. Hashed once, since
+// the archive never changes.
+static unsigned int initrd_hash() {
+    static unsigned int hash;
+    static int hashed = 0;
+    if (!hashed) {
+        unsigned int size;
+        const unsigned char* data = (const unsigned char*)ramfs_archive(&size);
+        hash = checksum(data, size);
+        hashed = 1;
+    }
+    return hash;
+}
+
+// Move sectors between the image and its disk region through the
+// elevator, which merges them into BLK_MAX_MERGE-sector commands. The
+// buffer cache is bypassed: a multi-megabyte stream would only evict
+// everything useful from it.
+static int disk_transfer(unsigned int first, unsigned int count, int write) {
+    for (unsigned int i = first; i < first + count; i++) {
+        if (blk_submit(CKPT_LBA + i, (char*)image + i * SECTOR_SIZE, write) < 0) {
+            return -1;
+        }
+    }
+    if (blk_run() < 0) return -1;
+    return write ? ata_flush() : 0;
+}
+
+static unsigned int image_sectors(const ckpt_header_t* hdr) {
+    return (sizeof(ckpt_header_t) + hdr->bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+static void print_error(const char* msg) {
+    set_color(COLOR_RED, COLOR_BLACK);
+    print("Error: ");
+    print(msg);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// checkpoint: snapshot every process, page table, frame, swap slot and
+// mailbox, with their counters
+void checkpoint_save() {
+    if (!image) {
+        image = (unsigned char*)kalloc(CKPT_BYTES);
+        if (!image) {
+            print_error("Not enough kernel heap for a checkpoint image");
+            return;
+        }
+    }
+    
+    unsigned long long start = rdtsc();
+    ckpt_header_t* hdr = (ckpt_header_t*)image;
+    ckpt_t c = {image + sizeof(ckpt_header_t), 0, 0, 0};
+    image_valid = 0;
+    
+    int processes = scheduler_save(&c);
+    ipc_save(&c);
+    int pages = memory_save(&c);
+    ckpt_section(&c, CKPT_SEC_END);
+    if (c.error) {
+        print_error("State does not fit in a checkpoint image");
+        return;
+    }
+    
+    hdr->magic = CKPT_MAGIC;
+    hdr->version = CKPT_VERSION;
+    hdr->config = config_hash();
+    hdr->initrd = initrd_hash();
+    hdr->bytes = c.size;
+    hdr->checksum = checksum(c.data, c.size);
+    hdr->tick = timer_now();
+    hdr->processes = processes;
+    hdr->pages = pages;
+    image_valid = 1;
+    unsigned int build_us = tsc_to_us(rdtsc() - start);
+    
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("Checkpoint at tick ");
+    print_int(hdr->tick);
+    print(": ");
+    print_int(processes);
+    print(" processes, ");
+    print_int(pages);
+    print(" pages, ");
+    print_int((sizeof(ckpt_header_t) + c.size + 1023) / 1024);
+    print(" KB in ");
+    print_int(build_us);
+    print(" us\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    if (!ata_drive()->present) {
+        print("No disk: kept in memory until reboot\n");
+        return;
+    }
+    start = rdtsc();
+    if (disk_transfer(0, image_sectors(hdr), 1) < 0) {
+        print_error("Disk write failed; kept in memory only");
+        return;
+    }
+    print("Written to disk at LBA ");
+    print_int(CKPT_LBA);
+    print(" (");
+    print_int(image_sectors(hdr));
+    print(" sectors) in ");
+    print_int(tsc_to_us(rdtsc() - start));
+    print(" us\n");
+}
+
+// Read the image from disk into the buffer: the header sector first,
+// to learn the size. Returns 0 or an error message.
+static const char* load_from_disk() {
+    if (!ata_drive()->present) return "No checkpoint taken and no disk to read one from";
+    if (!image) {
+        image = (unsigned char*)kalloc(CKPT_BYTES);
+        if (!image) return "Not enough kernel heap for a checkpoint image";
+    }
+    
+    const ckpt_header_t* hdr = (const ckpt_header_t*)image;
+    if (disk_transfer(0, 1, 0) < 0) return "Disk read failed";
+    if (hdr->magic != CKPT_MAGIC) return "No checkpoint on disk";
+    if (hdr->bytes > CKPT_PAYLOAD) return "Checkpoint on disk is corrupt";
+    if (disk_transfer(1, image_sectors(hdr) - 1, 0) < 0) return "Disk read failed";
+    return 0;
+}
+
+// restore: replace all processes and pager state with the last
+// checkpoint, from memory if one was taken since boot, else from disk
+void checkpoint_restore() {
+    unsigned long long start = rdtsc();
+    int from_disk = !image_valid;
+    const char* error = from_disk ? load_from_disk() : 0;
+    if (error) {
+        print_error(error);
+        return;
+    }
+    unsigned int read_us = tsc_to_us(rdtsc() - start);
+    
+    // Check everything before touching any state
+    const ckpt_header_t* hdr = (const ckpt_header_t*)image;
+    if (hdr->magic != CKPT_MAGIC || hdr->bytes > CKPT_PAYLOAD) {
+        print_error("Checkpoint image is corrupt");
+        return;
+    }
+    if (hdr->version != CKPT_VERSION) {
+        print_error("Checkpoint was written by another kernel version");
+        return;
+    }
+    if (hdr->config != config_hash()) {
+        print_error("Checkpoint was taken with different table sizes");
+        return;
+    }
+    if (hdr->initrd != initrd_hash()) {
+        print_error("Checkpoint was taken with a different initrd");
+        return;
+    }
+    ckpt_t c = {image + sizeof(ckpt_header_t), hdr->bytes, 0, 0};
+    if (checksum(c.data, c.size) != hdr->checksum) {
+        print_error("Checkpoint checksum mismatch");
+        return;
+    }
+    
+    // Parse every section once without applying it: PIDs, slots, queue
+    // membership, message sizes, pager indices, reverse maps, swap counts
+    // and image offsets must all hold up
+    start = rdtsc();
+    ckpt_t check = c;
+    scheduler_check(&check);
+    ipc_check(&check);
+    memory_check(&check);
+    ckpt_expect(&check, CKPT_SEC_END);
+    if (check.error) {
+        print_error("Checkpoint is inconsistent; nothing restored");
+        return;
+    }
+    image_valid = 1;
+    
+    // The scheduler section kills the current processes, then the
+    // others refill the mailboxes and pages they freed. Having passed
+    // the checks, this can only fail if the kernel heap runs out.
+    int processes = scheduler_load(&c);
+    ipc_load(&c);
+    int pages = memory_load(&c);
+    ckpt_expect(&c, CKPT_SEC_END);
+    if (c.error) {
+        scheduler_kill_all();
+        print_error("Out of kernel heap restoring the checkpoint; all processes removed");
+        return;
+    }
+    
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("Restored tick ");
+    print_int(hdr->tick);
+    print(": ");
+    print_int(processes);
+    print(" processes, ");
+    print_int(pages);
+    print(" pages in ");
+    print_int(tsc_to_us(rdtsc() - start));
+    print(" us");
+    if (from_disk) {
+        print(" (disk read ");
+        print_int(read_us);
+        print(" us)");
+    }
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
@@ -0,0 +1,54 @@
+// checkpoint.h - Save and restore scheduler, pager and IPC state
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "ata.h"
+
+#define CKPT_MAGIC 0x504B434D          // "MCKP", starts an image
+#define CKPT_VERSION 3                 // Bump when any section's layout changes
+#define CKPT_LBA 8192                  // Disk region holding the image (past diskbench's)
+#define CKPT_SECTORS 8192              // Region size: 4 MB
+#define CKPT_BYTES (CKPT_SECTORS * SECTOR_SIZE)
+
+// Section tags, in image order
+#define CKPT_SEC_MEMORY 0x4D454D31     // "1MEM"
+#define CKPT_SEC_SCHED  0x44485331     // "1SHD"
+#define CKPT_SEC_IPC    0x43504931     // "1IPC"
+#define CKPT_SEC_END    0x444E4531     // "1END"
+
+// Image header. The payload follows, padded to whole sectors on disk.
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int config;           // Table sizes and layouts it was built with
+    unsigned int initrd;           // Hash of the initrd image pages point into
+    unsigned int bytes;            // Payload size
+    unsigned int checksum;         // Of the payload
+    unsigned int tick;             // Scheduler tick at checkpoint time
+    unsigned int processes;
+    unsigned int pages;            // Page images stored (frames and swap)
+} ckpt_header_t;
+
+// Image being written or read. Running past the buffer sets error
+// instead of failing each call, so savers and loaders check once.
+typedef struct ckpt {
+    unsigned char* data;
+    unsigned int size;             // Bytes written, or bytes in the image
+    unsigned int pos;              // Next byte to read
+    int error;
+} ckpt_t;
+
+// Stream functions for the subsystems' save and load hooks
+void ckpt_put(ckpt_t* c, const void* src, unsigned int len);
+void ckpt_get(ckpt_t* c, void* dst, unsigned int len);
+void ckpt_skip(ckpt_t* c, unsigned int len);
+void ckpt_put_int(ckpt_t* c, int value);
+int ckpt_get_int(ckpt_t* c);
+void ckpt_section(ckpt_t* c, unsigned int tag);
+void ckpt_expect(ckpt_t* c, unsigned int tag);
+
+// Shell commands
+void checkpoint_save();
+void checkpoint_restore();
+
+#endif
@@ -0,0 +1,227 @@
+// elf.c - ELF32 loader with demand-paged segments
+#include "kernel.h"
+#include "elf.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "ramfs.h"
+#include "syscall.h"
+
+// One image record per scheduler slot, allocated PROC_CHUNK at a time
+// as the process table grows
+static elf_image_t* images[PID_MAX / PROC_CHUNK];
+#define IMAGE(i) (&images[(i) / PROC_CHUNK][(i) % PROC_CHUNK])
+
+// Memory at ELF_USER_BASE that programs run in: one address space, the
+// simulated pager's page 0 up to its stack page (0 if not reserved)
+#define ELF_REGION_BYTES (MAX_PAGES_PER_PROCESS * PAGE_SIZE)
+static unsigned char* user_region = 0;
+
+// Reserve the program region. Called right after the heap is set up,
+// before anything else can allocate across ELF_USER_BASE.
+void elf_init() {
+    user_region = (unsigned char*)kalloc_at(ELF_USER_BASE, ELF_REGION_BYTES);
+}
+
+// Image records for slot chunk n. Returns 0 if the heap is exhausted.
+int elf_grow(int n) {
+    if (!images[n]) {
+        images[n] = (elf_image_t*)kalloc(PROC_CHUNK * sizeof(elf_image_t));
+        if (!images[n]) return 0;
+        for (int i = 0; i < PROC_CHUNK; i++) images[n][i].pid = -1;
+    }
+    return 1;
+}
+
+// Find a program by module name or path, then in the bin directory
+static const char* elf_open(const char* name, unsigned int* size) {
+    const char* data = ramfs_open(name, size);
+    if (data || name[0] == '/') return data;
+    
+    char path[ELF_PATH_LEN];
+    int len = 0;
+    for (const char* p = ELF_BIN_DIR; *p; p++) path[len++] = *p;
+    while (*name && len < ELF_PATH_LEN - 1) path[len++] = *name++;
+    path[len] = '\0';
+    return ramfs_open(path, size);
+}
+
+static void elf_error(const char* message) {
+    set_color(COLOR_RED, COLOR_BLACK);
+    print("Error: ");
+    print(message);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Check that a file is a static i386 executable whose program headers
+// fit inside it. Returns the header, or 0. Sizes come from the file, so
+// ranges are checked against what is left of it and never summed.
+static const elf_header_t* elf_check(const char* data, unsigned int size) {
+    const elf_header_t* hdr = (const elf_header_t*)data;
+    
+    if (size < sizeof(elf_header_t) || *(const unsigned int*)hdr->ident != ELF_MAGIC) {
+        elf_error("Not an ELF file");
+        return 0;
+    }
+    if (hdr->ident[4] != ELFCLASS32 || hdr->ident[5] != ELFDATA2LSB ||
+        hdr->type != ET_EXEC || hdr->machine != EM_386) {
+        elf_error("Not a 32-bit i386 executable");
+        return 0;
+    }
+    if (hdr->phentsize != sizeof(elf_phdr_t) || hdr->phoff > size ||
+        (unsigned int)hdr->phnum * sizeof(elf_phdr_t) > size - hdr->phoff) {
+        elf_error("Bad program header table");
+        return 0;
+    }
+    return hdr;
+}
+
+// Load an executable into a new process. Segments are only recorded in
+// the page table; each page is read from the file on its first fault,
+// so start-up cost follows the pages touched rather than the file size.
+// Returns the new PID, or -1.
+int elf_exec(const char* name) {
+    unsigned int size;
+    const char* data = elf_open(name, &size);
+    if (!data) {
+        elf_error("No such program");
+        return -1;
+    }
+    
+    const elf_header_t* hdr = elf_check(data, size);
+    if (!hdr) return -1;
+    const elf_phdr_t* phdr = (const elf_phdr_t*)(data + hdr->phoff);
+    
+    // Address range of the loadable segments
+    unsigned int low = 0xFFFFFFFF;
+    unsigned int high = 0;
+    for (int i = 0; i < hdr->phnum; i++) {
+        if (phdr[i].type != PT_LOAD || phdr[i].memsz == 0) continue;
+        
+        if (phdr[i].offset > size || phdr[i].filesz > size - phdr[i].offset ||
+            phdr[i].filesz > phdr[i].memsz || phdr[i].vaddr + phdr[i].memsz < phdr[i].vaddr ||
+            (phdr[i].vaddr - phdr[i].offset) % PAGE_SIZE != 0) {
+            elf_error("Bad segment");
+            return -1;
+        }
+        if (phdr[i].vaddr < low) low = phdr[i].vaddr;
+        if (phdr[i].vaddr + phdr[i].memsz > high) high = phdr[i].vaddr + phdr[i].memsz;
+    }
+    if (high == 0) {
+        elf_error("No loadable segments");
+        return -1;
+    }
+    
+    unsigned int base = low & ~(PAGE_SIZE - 1);
+    int image_pages = (high - base + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (image_pages > MAX_PAGES_PER_PROCESS - ELF_STACK_PAGES) {
+        elf_error("Program does not fit in the address space");
+        return -1;
+    }
+    if (hdr->entry < low || hdr->entry >= high) {
+        elf_error("Entry point outside the program");
+        return -1;
+    }
+    
+    int pid = scheduler_create_process(ELF_DEFAULT_BURST, ELF_DEFAULT_PRIORITY);
+    if (pid == -1) {
+        elf_error("Maximum processes reached");
+        return -1;
+    }
+    
+    // Every page starts anonymous (zero-filled: bss, heap and stack);
+    // pages overlapping file contents are then backed by the image.
+    // Segment p_offset and p_vaddr agree modulo the page size, so a page
+    // maps the file bytes at the matching offset.
+    int mapped = memory_allocate_pages(pid, MAX_PAGES_PER_PROCESS);
+    int file_pages = 0;
+    for (int i = 0; i < hdr->phnum; i++) {
+        if (phdr[i].type != PT_LOAD || phdr[i].filesz == 0) continue;
+        
+        unsigned int first = phdr[i].vaddr & ~(PAGE_SIZE - 1);
+        unsigned int file_end = phdr[i].vaddr + phdr[i].filesz;
+        const char* seg = data + phdr[i].offset - (phdr[i].vaddr - first);
+        for (unsigned int va = first; mapped && va < file_end; va += PAGE_SIZE) {
+            unsigned int bytes = file_end - va;
+            if (bytes > PAGE_SIZE) bytes = PAGE_SIZE;
+            
+            mapped = memory_map_file(pid, (va - base) / PAGE_SIZE, (const unsigned char*)seg + (va - first), bytes);
+            file_pages += mapped;
+        }
+    }
+    
+    // A page that failed to map would read as zeros: fail rather than
+    // start a program with holes in it
+    if (!mapped) {
+        scheduler_kill_process(pid);
+        elf_error("Cannot map the program");
+        return -1;
+    }
+    
+    elf_image_t* image = IMAGE(scheduler_slot(pid));
+    image->pid = pid;
+    int len = 0;
+    while (name[len] && len < ELF_NAME_LEN - 1) {
+        image->name[len] = name[len];
+        len++;
+    }
+    image->name[len] = '\0';
+    image->base = base;
+    image->entry = hdr->entry;
+    image->image_pages = image_pages;
+    image->file_pages = file_pages;
+    image->file = data;
+    image->file_size = size;
+    
+    // Start-up touches only the entry page and the top of the stack.
+    // A fault can fail (memory group limit, swap full), so count what
+    // actually became resident.
+    int entry_page = (hdr->entry - base) / PAGE_SIZE;
+    int stack_page = MAX_PAGES_PER_PROCESS - 1;
+    memory_access_page(pid, entry_page, 0);
+    memory_access_page(pid, stack_page, 1);
+    image->startup_pages = memory_page_resident(pid, entry_page);
+    if (stack_page != entry_page) {
+        image->startup_pages += memory_page_resident(pid, stack_page);
+    }
+    
+    return pid;
+}
+
+// Run a loaded program in ring 3 until it exits. There is no MMU behind
+// the simulated pager, so the whole image is copied to ELF_USER_BASE,
+// where the program is linked, with bss and stack zeroed; the stack is
+// the top of that address space. Returns 0 if the program cannot run
+// here, else 1 with its exit code (-1 if it faulted) in *code.
+int elf_run(int pid, int* code) {
+    const elf_image_t* image = elf_image(pid);
+    if (!image) return 0;
+    if (!user_region) {
+        elf_error("No memory reserved for user programs");
+        return 0;
+    }
+    if (image->base != ELF_USER_BASE) {
+        elf_error("Program is not linked to run at 0x400000");
+        return 0;
+    }
+    
+    const char* data = image->file;
+    const elf_header_t* hdr = (const elf_header_t*)data;
+    const elf_phdr_t* phdr = (const elf_phdr_t*)(data + hdr->phoff);
+    memset(user_region, 0, ELF_REGION_BYTES);
+    for (int i = 0; i < hdr->phnum; i++) {
+        if (phdr[i].type != PT_LOAD || phdr[i].filesz == 0) continue;
+        memcpy(user_region + (phdr[i].vaddr - ELF_USER_BASE), data + phdr[i].offset, phdr[i].filesz);
+    }
+    
+    *code = user_exec(pid, image->entry, ELF_USER_BASE + ELF_REGION_BYTES);
+    return 1;
+}
+
+// Program loaded into a process, if any
+const elf_image_t* elf_image(int pid) {
+    int slot = scheduler_slot(pid);
+    if (slot == -1 || IMAGE(slot)->pid != pid) return 0;
+    const elf_image_t* image = IMAGE(slot);
+    return image;
+}
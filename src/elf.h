@@ -0,0 +1,71 @@
+// elf.h - ELF32 executable loader
+#ifndef ELF_H
+#define ELF_H
+
+#define ELF_STACK_PAGES 1              // Top pages of the address space
+#define ELF_USER_BASE 0x400000         // Where user programs are linked (Makefile -Ttext-segment)
+#define ELF_DEFAULT_BURST 20
+#define ELF_DEFAULT_PRIORITY 1
+#define ELF_NAME_LEN 32
+#define ELF_BIN_DIR "/bin/"             // Searched for bare program names
+#define ELF_PATH_LEN 64
+
+// ELF identification and types
+#define ELF_MAGIC 0x464C457F           // "\x7FELF"
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define ET_EXEC 2
+#define EM_386 3
+#define PT_LOAD 1
+
+// ELF file header
+typedef struct {
+    unsigned char ident[16];
+    unsigned short type;
+    unsigned short machine;
+    unsigned int version;
+    unsigned int entry;
+    unsigned int phoff;
+    unsigned int shoff;
+    unsigned int flags;
+    unsigned short ehsize;
+    unsigned short phentsize;
+    unsigned short phnum;
+    unsigned short shentsize;
+    unsigned short shnum;
+    unsigned short shstrndx;
+} elf_header_t;
+
+// Program header
+typedef struct {
+    unsigned int type;
+    unsigned int offset;
+    unsigned int vaddr;
+    unsigned int paddr;
+    unsigned int filesz;
+    unsigned int memsz;
+    unsigned int flags;
+    unsigned int align;
+} elf_phdr_t;
+
+// Loaded program, per process slot
+typedef struct {
+    int pid;                   // -1 if unused
+    char name[ELF_NAME_LEN];
+    unsigned int base;         // Virtual address of page 0
+    unsigned int entry;
+    int image_pages;           // Pages covered by PT_LOAD segments
+    int file_pages;            // Pages with bytes from the file
+    int startup_pages;         // Pages made resident by start-up
+    const char* file;          // Executable in the initrd
+    unsigned int file_size;
+} elf_image_t;
+
+// Loader functions
+void elf_init();
+int elf_grow(int n);
+int elf_exec(const char* name);
+int elf_run(int pid, int* code);
+const elf_image_t* elf_image(int pid);
+
+#endif
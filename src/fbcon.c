@@ -0,0 +1,230 @@
+// fbcon.c - Framebuffer console: a text grid drawn from cached glyphs
+#include "kernel.h"
+#include "fbcon.h"
+#include "klib.h"
+
+// Text is kept as VGA-style cells ((color << 8) | char). Printing only
+// updates cells; fbcon_flush draws the cells that differ from what the
+// screen shows, within the dirty rows. Scrolling moves the ring's top
+// row instead of copying text.
+
+static int active = 0;
+static unsigned char* fb;
+static unsigned int pitch;
+static int cols, rows;
+static int col = 0, row = 0;
+static int top = 0;                    // Ring row shown as screen row 0
+static int dirty_first, dirty_last;    // Screen rows to redraw (first > last: none)
+static int use_sse2 = 0;
+
+static unsigned short cells[FBCON_MAX_ROWS * FBCON_MAX_COLS];
+static unsigned short shown[FBCON_MAX_ROWS * FBCON_MAX_COLS];
+
+// Pixel values of the 16 VGA colours in the framebuffer's format
+static unsigned int palette[16];
+static const unsigned int vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+// Glyph cache: each glyph in each colour pair, rendered once into
+// ready-to-copy pixel rows. cache_slot holds slot + 1 (0: not rendered).
+static unsigned int glyph_cache[FBCON_CACHE_GLYPHS][FONT_HEIGHT * FONT_WIDTH] __attribute__((aligned(16)));
+static unsigned short cache_slot[256][FONT_GLYPHS];
+static int cache_used = 0;
+
+// Scale an 8-bit channel into a field of the pixel format
+static unsigned int channel(unsigned int value, int position, int size) {
+    return (value >> (8 - size)) << position;
+}
+
+// Use the framebuffer GRUB set up, if it is 32 bpp RGB. Returns 0 (and
+// the VGA text console stays in use) otherwise.
+int fbcon_init(unsigned int magic, multiboot_info_t* mbi) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !mbi ||
+        !(mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER) ||
+        mbi->framebuffer_type != MULTIBOOT_FRAMEBUFFER_RGB ||
+        mbi->framebuffer_bpp != FBCON_BPP ||
+        (mbi->framebuffer_addr >> 32) != 0) {
+        return 0;
+    }
+    
+    fb = (unsigned char*)(unsigned int)mbi->framebuffer_addr;
+    pitch = mbi->framebuffer_pitch;
+    cols = mbi->framebuffer_width / FONT_WIDTH;
+    rows = mbi->framebuffer_height / FONT_HEIGHT;
+    if (cols > FBCON_MAX_COLS) cols = FBCON_MAX_COLS;
+    if (rows > FBCON_MAX_ROWS) rows = FBCON_MAX_ROWS;
+    if (cols < VGA_WIDTH || rows < VGA_HEIGHT) return 0;
+    
+    for (int i = 0; i < 16; i++) {
+        unsigned int rgb = vga_rgb[i];
+        palette[i] = channel((rgb >> 16) & 0xFF, mbi->red_position, mbi->red_size) |
+                     channel((rgb >> 8) & 0xFF, mbi->green_position, mbi->green_size) |
+                     channel(rgb & 0xFF, mbi->blue_position, mbi->blue_size);
+    }
+    
+    // 16-byte stores need 16-byte aligned glyph rows on screen
+    use_sse2 = klib_has_sse2() && (((unsigned int)fb | pitch) & 15) == 0;
+    active = 1;
+    fbcon_clear(VGA_COLOR_DEFAULT);
+    return 1;
+}
+
+int fbcon_active() {
+    return active;
+}
+
+int fbcon_cols() {
+    return cols;
+}
+
+int fbcon_rows() {
+    return rows;
+}
+
+// Cells of a screen row
+static unsigned short* row_cells(int screen_row) {
+    int ring_row = top + screen_row;
+    if (ring_row >= rows) ring_row -= rows;
+    return &cells[ring_row * cols];
+}
+
+static void mark_dirty(int first, int last) {
+    if (first < dirty_first) dirty_first = first;
+    if (last > dirty_last) dirty_last = last;
+}
+
+static void blank_row(unsigned short* line, unsigned char color) {
+    unsigned short blank = (color << 8) | ' ';
+    for (int i = 0; i < cols; i++) {
+        line[i] = blank;
+    }
+}
+
+void fbcon_clear(unsigned char color) {
+    for (int r = 0; r < rows; r++) {
+        blank_row(&cells[r * cols], color);
+    }
+    // Nothing on screen is known: the first flush draws every cell
+    memset(shown, 0xFF, sizeof(shown));
+    top = 0;
+    col = 0;
+    row = 0;
+    dirty_first = 0;
+    dirty_last = rows - 1;
+}
+
+void fbcon_putc(char c, unsigned char color) {
+    if (c == '\n') {
+        col = 0;
+        row++;
+    } else if (c == '\b') {
+        if (col > 0) {
+            col--;
+            row_cells(row)[col] = (color << 8) | ' ';
+            mark_dirty(row, row);
+        }
+    } else {
+        row_cells(row)[col] = (color << 8) | (unsigned char)c;
+        mark_dirty(row, row);
+        col++;
+        if (col >= cols) {
+            col = 0;
+            row++;
+        }
+    }
+    
+    if (row >= rows) {
+        row = rows - 1;
+        top = (top + 1 == rows) ? 0 : top + 1;
+        blank_row(row_cells(row), color);
+        mark_dirty(0, rows - 1);
+    }
+}
+
+// Pixels of a character in a colour pair, rendering it on first use.
+// A full cache is emptied and refilled.
+static const unsigned int* glyph(unsigned short cell) {
+    unsigned int ch = cell & 0xFF;
+    unsigned int color = cell >> 8;
+    if (ch < FONT_FIRST || ch >= FONT_FIRST + FONT_GLYPHS) ch = '?';
+    ch -= FONT_FIRST;
+    
+    int slot = cache_slot[color][ch] - 1;
+    if (slot >= 0) {
+        return glyph_cache[slot];
+    }
+    
+    if (cache_used == FBCON_CACHE_GLYPHS) {
+        memset(cache_slot, 0, sizeof(cache_slot));
+        cache_used = 0;
+    }
+    slot = cache_used++;
+    cache_slot[color][ch] = slot + 1;
+    
+    unsigned int fg = palette[color & 0x0F];
+    unsigned int bg = palette[(color >> 4) & 0x0F];
+    unsigned int* pixels = glyph_cache[slot];
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        unsigned char bits = font8x8[ch][y];
+        for (int x = 0; x < FONT_WIDTH; x++) {
+            pixels[y * FONT_WIDTH + x] = (bits & (0x80 >> x)) ? fg : bg;
+        }
+    }
+    return pixels;
+}
+
+// Copy a cached glyph to the screen: one 32-byte row per scan line,
+// as 32-bit stores or two aligned SSE2 stores
+
+static void blit32(unsigned char* dst, const unsigned int* src) {
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        unsigned int* d = (unsigned int*)dst;
+        d[0] = src[0];
+        d[1] = src[1];
+        d[2] = src[2];
+        d[3] = src[3];
+        d[4] = src[4];
+        d[5] = src[5];
+        d[6] = src[6];
+        d[7] = src[7];
+        dst += pitch;
+        src += FONT_WIDTH;
+    }
+}
+
+typedef int v4si __attribute__((vector_size(16)));
+
+__attribute__((target("sse2")))
+static void blit_sse2(unsigned char* dst, const unsigned int* src) {
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        ((v4si*)dst)[0] = ((const v4si*)src)[0];
+        ((v4si*)dst)[1] = ((const v4si*)src)[1];
+        dst += pitch;
+        src += FONT_WIDTH;
+    }
+}
+
+// Draw every dirty cell that differs from what the screen shows
+void fbcon_flush() {
+    if (!active || dirty_first > dirty_last) return;
+    
+    for (int r = dirty_first; r <= dirty_last; r++) {
+        const unsigned short* line = row_cells(r);
+        unsigned short* seen = &shown[r * cols];
+        unsigned char* dst = fb + r * FONT_HEIGHT * pitch;
+    
+        for (int c = 0; c < cols; c++) {
+            if (line[c] == seen[c]) continue;
+            seen[c] = line[c];
+            if (use_sse2) {
+                blit_sse2(dst + c * FONT_WIDTH * 4, glyph(line[c]));
+            } else {
+                blit32(dst + c * FONT_WIDTH * 4, glyph(line[c]));
+            }
+        }
+    }
+    dirty_first = rows;
+    dirty_last = -1;
+}
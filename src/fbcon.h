@@ -0,0 +1,30 @@
+// fbcon.h - Text console on a linear framebuffer
+#ifndef FBCON_H
+#define FBCON_H
+
+#include "multiboot.h"
+
+#define FBCON_WIDTH 1280               // Mode requested in boot.asm's multiboot header
+#define FBCON_HEIGHT 1024
+#define FBCON_BPP 32                   // The only depth drawn; others keep VGA text
+#define FBCON_MAX_COLS 256
+#define FBCON_MAX_ROWS 192
+#define FBCON_CACHE_GLYPHS 1024        // Rendered glyph/colour pairs kept
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 8
+#define FONT_FIRST 32                  // Glyphs cover ' ' to '~'
+#define FONT_GLYPHS 95
+
+extern const unsigned char font8x8[FONT_GLYPHS][FONT_HEIGHT];
+
+// Framebuffer console functions
+int fbcon_init(unsigned int magic, multiboot_info_t* mbi);
+int fbcon_active();
+int fbcon_cols();
+int fbcon_rows();
+void fbcon_putc(char c, unsigned char color);
+void fbcon_clear(unsigned char color);
+void fbcon_flush();
+
+#endif
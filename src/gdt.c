@@ -0,0 +1,45 @@
+// gdt.c - Global descriptor table and task state segment
+#include "gdt.h"
+
+static gdt_entry_t gdt[GDT_ENTRIES];
+static gdt_ptr_t gdt_ptr;
+static tss_t tss;
+
+// Stack the CPU switches to on int 0x80 and sysenter
+static unsigned char kernel_stack[KERNEL_STACK_SIZE] __attribute__((aligned(16)));
+
+static void gdt_set(int index, unsigned int base, unsigned int limit,
+                    unsigned char access, unsigned char granularity) {
+    gdt[index].base_low = base & 0xFFFF;
+    gdt[index].base_mid = (base >> 16) & 0xFF;
+    gdt[index].base_high = (base >> 24) & 0xFF;
+    gdt[index].limit_low = limit & 0xFFFF;
+    gdt[index].granularity = ((limit >> 16) & 0x0F) | (granularity & 0xF0);
+    gdt[index].access = access;
+}
+
+// Replace GRUB's segments with flat kernel and user segments and a TSS
+void gdt_init() {
+    gdt_set(0, 0, 0, 0, 0);                      // Null
+    gdt_set(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);       // Kernel code
+    gdt_set(2, 0, 0xFFFFFFFF, 0x92, 0xCF);       // Kernel data
+    gdt_set(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);       // User code (DPL 3)
+    gdt_set(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);       // User data (DPL 3)
+    
+    unsigned char* raw = (unsigned char*)&tss;
+    for (unsigned int i = 0; i < sizeof(tss); i++) raw[i] = 0;
+    tss.ss0 = KERNEL_DS;
+    tss.esp0 = gdt_kernel_stack();
+    tss.iomap_base = sizeof(tss);                // No I/O bitmap: ring 3 gets no ports
+    gdt_set(5, (unsigned int)&tss, sizeof(tss) - 1, 0x89, 0x00);
+    
+    gdt_ptr.limit = sizeof(gdt) - 1;
+    gdt_ptr.base = (unsigned int)&gdt;
+    gdt_flush(&gdt_ptr);
+    tss_flush(TSS_SEL);
+}
+
+// Top of the ring 0 stack used by system call entries
+unsigned int gdt_kernel_stack() {
+    return (unsigned int)(kernel_stack + KERNEL_STACK_SIZE);
+}
@@ -0,0 +1,54 @@
+// gdt.h - Global descriptor table and task state segment
+#ifndef GDT_H
+#define GDT_H
+
+// Segment selectors. The order (kernel code, kernel data, user code,
+// user data) is the layout sysenter/sysexit require.
+#define KERNEL_CS 0x08
+#define KERNEL_DS 0x10
+#define USER_CS   0x1B                 // 0x18 | RPL 3
+#define USER_DS   0x23                 // 0x20 | RPL 3
+#define TSS_SEL   0x28
+
+#define GDT_ENTRIES 6
+#define KERNEL_STACK_SIZE 8192         // Stack for ring 3 -> ring 0 entries
+
+// GDT descriptor
+typedef struct {
+    unsigned short limit_low;
+    unsigned short base_low;
+    unsigned char base_mid;
+    unsigned char access;
+    unsigned char granularity;
+    unsigned char base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+// Operand of lgdt/lidt
+typedef struct {
+    unsigned short limit;
+    unsigned int base;
+} __attribute__((packed)) gdt_ptr_t;
+
+// 32-bit task state segment (only ss0/esp0 are used)
+typedef struct {
+    unsigned int prev_tss;
+    unsigned int esp0;
+    unsigned int ss0;
+    unsigned int esp1, ss1, esp2, ss2;
+    unsigned int cr3, eip, eflags;
+    unsigned int eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    unsigned int es, cs, ss, ds, fs, gs;
+    unsigned int ldt;
+    unsigned short trap;
+    unsigned short iomap_base;
+} __attribute__((packed)) tss_t;
+
+// GDT functions
+void gdt_init();
+unsigned int gdt_kernel_stack();
+
+// asm/syscall.asm
+void gdt_flush(gdt_ptr_t* ptr);
+void tss_flush(unsigned short selector);
+
+#endif
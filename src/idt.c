@@ -0,0 +1,31 @@
+// idt.c - Interrupt descriptor table
+#include "idt.h"
+
+static idt_entry_t idt[IDT_ENTRIES];
+static gdt_ptr_t idt_ptr;
+
+void idt_set_gate(int vector, unsigned int handler, unsigned char type_attr) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+    idt[vector].selector = KERNEL_CS;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = type_attr;
+}
+
+// Load an IDT with the CPU exceptions routed to syscall_fault
+void idt_init() {
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt[i].offset_low = 0;
+        idt[i].offset_high = 0;
+        idt[i].selector = 0;
+        idt[i].zero = 0;
+        idt[i].type_attr = 0;
+    }
+    for (int i = 0; i < IDT_EXCEPTIONS; i++) {
+        idt_set_gate(i, (unsigned int)exception_stubs + i * 8, IDT_INT_GATE);
+    }
+    
+    idt_ptr.limit = sizeof(idt) - 1;
+    idt_ptr.base = (unsigned int)&idt;
+    idt_flush(&idt_ptr);
+}
@@ -0,0 +1,31 @@
+// idt.h - Interrupt descriptor table
+#ifndef IDT_H
+#define IDT_H
+
+#include "gdt.h"
+
+#define IDT_ENTRIES 256
+#define IDT_EXCEPTIONS 32
+
+// Gate types
+#define IDT_INT_GATE 0x8E              // Present, DPL 0, 32-bit interrupt gate
+#define IDT_USER_GATE 0xEE             // Same, callable from ring 3
+
+// IDT descriptor
+typedef struct {
+    unsigned short offset_low;
+    unsigned short selector;
+    unsigned char zero;
+    unsigned char type_attr;
+    unsigned short offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+// IDT functions
+void idt_init();
+void idt_set_gate(int vector, unsigned int handler, unsigned char type_attr);
+
+// asm/syscall.asm
+void idt_flush(gdt_ptr_t* ptr);
+extern char exception_stubs[];         // One 8-byte stub per exception vector
+
+#endif
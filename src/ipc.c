@@ -0,0 +1,334 @@
+// ipc.c - Lock-free inter-process message queues
+#include "kernel.h"
+#include "ipc.h"
+#include "checkpoint.h"
+
+// One mailbox per scheduler slot, allocated PROC_CHUNK at a time as
+// the process table grows (ipc_grow)
+static ipc_queue_t* mailboxes[PID_MAX / PROC_CHUNK];
+static int mailbox_slots = 0;
+#define MAILBOX(i) (&mailboxes[(i) / PROC_CHUNK][(i) % PROC_CHUNK])
+
+// Private queues for ipcbench
+static ipc_queue_t bench_queues[2];
+
+// Empty a queue: slot i is free for the sender at position i
+static void queue_init(ipc_queue_t* q, int owner) {
+    // A receiver still blocked here loses the mailbox: let it run
+    while (scheduler_wake_one(&q->receivers) != -1);
+    
+    q->head = 0;
+    q->tail = 0;
+    q->waiting = 0;
+    wait_queue_init(&q->receivers);
+    q->owner = owner;
+    q->sent = 0;
+    q->received = 0;
+    for (int i = 0; i < IPC_QUEUE_SLOTS; i++) {
+        q->slots[i].seq = i;
+    }
+}
+
+// Claim a slot with compare-and-swap on the tail, fill it, then publish
+// it by advancing its sequence number. Returns IPC_OK or IPC_FULL.
+static int queue_push(ipc_queue_t* q, int sender, const char* data, int length) {
+    unsigned int pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    ipc_slot_t* slot;
+    
+    while (1) {
+        slot = &q->slots[pos & (IPC_QUEUE_SLOTS - 1)];
+        unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int diff = (int)(seq - pos);
+        
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return IPC_FULL;           // Slot still holds an unread message
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    
+    slot->msg.sender = sender;
+    slot->msg.length = length;
+    memcpy(slot->msg.data, data, length);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return IPC_OK;
+}
+
+// Take the oldest published message. Only the owner receives, so the
+// head needs no compare-and-swap. Returns IPC_OK or IPC_EMPTY.
+static int queue_pop(ipc_queue_t* q, ipc_msg_t* msg) {
+    unsigned int pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    ipc_slot_t* slot = &q->slots[pos & (IPC_QUEUE_SLOTS - 1)];
+    unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    
+    if ((int)(seq - (pos + 1)) < 0) {
+        return IPC_EMPTY;
+    }
+    
+    msg->sender = slot->msg.sender;
+    msg->length = slot->msg.length;
+    memcpy(msg->data, slot->msg.data, msg->length);
+    
+    __atomic_store_n(&q->head, pos + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + IPC_QUEUE_SLOTS, __ATOMIC_RELEASE);
+    return IPC_OK;
+}
+
+// Mailbox of a live process, reset if its slot was last used by another PID
+static ipc_queue_t* mailbox(int pid) {
+    int slot = scheduler_slot(pid);
+    if (slot == -1) return 0;
+    
+    ipc_queue_t* q = MAILBOX(slot);
+    if (q->owner != pid) {
+        queue_init(q, pid);
+    }
+    return q;
+}
+
+// Nothing to do at boot: mailbox() sets each mailbox up on first use
+void ipc_init() {
+}
+
+// Mailboxes for slot chunk n, added when the scheduler grows its process
+// table. A cleared mailbox has owner 0, which no PID matches. Returns 0
+// if the heap is exhausted.
+int ipc_grow(int n) {
+    if (!mailboxes[n]) {
+        mailboxes[n] = (ipc_queue_t*)kalloc(PROC_CHUNK * sizeof(ipc_queue_t));
+        if (!mailboxes[n]) return 0;
+        memset(mailboxes[n], 0, PROC_CHUNK * sizeof(ipc_queue_t));
+    }
+    mailbox_slots = (n + 1) * PROC_CHUNK;
+    return 1;
+}
+
+// Drop a terminated process's messages. Called before its slot is
+// freed; a mailbox it never used may still name an earlier owner, and
+// is left alone.
+void ipc_reset(int pid) {
+    int slot = scheduler_slot(pid);
+    if (slot == -1 || MAILBOX(slot)->owner != pid) return;
+    queue_init(MAILBOX(slot), -1);
+}
+
+// Send a message. A receiver blocked on the mailbox is woken directly.
+int ipc_send(int from, int to, const char* data, int length) {
+    ipc_queue_t* q = mailbox(to);
+    if (!q) return IPC_NO_PROCESS;
+    
+    if (length > IPC_MSG_MAX) length = IPC_MSG_MAX;
+    if (length < 0) length = 0;
+    
+    if (queue_push(q, from, data, length) != IPC_OK) {
+        return IPC_FULL;
+    }
+    q->sent++;
+    
+    if (__atomic_exchange_n(&q->waiting, 0, __ATOMIC_ACQ_REL) &&
+        scheduler_wake_one(&q->receivers) != -1) {
+        return IPC_WOKE;
+    }
+    return IPC_OK;
+}
+
+// Receive a message. Unless timeout is IPC_NOWAIT, an empty mailbox
+// puts the process on the mailbox's wait queue until a sender wakes it
+// or timeout ticks pass (IPC_FOREVER: no limit).
+int ipc_recv(int pid, ipc_msg_t* msg, int timeout) {
+    ipc_queue_t* q = mailbox(pid);
+    if (!q) return IPC_NO_PROCESS;
+    
+    if (queue_pop(q, msg) == IPC_OK) {
+        q->received++;
+        return IPC_OK;
+    }
+    if (timeout == IPC_NOWAIT) return IPC_EMPTY;
+    
+    // Announce the wait, then look again so a message sent in between
+    // is not missed
+    __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+    if (queue_pop(q, msg) == IPC_OK) {
+        __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+        q->received++;
+        return IPC_OK;
+    }
+    
+    // A stale waiting flag (timed out, or already blocked) only costs a
+    // sender a look at an empty wait queue
+    if (!scheduler_wait(&q->receivers, pid, timeout > 0 ? timeout : 0)) {
+        return IPC_EMPTY;              // Already waiting
+    }
+    return IPC_BLOCKED;
+}
+
+// Messages waiting in a process's mailbox
+int ipc_pending(int pid) {
+    int slot = scheduler_slot(pid);
+    if (slot == -1 || MAILBOX(slot)->owner != pid) return 0;
+    return (int)(MAILBOX(slot)->tail - MAILBOX(slot)->head);
+}
+
+// Wait queue of a process's mailbox, for re-blocking a receiver when a
+// checkpoint is restored
+wait_queue_t* ipc_wait_queue(int pid) {
+    ipc_queue_t* q = mailbox(pid);
+    return q ? &q->receivers : 0;
+}
+
+// Write the mailboxes of live processes and their unread messages to
+// a checkpoint image
+void ipc_save(ckpt_t* c) {
+    ckpt_section(c, CKPT_SEC_IPC);
+    
+    int count = 0;
+    for (int i = 0; i < mailbox_slots; i++) {
+        if (MAILBOX(i)->owner > 0 && scheduler_slot(MAILBOX(i)->owner) == i) count++;
+    }
+    ckpt_put_int(c, count);
+    
+    for (int i = 0; i < mailbox_slots; i++) {
+        ipc_queue_t* q = MAILBOX(i);
+        if (q->owner <= 0 || scheduler_slot(q->owner) != i) continue;
+        
+        ckpt_put_int(c, q->owner);
+        ckpt_put_int(c, q->sent);
+        ckpt_put_int(c, q->received);
+        ckpt_put_int(c, q->waiting);
+        ckpt_put_int(c, q->tail - q->head);
+        for (unsigned int pos = q->head; pos != q->tail; pos++) {
+            const ipc_msg_t* msg = &q->slots[pos & (IPC_QUEUE_SLOTS - 1)].msg;
+            ckpt_put_int(c, msg->sender);
+            ckpt_put_int(c, msg->length);
+            ckpt_put(c, msg->data, msg->length);
+        }
+    }
+}
+
+// Check a checkpoint's IPC section without changing anything: owners
+// are processes in the image, queues and messages within their limits
+void ipc_check(ckpt_t* c) {
+    ckpt_expect(c, CKPT_SEC_IPC);
+    int count = ckpt_get_int(c);
+    
+    for (int n = 0; n < count && !c->error; n++) {
+        if (scheduler_image_slot(ckpt_get_int(c)) == -1) c->error = 1;
+        ckpt_skip(c, 3 * sizeof(int));           // sent, received, waiting
+        int pending = ckpt_get_int(c);
+        if (pending < 0 || pending > IPC_QUEUE_SLOTS) c->error = 1;
+        for (int i = 0; i < pending && !c->error; i++) {
+            ckpt_skip(c, sizeof(int));           // sender
+            int length = ckpt_get_int(c);
+            if (length < 0 || length > IPC_MSG_MAX) c->error = 1;
+            ckpt_skip(c, length);
+        }
+    }
+}
+
+// Refill mailboxes from a checkpoint image. The scheduler section comes
+// first: owners exist and blocked receivers are already queued, so the
+// ring is reset here without waking them.
+void ipc_load(ckpt_t* c) {
+    ckpt_expect(c, CKPT_SEC_IPC);
+    int count = ckpt_get_int(c);
+    
+    for (int n = 0; n < count && !c->error; n++) {
+        ipc_queue_t* q = mailbox(ckpt_get_int(c));
+        if (!q) {
+            c->error = 1;
+            return;
+        }
+        q->sent = ckpt_get_int(c);
+        q->received = ckpt_get_int(c);
+        q->waiting = ckpt_get_int(c);
+        q->head = 0;
+        q->tail = 0;
+        for (int i = 0; i < IPC_QUEUE_SLOTS; i++) {
+            q->slots[i].seq = i;
+        }
+        
+        int pending = ckpt_get_int(c);
+        if (pending < 0 || pending > IPC_QUEUE_SLOTS) c->error = 1;
+        for (int i = 0; i < pending && !c->error; i++) {
+            ipc_msg_t msg;
+            msg.sender = ckpt_get_int(c);
+            msg.length = ckpt_get_int(c);
+            if (msg.length < 0 || msg.length > IPC_MSG_MAX) {
+                c->error = 1;
+                break;
+            }
+            ckpt_get(c, msg.data, msg.length);
+            queue_push(q, msg.sender, msg.data, msg.length);
+        }
+    }
+}
+
+// Print a number right-aligned in a column
+static void print_padded(int value, int width) {
+    int digits = 1;
+    for (int n = value; n >= 10; n /= 10) digits++;
+    for (int i = digits; i < width; i++) print(" ");
+    print_int(value);
+}
+
+// ipcbench: throughput (fill and drain the ring) and ping-pong round
+// trips between two queues, for several message sizes
+void ipc_benchmark() {
+    static const int sizes[] = {8, 32, IPC_MSG_MAX};
+    char payload[IPC_MSG_MAX];
+    ipc_msg_t msg;
+    
+    for (int i = 0; i < IPC_MSG_MAX; i++) payload[i] = 'a' + i % 26;
+    
+    print("\n  ");
+    print_int(IPC_BENCH_MSGS);
+    print(" messages per throughput run, ");
+    print_int(IPC_BENCH_TRIPS);
+    print(" round trips, ");
+    print_int(IPC_QUEUE_SLOTS);
+    print(" slots\n\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("  Bytes   Cycles/msg      Msgs/sec   RTT cycles\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+        queue_init(&bench_queues[0], -1);
+        queue_init(&bench_queues[1], -1);
+        
+        // Throughput
+        unsigned long long start = rdtsc();
+        int sent = 0;
+        while (sent < IPC_BENCH_MSGS) {
+            while (sent < IPC_BENCH_MSGS &&
+                   queue_push(&bench_queues[0], 0, payload, size) == IPC_OK) {
+                sent++;
+            }
+            while (queue_pop(&bench_queues[0], &msg) == IPC_OK);
+        }
+        unsigned int per_msg = (unsigned int)udiv64(rdtsc() - start, IPC_BENCH_MSGS);
+        unsigned int rate = per_msg ? (unsigned int)udiv64((unsigned long long)tsc_khz * 1000, per_msg) : 0;
+        
+        // Round trip: ping on queue 0, pong on queue 1
+        start = rdtsc();
+        for (int i = 0; i < IPC_BENCH_TRIPS; i++) {
+            queue_push(&bench_queues[0], 1, payload, size);
+            queue_pop(&bench_queues[0], &msg);
+            queue_push(&bench_queues[1], 2, msg.data, msg.length);
+            queue_pop(&bench_queues[1], &msg);
+        }
+        unsigned int rtt = (unsigned int)udiv64(rdtsc() - start, IPC_BENCH_TRIPS);
+        
+        print_padded(size, 7);
+        print_padded(per_msg, 13);
+        print_padded(rate, 14);
+        print_padded(rtt, 13);
+        print("\n");
+    }
+    print("\n");
+}
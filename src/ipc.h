@@ -0,0 +1,64 @@
+// ipc.h - Inter-process message queues
+#ifndef IPC_H
+#define IPC_H
+
+#include "scheduler.h"
+
+#define IPC_QUEUE_SLOTS 16             // Messages per mailbox (power of two)
+#define IPC_MSG_MAX 128                // Largest payload in bytes
+#define IPC_BENCH_MSGS 20000           // Messages per throughput run
+#define IPC_BENCH_TRIPS 5000           // Round trips per latency run
+
+// Results of ipc_send/ipc_recv
+#define IPC_OK 0
+#define IPC_WOKE 1                     // Sent, and the blocked receiver was woken
+#define IPC_FULL -1                    // Mailbox has no free slot
+#define IPC_EMPTY -2                   // Nothing to receive
+#define IPC_BLOCKED -3                 // Receiver is now PROC_WAITING
+#define IPC_NO_PROCESS -4
+
+// ipc_recv timeouts (otherwise a number of ticks)
+#define IPC_NOWAIT 0                   // Return IPC_EMPTY at once
+#define IPC_FOREVER -1                 // Wait until a message arrives
+
+// Message
+typedef struct {
+    int sender;        // PID of the sender (0 for the shell)
+    int length;
+    char data[IPC_MSG_MAX];
+} ipc_msg_t;
+
+// Ring slot: seq tells producers and consumers whose turn it is
+typedef struct {
+    volatile unsigned int seq;
+    ipc_msg_t msg;
+} ipc_slot_t;
+
+// Bounded lock-free queue (multiple senders, one receiver)
+typedef struct {
+    volatile unsigned int head;        // Next slot to receive from
+    volatile unsigned int tail;        // Next slot to claim for sending
+    volatile int waiting;              // Receiver blocked on this queue
+    wait_queue_t receivers;            // Where the blocked receiver waits
+    int owner;                         // PID owning the mailbox (-1 if none)
+    int sent;
+    int received;
+    ipc_slot_t slots[IPC_QUEUE_SLOTS];
+} ipc_queue_t;
+
+// IPC functions
+void ipc_init();
+int ipc_grow(int n);
+void ipc_reset(int pid);
+int ipc_send(int from, int to, const char* data, int length);
+int ipc_recv(int pid, ipc_msg_t* msg, int timeout);
+int ipc_pending(int pid);
+wait_queue_t* ipc_wait_queue(int pid);
+void ipc_save(struct ckpt* c);
+void ipc_load(struct ckpt* c);
+void ipc_check(struct ckpt* c);
+
+// Shell commands
+void ipc_benchmark();
+
+#endif
@@ -0,0 +1,72 @@
+// irq.c - 8259 PIC remapping and hardware interrupt dispatch
+#include "kernel.h"
+#include "irq.h"
+#include "idt.h"
+
+static irq_handler_t handlers[IRQ_COUNT];
+
+// Move IRQ 0-15 off the exception vectors (the BIOS puts the timer on
+// vector 8, the double fault), mask every line and install the stubs.
+// Interrupts stay disabled until a user of an IRQ turns them on.
+void irq_init() {
+    outb(PIC1_CMD, 0x11);              // ICW1: initialise, expect ICW4
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, IRQ_VECTOR_BASE);  // ICW2: vector offsets
+    outb(PIC2_DATA, IRQ_VECTOR_BASE + 8);
+    outb(PIC1_DATA, 0x04);             // ICW3: slave on IRQ 2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);             // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01);
+    outb(PIC1_DATA, 0xFB);             // Mask all but the cascade
+    outb(PIC2_DATA, 0xFF);
+    
+    for (int i = 0; i < IRQ_COUNT; i++) {
+        handlers[i] = 0;
+        idt_set_gate(IRQ_VECTOR_BASE + i, (unsigned int)irq_stubs + i * 8, IDT_INT_GATE);
+    }
+}
+
+void irq_register(int irq, irq_handler_t handler) {
+    handlers[irq] = handler;
+}
+
+void irq_unmask(int irq) {
+    unsigned short port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void irq_mask(int irq) {
+    unsigned short port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+// Called from irq_common. Spurious IRQ 7/15 (no bit in the in-service
+// register) must not be acknowledged.
+void irq_dispatch(int irq, unsigned int eip) {
+    if (irq == 7 || irq == 15) {
+        unsigned short cmd = irq == 7 ? PIC1_CMD : PIC2_CMD;
+        outb(cmd, 0x0B);               // OCW3: read the ISR
+        if (!(inb(cmd) & 0x80)) {
+            if (irq == 15) outb(PIC1_CMD, PIC_EOI);
+            return;
+        }
+    }
+    
+    if (handlers[irq]) {
+        handlers[irq](eip);
+    }
+    
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+// Run PIT channel 0 as a rate generator at hz
+void pit_set_frequency(unsigned int hz) {
+    unsigned int divisor = PIT_HZ / hz;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    if (divisor < 1) divisor = 1;
+    
+    outb(0x43, 0x34);                  // Channel 0, lo/hi byte, mode 2
+    outb(0x40, divisor & 0xFF);
+    outb(0x40, divisor >> 8);
+}
@@ -0,0 +1,30 @@
+// irq.h - 8259 PIC and hardware interrupt dispatch
+#ifndef IRQ_H
+#define IRQ_H
+
+#define IRQ_COUNT 16
+#define IRQ_VECTOR_BASE 0x20           // IRQ 0-15 follow the CPU exceptions
+#define IRQ_TIMER 0
+
+// PIC ports
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+
+// Handler: gets the EIP the interrupt arrived at
+typedef void (*irq_handler_t)(unsigned int eip);
+
+// IRQ functions
+void irq_init();
+void irq_register(int irq, irq_handler_t handler);
+void irq_unmask(int irq);
+void irq_mask(int irq);
+void irq_dispatch(int irq, unsigned int eip);
+void pit_set_frequency(unsigned int hz);
+
+// asm/syscall.asm
+extern char irq_stubs[];               // One 8-byte stub per IRQ
+
+#endif
@@ -3,12 +3,27 @@
 #include "shell.h"
 #include "scheduler.h"
 #include "memory.h"
+#include "module.h"
+#include "ramfs.h"
+#include "bcache.h"
+#include "ipc.h"
+#include "gdt.h"
+#include "idt.h"
+#include "irq.h"
+#include "boottime.h"
+#include "klib.h"
+#include "syscall.h"
+#include "trace.h"
+#include "bench.h"
+#include "fbcon.h"
+#include "elf.h"
 
 // VGA buffer
 volatile unsigned short* vga_buffer = (unsigned short*)0xB8000;
 int cursor_x = 0;
 int cursor_y = 0;
 unsigned char current_color = VGA_COLOR_DEFAULT;
+int console_quiet = 0;
 
 // I/O port functions
 void outb(unsigned short port, unsigned char val) {
@@ -21,6 +36,155 @@ unsigned char inb(unsigned short port) {
     return ret;
 }
 
+void outw(unsigned short port, unsigned short val) {
+    __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+unsigned short inw(unsigned short port) {
+    unsigned short ret;
+    __asm__ volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Block transfers of count 16-bit words
+void insw(unsigned short port, void* buf, int count) {
+    __asm__ volatile ("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+void outsw(unsigned short port, const void* buf, int count) {
+    __asm__ volatile ("rep outsw" : "+S"(buf), "+c"(count) : "d"(port));
+}
+
+// Serial port, for output that should outlive the screen
+static int serial_present = 0;
+
+// Program COM1 for 115200 8N1. Returns 0 if no UART answers.
+int serial_init() {
+    outb(SERIAL_PORT + 7, 0xA5);       // Scratch register round trip
+    if (inb(SERIAL_PORT + 7) != 0xA5) return 0;
+    
+    outb(SERIAL_PORT + 1, 0x00);       // No interrupts
+    outb(SERIAL_PORT + 3, 0x80);       // DLAB on: set the divisor
+    outb(SERIAL_PORT + 0, 0x01);       // 115200 baud
+    outb(SERIAL_PORT + 1, 0x00);
+    outb(SERIAL_PORT + 3, 0x03);       // 8 bits, no parity, one stop bit
+    outb(SERIAL_PORT + 2, 0xC7);       // FIFO on, cleared, 14-byte threshold
+    outb(SERIAL_PORT + 4, 0x03);       // DTR and RTS
+    serial_present = 1;
+    return 1;
+}
+
+// Send one byte, waiting for the transmit holding register
+void serial_write(char c) {
+    if (!serial_present) return;
+    while (!(inb(SERIAL_PORT + 5) & 0x20));
+    outb(SERIAL_PORT, c);
+}
+
+void serial_print(const char* str) {
+    for (int i = 0; str[i] != '\0'; i++) {
+        if (str[i] == '\n') serial_write('\r');
+        serial_write(str[i]);
+    }
+}
+
+// Power off QEMU through isa-debug-exit. Returns if the device is not
+// present (other emulators, real hardware).
+void qemu_exit(unsigned char code) {
+    outb(QEMU_EXIT_PORT, code);
+}
+
+// Kernel heap: a bump allocator over [heap_next, heap_end)
+extern char bss_end[];                 // End of the kernel image (linker.ld)
+static unsigned int heap_next = 0;
+static unsigned int heap_end = 0;
+
+// Place the heap above the kernel and the modules, up to the top of the
+// memory GRUB reports above 1 MB
+static void kheap_init(unsigned int magic, multiboot_info_t* mbi) {
+    unsigned int start = (unsigned int)bss_end;
+    if (module_end() > start) start = module_end();
+    
+    heap_end = KHEAP_DEFAULT_END;
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && mbi && (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        heap_end = 0x100000 + mbi->mem_upper * 1024;
+    }
+    heap_next = (start + KHEAP_ALIGN - 1) & ~(KHEAP_ALIGN - 1);
+    if (heap_next > heap_end) heap_next = heap_end;
+}
+
+void* kalloc(unsigned int size) {
+    size = (size + KHEAP_ALIGN - 1) & ~(KHEAP_ALIGN - 1);
+    if (size > heap_end - heap_next) return 0;
+    
+    void* p = (void*)heap_next;
+    heap_next += size;
+    return p;
+}
+
+// Take [addr, addr + size) from the heap for memory that must sit at a
+// fixed address, giving up whatever lies below it. Returns 0 if the heap
+// has already passed addr or ends before the region does.
+void* kalloc_at(unsigned int addr, unsigned int size) {
+    if (addr < heap_next || addr > heap_end || size > heap_end - addr) return 0;
+    
+    heap_next = addr;
+    return kalloc(size);
+}
+
+unsigned int kheap_free() {
+    return heap_end - heap_next;
+}
+
+// Timestamp counter
+unsigned int tsc_khz = 0;
+
+unsigned long long rdtsc() {
+    unsigned int lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+// 64-by-32 bit division without libgcc
+unsigned long long udiv64(unsigned long long n, unsigned int d) {
+    unsigned int hi = (unsigned int)(n >> 32);
+    unsigned int lo = (unsigned int)n;
+    unsigned int qhi = hi / d;
+    unsigned int rem = hi % d;
+    unsigned int qlo;
+    __asm__ ("divl %4" : "=a"(qlo), "=d"(rem) : "a"(lo), "d"(rem), "rm"(d));
+    return ((unsigned long long)qhi << 32) | qlo;
+}
+
+// Measure the TSC rate over 10ms of PIT channel 2
+void tsc_calibrate() {
+    unsigned int count = PIT_HZ / 100;
+    
+    // Enable the channel 2 gate with the speaker off
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    outb(0x43, 0xB0);                  // Channel 2, lo/hi byte, mode 0
+    outb(0x42, count & 0xFF);
+    outb(0x42, count >> 8);
+    
+    // Restart the count by pulsing the gate
+    unsigned char gate = inb(0x61) & ~0x01;
+    outb(0x61, gate);
+    outb(0x61, gate | 0x01);
+    
+    unsigned long long start = rdtsc();
+    while (!(inb(0x61) & 0x20));       // OUT2 goes high at terminal count
+    unsigned long long end = rdtsc();
+    
+    tsc_khz = (unsigned int)udiv64(end - start, 10);
+    if (tsc_khz == 0) tsc_khz = 1;
+}
+
+// Convert a TSC delta to microseconds
+unsigned int tsc_to_us(unsigned long long cycles) {
+    if (tsc_khz < 1000) return (unsigned int)udiv64(cycles * 1000, tsc_khz);
+    return (unsigned int)udiv64(cycles, tsc_khz / 1000);
+}
+
 // Set color for subsequent text
 void set_color(unsigned char foreground, unsigned char background) {
     current_color = MAKE_COLOR(foreground, background);
@@ -28,6 +192,11 @@ void set_color(unsigned char foreground, unsigned char background) {
 
 // Clear screen with current color
 void clear_screen() {
+    if (fbcon_active()) {
+        fbcon_clear(current_color);
+        return;
+    }
+    
     for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
         vga_buffer[i] = (current_color << 8) | ' ';
     }
@@ -37,6 +206,12 @@ void clear_screen() {
 
 // Print character with current color
 void print_char(char c) {
+    if (console_quiet) return;
+    if (fbcon_active()) {
+        fbcon_putc(c, current_color);
+        return;
+    }
+    
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -58,9 +233,8 @@ void print_char(char c) {
     
     if (cursor_y >= VGA_HEIGHT) {
         cursor_y = VGA_HEIGHT - 1;
-        for (int i = 0; i < VGA_WIDTH * (VGA_HEIGHT - 1); i++) {
-            vga_buffer[i] = vga_buffer[i + VGA_WIDTH];
-        }
+        memmove((void*)vga_buffer, (const void*)(vga_buffer + VGA_WIDTH),
+                VGA_WIDTH * (VGA_HEIGHT - 1) * sizeof(unsigned short));
         for (int i = 0; i < VGA_WIDTH; i++) {
             vga_buffer[VGA_WIDTH * (VGA_HEIGHT - 1) + i] = (current_color << 8) | ' ';
         }
@@ -123,18 +297,29 @@ char scancode_to_ascii(unsigned char scancode) {
 }
 
 char get_key() {
+    // Show everything printed so far before waiting
+    fbcon_flush();
+    
     while (1) {
         if (inb(0x64) & 1) {
             unsigned char scancode = inb(0x60);
             if (scancode < 0x80) {
-                return scancode_to_ascii(scancode);
+                char c = scancode_to_ascii(scancode);
+                TRACE(TRACE_KEY, c, scancode);
+                return c;
             }
         }
     }
 }
 
 // Main kernel entry point with COLORS!
-void kernel_main() {
+void kernel_main(unsigned int magic, multiboot_info_t* mbi) {
+    // Pick memcpy/strlen/... variants for this CPU
+    klib_init();
+    
+    // Framebuffer console, if GRUB set the video mode we asked for
+    fbcon_init(magic, mbi);
+    
     // Set initial color
     set_color(COLOR_WHITE, COLOR_BLACK);
     clear_screen();
@@ -171,16 +356,60 @@ void kernel_main() {
     set_color(COLOR_CYAN, COLOR_BLACK);
     print("] 100%\n\n");
     
+    boot_phase("Console and banner");
+    
     // White for subsystem init
     set_color(COLOR_WHITE, COLOR_BLACK);
     print("  [*] Initializing subsystems...\n");
     
+    // Console: framebuffer or VGA text
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    if (fbcon_active()) {
+        print("Framebuffer console: ");
+        print_int(fbcon_cols());
+        print("x");
+        print_int(fbcon_rows());
+        print(" characters\n");
+    } else {
+        print("VGA text console: 80x25 characters\n");
+    }
+    
+    // Own segments, exception handlers and system call entries
+    gdt_init();
+    idt_init();
+    irq_init();
+    syscall_init();
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("GDT/TSS loaded, system calls via int 0x80");
+    print(syscall_has_sysenter() ? " and sysenter\n" : "\n");
+    boot_phase("GDT, IDT, syscalls");
+    
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("klib: ");
+    print(klib_active()->name);
+    print(" string and memory routines\n");
+    
     // Initialize scheduler
     scheduler_init();
     set_color(COLOR_GREEN, COLOR_BLACK);
     print("      [OK] ");
     set_color(COLOR_WHITE, COLOR_BLACK);
     print("Scheduler initialized\n");
+    boot_phase("Scheduler");
+    
+    // Initialize message queues
+    ipc_init();
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("IPC mailboxes initialized\n");
+    boot_phase("IPC");
     
     // Initialize memory manager
     memory_init();
@@ -188,6 +417,88 @@ void kernel_main() {
     print("      [OK] ");
     set_color(COLOR_WHITE, COLOR_BLACK);
     print("Memory manager initialized\n");
+    boot_phase("Memory manager");
+    
+    // Calibrate the timestamp counter for benchmarks
+    tsc_calibrate();
+    boot_phase("TSC calibration");
+    
+    // Serial port for trace dumps
+    if (serial_init()) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("      [OK] ");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("Serial port COM1 at 115200 baud\n");
+    } else {
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print("      [--] ");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("No serial port\n");
+    }
+    boot_phase("Serial port");
+    
+    // Probe the disk and set up the buffer cache
+    bcache_init();
+    if (ata_init()) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("      [OK] ");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("ATA disk: ");
+        print_int(ata_drive()->sectors / 2048);
+        print(" MB\n");
+    } else {
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print("      [--] ");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("No ATA disk\n");
+    }
+    boot_phase("ATA probe, buffer cache");
+    
+    // Register shell commands
+    shell_init();
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("Shell commands registered\n");
+    boot_phase("Shell commands");
+    
+    // Pick up boot modules (scripts) loaded by GRUB
+    int mods = module_init(magic, mbi);
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print_int(mods);
+    print(" boot module(s) loaded\n");
+    boot_phase("Boot modules");
+    
+    // Kernel heap above the image and the modules (process table growth),
+    // less the region user programs run in
+    kheap_init(magic, mbi);
+    elf_init();
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("Kernel heap: ");
+    print_int(kheap_free() / 1024);
+    print(" KB\n");
+    boot_phase("Kernel heap");
+    
+    // Mount the initrd
+    int files = ramfs_init(module_find(RAMFS_MODULE));
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("      [OK] ");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("Initrd mounted (");
+    print_int(files);
+    print(" files)\n");
+    boot_phase("Initrd");
+    
+    // Headless benchmark run ("bench" or "bench=<name>" on the command line)
+    const char* suite = boot_option(BENCH_OPTION);
+    if (suite) {
+        int ran = bench_run(suite);
+        qemu_exit(ran ? 0 : 1);
+    }
     
     print("\n");
     
@@ -217,6 +528,12 @@ void kernel_main() {
     set_color(COLOR_WHITE, COLOR_BLACK);
     print("\n");
     
+    // Run the startup script, if one was loaded
+    if (module_find(SHELL_AUTORUN)) {
+        shell_source(SHELL_AUTORUN);
+    }
+    
     // Start shell
+    boot_phase("First prompt");
     shell_loop();
 }
@@ -32,10 +32,41 @@ extern volatile unsigned short* vga_buffer;
 extern int cursor_x;
 extern int cursor_y;
 extern unsigned char current_color;
+extern int console_quiet;         // Output is dropped while nonzero
 
 // I/O functions
 void outb(unsigned short port, unsigned char val);
 unsigned char inb(unsigned short port);
+void outw(unsigned short port, unsigned short val);
+unsigned short inw(unsigned short port);
+void insw(unsigned short port, void* buf, int count);
+void outsw(unsigned short port, const void* buf, int count);
+
+// Serial port (COM1, 115200 8N1)
+#define SERIAL_PORT 0x3F8
+int serial_init();
+void serial_write(char c);
+void serial_print(const char* str);
+
+// QEMU isa-debug-exit device: QEMU exits with status (code << 1) | 1
+#define QEMU_EXIT_PORT 0xF4
+void qemu_exit(unsigned char code);
+
+// Kernel heap: memory above the kernel image and boot modules. Never
+// freed; kalloc returns 0 when it runs out.
+#define KHEAP_ALIGN 16
+#define KHEAP_DEFAULT_END 0x01000000   // Top of RAM if GRUB gives no memory size
+void* kalloc(unsigned int size);
+void* kalloc_at(unsigned int addr, unsigned int size);
+unsigned int kheap_free();
+
+// Timing functions (TSC calibrated against the PIT)
+#define PIT_HZ 1193182
+extern unsigned int tsc_khz;
+unsigned long long rdtsc();
+void tsc_calibrate();
+unsigned long long udiv64(unsigned long long n, unsigned int d);
+unsigned int tsc_to_us(unsigned long long cycles);
 
 // Display functions
 void clear_screen();
@@ -45,6 +76,14 @@ void print(const char* str);
 void print_colored(const char* str, unsigned char foreground, unsigned char background);
 void print_int(int num);
 
+// String and memory functions (klib.c)
+int strlen(const char* str);
+int strcmp(const char* s1, const char* s2);
+int atoi(const char* str);
+void* memcpy(void* dst, const void* src, unsigned int n);
+void* memset(void* dst, int c, unsigned int n);
+void* memmove(void* dst, const void* src, unsigned int n);
+
 // Keyboard functions
 char scancode_to_ascii(unsigned char scancode);
 char get_key();
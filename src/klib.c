@@ -0,0 +1,388 @@
+// klib.c - memcpy/memset/memmove/strlen/strcmp, picked per CPU at boot
+#include "kernel.h"
+#include "klib.h"
+
+// Plain C loops: the reference, and the fallback for any CPU
+
+static void* byte_memcpy(void* dst, const void* src, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    for (unsigned int i = 0; i < n; i++) d[i] = s[i];
+    return dst;
+}
+
+static void* byte_memset(void* dst, int c, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    for (unsigned int i = 0; i < n; i++) d[i] = (unsigned char)c;
+    return dst;
+}
+
+static void* byte_memmove(void* dst, const void* src, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (d <= s || d >= s + n) {
+        for (unsigned int i = 0; i < n; i++) d[i] = s[i];
+    } else {
+        for (unsigned int i = n; i > 0; i--) d[i - 1] = s[i - 1];
+    }
+    return dst;
+}
+
+static int byte_strlen(const char* str) {
+    int len = 0;
+    while (str[len]) len++;
+    return len;
+}
+
+static int byte_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+// String instructions: dword moves and stores, byte tails
+
+static void* rep_memcpy(void* dst, const void* src, unsigned int n) {
+    void* d = dst;
+    unsigned int dwords = n >> 2;
+    unsigned int tail = n & 3;
+    __asm__ volatile ("rep movsl\n\t"
+                      "mov %3, %%ecx\n\t"
+                      "rep movsb"
+                      : "+D"(d), "+S"(src), "+c"(dwords)
+                      : "r"(tail)
+                      : "memory");
+    return dst;
+}
+
+static void* rep_memset(void* dst, int c, unsigned int n) {
+    void* d = dst;
+    unsigned int fill = (unsigned char)c * 0x01010101u;
+    unsigned int dwords = n >> 2;
+    unsigned int tail = n & 3;
+    __asm__ volatile ("rep stosl\n\t"
+                      "mov %3, %%ecx\n\t"
+                      "rep stosb"
+                      : "+D"(d), "+c"(dwords), "+a"(fill)
+                      : "r"(tail)
+                      : "memory");
+    return dst;
+}
+
+// Overlapping copies to a higher address run backwards: the odd tail
+// bytes first, then dwords
+static void* rep_memmove(void* dst, const void* src, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (d <= s || d >= s + n) {
+        return rep_memcpy(dst, src, n);
+    }
+    
+    d += n - 1;
+    s += n - 1;
+    unsigned int tail = n & 3;
+    unsigned int dwords = n >> 2;
+    __asm__ volatile ("std\n\t"
+                      "rep movsb\n\t"
+                      "sub $3, %%edi\n\t"
+                      "sub $3, %%esi\n\t"
+                      "mov %3, %%ecx\n\t"
+                      "rep movsl\n\t"
+                      "cld"
+                      : "+D"(d), "+S"(s), "+c"(tail)
+                      : "r"(dwords)
+                      : "memory");
+    return dst;
+}
+
+static int rep_strlen(const char* str) {
+    const char* p = str;
+    unsigned int count = 0xFFFFFFFF;
+    __asm__ volatile ("repne scasb"
+                      : "+D"(p), "+c"(count)
+                      : "a"(0)
+                      : "memory");
+    return (int)(~count - 1);
+}
+
+// SSE2: 16 bytes per step. Only used once klib_init has seen SSE2 and
+// boot.asm has enabled SSE in CR4.
+
+typedef char v16 __attribute__((vector_size(16)));
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static void* sse2_memcpy(void* dst, const void* src, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    
+    if (n >= 64) {
+        // Align the destination, then copy 64 bytes per iteration
+        unsigned int head = (16 - ((unsigned int)d & 15)) & 15;
+        for (unsigned int i = 0; i < head; i++) d[i] = s[i];
+        d += head;
+        s += head;
+        n -= head;
+        
+        while (n >= 64) {
+            v16 a = (v16)__builtin_ia32_loaddqu((const char*)s);
+            v16 b = (v16)__builtin_ia32_loaddqu((const char*)s + 16);
+            v16 c = (v16)__builtin_ia32_loaddqu((const char*)s + 32);
+            v16 e = (v16)__builtin_ia32_loaddqu((const char*)s + 48);
+            ((v16*)d)[0] = a;
+            ((v16*)d)[1] = b;
+            ((v16*)d)[2] = c;
+            ((v16*)d)[3] = e;
+            d += 64;
+            s += 64;
+            n -= 64;
+        }
+    }
+    for (unsigned int i = 0; i < n; i++) d[i] = s[i];
+    return dst;
+}
+
+SSE2 static void* sse2_memset(void* dst, int c, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    
+    if (n >= 64) {
+        unsigned int head = (16 - ((unsigned int)d & 15)) & 15;
+        for (unsigned int i = 0; i < head; i++) d[i] = (unsigned char)c;
+        d += head;
+        n -= head;
+        
+        char b = (char)c;
+        v16 fill = {b, b, b, b, b, b, b, b, b, b, b, b, b, b, b, b};
+        while (n >= 64) {
+            ((v16*)d)[0] = fill;
+            ((v16*)d)[1] = fill;
+            ((v16*)d)[2] = fill;
+            ((v16*)d)[3] = fill;
+            d += 64;
+            n -= 64;
+        }
+    }
+    for (unsigned int i = 0; i < n; i++) d[i] = (unsigned char)c;
+    return dst;
+}
+
+// Backward 16-byte blocks when the regions overlap the wrong way: each
+// block is loaded before the store that could overwrite it
+SSE2 static void* sse2_memmove(void* dst, const void* src, unsigned int n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (d <= s || d >= s + n) {
+        return sse2_memcpy(dst, src, n);
+    }
+    
+    while (n >= 16) {
+        n -= 16;
+        v16 block = (v16)__builtin_ia32_loaddqu((const char*)s + n);
+        __builtin_ia32_storedqu((char*)d + n, (v16)block);
+    }
+    while (n > 0) {
+        n--;
+        d[n] = s[n];
+    }
+    return dst;
+}
+
+// Aligned 16-byte loads never cross a page, so reading past the
+// terminator is safe. Bytes before the start are masked off.
+SSE2 static int sse2_strlen(const char* str) {
+    v16 zero = {0};
+    unsigned int offset = (unsigned int)str & 15;
+    const v16* p = (const v16*)(str - offset);
+    unsigned int mask = __builtin_ia32_pmovmskb128(__builtin_ia32_pcmpeqb128(*p, zero));
+    mask &= 0xFFFFu << offset;
+    
+    while (mask == 0) {
+        p++;
+        mask = __builtin_ia32_pmovmskb128(__builtin_ia32_pcmpeqb128(*p, zero));
+    }
+    return (int)((const char*)p - str) + __builtin_ctz(mask);
+}
+
+// Compare 16 bytes at a time while neither string is within 16 bytes
+// of the end of a page, and a byte at a time across page ends
+SSE2 static int sse2_strcmp(const char* s1, const char* s2) {
+    v16 zero = {0};
+    while (1) {
+        if (((unsigned int)s1 & (KLIB_PAGE - 1)) <= KLIB_PAGE - 16 &&
+            ((unsigned int)s2 & (KLIB_PAGE - 1)) <= KLIB_PAGE - 16) {
+            v16 a = (v16)__builtin_ia32_loaddqu(s1);
+            v16 b = (v16)__builtin_ia32_loaddqu(s2);
+            unsigned int differ = ~__builtin_ia32_pmovmskb128(__builtin_ia32_pcmpeqb128(a, b)) & 0xFFFF;
+            unsigned int end = __builtin_ia32_pmovmskb128(__builtin_ia32_pcmpeqb128(a, zero));
+            if (differ | end) {
+                int i = __builtin_ctz(differ | end);
+                return (unsigned char)s1[i] - (unsigned char)s2[i];
+            }
+            s1 += 16;
+            s2 += 16;
+        } else {
+            if (*s1 != *s2 || *s1 == '\0') {
+                return *(unsigned char*)s1 - *(unsigned char*)s2;
+            }
+            s1++;
+            s2++;
+        }
+    }
+}
+
+static const klib_ops_t variants[KLIB_VARIANTS] = {
+    {"byte", byte_memcpy, byte_memset, byte_memmove, byte_strlen, byte_strcmp},
+    {"rep",  rep_memcpy,  rep_memset,  rep_memmove,  rep_strlen,  byte_strcmp},
+    {"sse2", sse2_memcpy, sse2_memset, sse2_memmove, sse2_strlen, sse2_strcmp},
+};
+
+// rep string instructions work on every x86, so they serve until klib_init
+static const klib_ops_t* active = &variants[KLIB_REP];
+static int sse2_usable = 0;
+
+// Public entry points
+void* memcpy(void* dst, const void* src, unsigned int n) {
+    return active->memcpy(dst, src, n);
+}
+
+void* memset(void* dst, int c, unsigned int n) {
+    return active->memset(dst, c, n);
+}
+
+void* memmove(void* dst, const void* src, unsigned int n) {
+    return active->memmove(dst, src, n);
+}
+
+int strlen(const char* str) {
+    return active->strlen(str);
+}
+
+int strcmp(const char* s1, const char* s2) {
+    return active->strcmp(s1, s2);
+}
+
+int atoi(const char* str) {
+    int result = 0;
+    int sign = 1;
+    
+    if (*str == '-') {
+        sign = -1;
+        str++;
+    }
+    
+    while (*str >= '0' && *str <= '9') {
+        result = result * 10 + (*str - '0');
+        str++;
+    }
+    
+    return sign * result;
+}
+
+// Pick the fastest variant: SSE2 needs CPUID.1:EDX bit 26 and the
+// OSFXSR bit that boot.asm sets in CR4
+void klib_init() {
+    unsigned int eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    
+    unsigned long cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    
+    sse2_usable = ((edx >> 26) & 1) && (cr4 & CR4_OSFXSR);
+    active = &variants[sse2_usable ? KLIB_SSE2 : KLIB_REP];
+}
+
+// Switch variants (for comparison). Returns 0 if the CPU lacks it.
+int klib_select(int variant) {
+    if (variant < 0 || variant >= KLIB_VARIANTS) return 0;
+    if (variant == KLIB_SSE2 && !sse2_usable) return 0;
+    active = &variants[variant];
+    return 1;
+}
+
+const klib_ops_t* klib_active() {
+    return active;
+}
+
+// Other SSE2 code (the framebuffer blitter) checks here
+int klib_has_sse2() {
+    return sse2_usable;
+}
+
+// Benchmark buffers: 16-byte aligned, plus an offset copy
+static char bench_src[KLIB_BENCH_BYTES + 64] __attribute__((aligned(16)));
+static char bench_dst[KLIB_BENCH_BYTES + 64] __attribute__((aligned(16)));
+
+// Average cycles per call of one routine on one size
+static unsigned int bench_one(const klib_ops_t* ops, int op, unsigned int size) {
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < KLIB_BENCH_ITERS; i++) {
+        __asm__ volatile ("" : : : "memory");   // No hoisting of pure calls
+        switch (op) {
+        case 0: ops->memcpy(bench_dst, bench_src + 1, size); break;
+        case 1: ops->memset(bench_dst, i, size); break;
+        case 2: ops->memmove(bench_dst + 8, bench_dst, size); break;
+        case 3: ops->strlen(bench_src); break;
+        default: ops->strcmp(bench_src, bench_dst); break;
+        }
+    }
+    return (unsigned int)udiv64(rdtsc() - start, KLIB_BENCH_ITERS);
+}
+
+// Print a number right-aligned in a column
+static void print_padded(unsigned int value, int width) {
+    int digits = 1;
+    for (unsigned int v = value; v >= 10; v /= 10) digits++;
+    for (int i = digits; i < width; i++) print(" ");
+    print_int(value);
+}
+
+// Cycles per call for each routine and variant
+void klib_benchmark() {
+    static const struct {
+        const char* label;
+        int op;
+        unsigned int size;
+    } cases[] = {
+        {"memcpy   64 B ", 0, 64},
+        {"memcpy   4 KB ", 0, KLIB_BENCH_BYTES},
+        {"memset   64 B ", 1, 64},
+        {"memset   4 KB ", 1, KLIB_BENCH_BYTES},
+        {"memmove  4 KB ", 2, KLIB_BENCH_BYTES},
+        {"strlen   1 KB ", 3, 1024},
+        {"strcmp   1 KB ", 4, 1024},
+    };
+    
+    // Two equal 1 KB strings for strlen/strcmp
+    for (int i = 0; i < KLIB_BENCH_BYTES + 64; i++) {
+        bench_src[i] = 'a' + i % 26;
+    }
+    bench_src[1024] = '\0';
+    byte_memcpy(bench_dst, bench_src, 1025);
+    
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("\n  klib benchmark (cycles per call, active: ");
+    print(active->name);
+    print(")\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("  Routine            byte       rep      sse2\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    int count = sizeof(cases) / sizeof(cases[0]);
+    for (int c = 0; c < count; c++) {
+        print("  ");
+        print(cases[c].label);
+        for (int v = 0; v < KLIB_VARIANTS; v++) {
+            if (v == KLIB_SSE2 && !sse2_usable) {
+                print("         -");
+                continue;
+            }
+            // strcmp compares bench_src with bench_dst: refresh the copy
+            if (cases[c].op == 4) byte_memcpy(bench_dst, bench_src, 1025);
+            print_padded(bench_one(&variants[v], cases[c].op, cases[c].size), 10);
+        }
+        print("\n");
+    }
+    print("\n");
+}
@@ -0,0 +1,33 @@
+// klib.h - Kernel memory and string routines with per-CPU variants
+#ifndef KLIB_H
+#define KLIB_H
+
+#define KLIB_BENCH_ITERS 2000          // Calls timed per benchmark cell
+#define KLIB_BENCH_BYTES 4096          // Largest benchmark buffer
+#define KLIB_PAGE 4096                 // SSE2 strcmp never loads across one
+#define CR4_OSFXSR (1 << 9)            // OS saves SSE state: SSE enabled
+
+// Variants, slowest first
+#define KLIB_BYTE 0                    // Plain C loops
+#define KLIB_REP 1                     // rep movs/stos/scas
+#define KLIB_SSE2 2                    // 16-byte SSE2 loads and stores
+#define KLIB_VARIANTS 3
+
+// One implementation of every routine
+typedef struct {
+    const char* name;
+    void* (*memcpy)(void* dst, const void* src, unsigned int n);
+    void* (*memset)(void* dst, int c, unsigned int n);
+    void* (*memmove)(void* dst, const void* src, unsigned int n);
+    int (*strlen)(const char* str);
+    int (*strcmp)(const char* s1, const char* s2);
+} klib_ops_t;
+
+// klib functions
+void klib_init();
+int klib_select(int variant);
+const klib_ops_t* klib_active();
+int klib_has_sse2();
+void klib_benchmark();
+
+#endif
@@ -0,0 +1,15 @@
+// ksyms.h - Kernel symbol table
+#ifndef KSYMS_H
+#define KSYMS_H
+
+// Function start address and name. The table is generated at build time
+// (tools/ksyms.awk) and sorted by address.
+typedef struct {
+    unsigned int addr;
+    const char* name;
+} ksym_t;
+
+extern const ksym_t ksyms[];
+extern const int ksym_count;
+
+#endif
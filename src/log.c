@@ -0,0 +1,181 @@
+// log.c - Kernel log: printk into a ring, drained to the console later
+#include <stdarg.h>
+#include "kernel.h"
+#include "log.h"
+#include "timer.h"
+
+// printk only formats into the ring; nothing touches the screen until
+// log_flush, which the shell calls after each command. Messages above
+// the console level stay in the ring for dmesg.
+static log_record_t records[LOG_RECORDS];
+static unsigned int head = 0;          // Messages logged so far
+static unsigned int first = 0;         // First message dmesg shows
+static unsigned int console_next = 0;  // First message not yet drained
+static int console_level = LOG_INFO;
+
+static const char* level_names[LOG_LEVELS] = {"err", "warn", "info", "debug"};
+static const unsigned char level_colors[LOG_LEVELS] = {
+    COLOR_RED, COLOR_YELLOW, COLOR_WHITE, COLOR_DARK_GREY
+};
+
+static log_record_t* record(unsigned int seq) {
+    return &records[seq & (LOG_RECORDS - 1)];
+}
+
+// Formatting state: where the next character goes, and the end of
+// the record's text
+typedef struct {
+    char* out;
+    char* end;
+} cursor_t;
+
+// Append a character, dropping what does not fit
+static inline void put(cursor_t* cur, char c) {
+    if (cur->out < cur->end) *cur->out++ = c;
+}
+
+// Digits of a number, in decimal or hex (constant divisors: no div)
+static void put_uint(cursor_t* cur, unsigned int value, int hex) {
+    char digits[10];
+    int n = 0;
+    do {
+        if (hex) {
+            digits[n++] = "0123456789abcdef"[value & 15];
+            value >>= 4;
+        } else {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        }
+    } while (value);
+    while (n > 0) put(cur, digits[--n]);
+}
+
+// Format onto a record: %d %u %x %s %c and %%
+static void format(log_record_t* rec, const char* fmt, va_list ap) {
+    cursor_t cur = {rec->text + rec->len, rec->text + LOG_LINE};
+    
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            if (*fmt != '\n') put(&cur, *fmt);
+            continue;
+        }
+        fmt++;
+        if (*fmt == 'd') {
+            int value = va_arg(ap, int);
+            if (value < 0) {
+                put(&cur, '-');
+                put_uint(&cur, -(unsigned int)value, 0);
+            } else {
+                put_uint(&cur, value, 0);
+            }
+        } else if (*fmt == 'u') {
+            put_uint(&cur, va_arg(ap, unsigned int), 0);
+        } else if (*fmt == 'x') {
+            put_uint(&cur, va_arg(ap, unsigned int), 1);
+        } else if (*fmt == 's') {
+            const char* str = va_arg(ap, const char*);
+            while (str && *str) put(&cur, *str++);
+        } else if (*fmt == 'c') {
+            put(&cur, (char)va_arg(ap, int));
+        } else if (*fmt == '%') {
+            put(&cur, '%');
+        } else if (*fmt == '\0') {
+            break;
+        }
+    }
+    
+    *cur.out = '\0';
+    rec->len = cur.out - rec->text;
+}
+
+// Log a message at a level, or continue the last one (LOG_CONT). A
+// trailing newline is optional.
+void printk(int level, const char* fmt, ...) {
+    log_record_t* rec;
+    if (level == LOG_CONT && head != first) {
+        rec = record(head - 1);
+    } else {
+        if (level < 0 || level >= LOG_LEVELS) level = LOG_INFO;
+        rec = record(head++);
+        rec->tick = timer_now();
+        rec->level = level;
+        rec->quiet = console_quiet != 0;
+        rec->len = 0;
+    }
+    
+    va_list ap;
+    va_start(ap, fmt);
+    format(rec, fmt, ap);
+    va_end(ap);
+}
+
+static void print_record(const log_record_t* rec) {
+    set_color(level_colors[rec->level], COLOR_BLACK);
+    print(rec->text);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Show the messages logged since the last flush that pass the console
+// level. Messages overwritten before they could be shown are counted.
+void log_flush() {
+    if (head - console_next > LOG_RECORDS) {
+        set_color(COLOR_DARK_GREY, COLOR_BLACK);
+        print("(");
+        print_int(head - console_next - LOG_RECORDS);
+        print(" kernel messages dropped: log ring full)\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        console_next = head - LOG_RECORDS;
+    }
+    
+    for (; console_next != head; console_next++) {
+        const log_record_t* rec = record(console_next);
+        if (!rec->quiet && rec->level <= console_level) {
+            print_record(rec);
+        }
+    }
+}
+
+// dmesg: every message still in the ring, with its tick
+void log_dump() {
+    unsigned int seq = first;
+    if (head - seq > LOG_RECORDS) seq = head - LOG_RECORDS;
+    if (seq == head) {
+        print("Kernel log is empty\n");
+        return;
+    }
+    
+    for (; seq != head; seq++) {
+        const log_record_t* rec = record(seq);
+        set_color(COLOR_DARK_GREY, COLOR_BLACK);
+        print("[");
+        for (unsigned int t = 100000; t > 1 && rec->tick < t; t /= 10) print(" ");
+        print_int(rec->tick);
+        print("] ");
+        print_record(rec);
+    }
+}
+
+void log_clear() {
+    first = head;
+}
+
+int log_level() {
+    return console_level;
+}
+
+const char* log_level_name(int level) {
+    return level_names[level];
+}
+
+// Set the console level by name or number. Returns 0 if unknown.
+int log_set_level(const char* name) {
+    for (int i = 0; i < LOG_LEVELS; i++) {
+        if (strcmp(name, level_names[i]) == 0 ||
+            (name[0] == '0' + i && name[1] == '\0')) {
+            console_level = i;
+            return 1;
+        }
+    }
+    return 0;
+}
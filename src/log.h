@@ -0,0 +1,34 @@
+// log.h - Leveled kernel log kept in a ring buffer
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_RECORDS 256                // Records kept (power of two)
+#define LOG_LINE 184                   // Longest message (a 192-byte record)
+
+// Levels, most severe first
+#define LOG_ERR   0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+#define LOG_LEVELS 4
+#define LOG_CONT  -1                   // Append to the previous message
+
+// One message. The oldest is overwritten when the ring is full.
+typedef struct {
+    unsigned int tick;                 // Scheduler tick it was logged on
+    unsigned char level;
+    unsigned char quiet;               // Logged under console_quiet: never shown
+    unsigned char len;
+    char text[LOG_LINE + 1];
+} log_record_t;
+
+// Log functions
+void printk(int level, const char* fmt, ...);
+void log_flush();
+void log_dump();
+void log_clear();
+int log_level();
+int log_set_level(const char* name);
+const char* log_level_name(int level);
+
+#endif
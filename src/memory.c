@@ -2,12 +2,246 @@
 #include "kernel.h"
 #include "memory.h"
 #include "scheduler.h"
+#include "trace.h"
+#include "log.h"
+#include "ramfs.h"
+#include "checkpoint.h"
 
 static frame_t frames[FRAME_COUNT];
-static page_entry_t page_tables[MAX_PROCESSES][MAX_PAGES_PER_PROCESS];
 static int current_time = 0;
 static int page_faults = 0;
 static int page_hits = 0;
+static memgroup_t groups[MEMGROUP_COUNT];
+static const char* no_frame_reason;    // Why obtain_frame last returned -1
+static shm_segment_t shm_segments[SHM_SEGMENTS];
+
+// Page tables and per-process pager state, one per scheduler slot. They
+// are allocated PROC_CHUNK at a time alongside the PCBs (memory_grow), so
+// slot i lives in table_chunks[i / PROC_CHUNK].
+typedef struct {
+    page_entry_t pages[MAX_PAGES_PER_PROCESS];
+    readahead_t readahead;
+    int pid;                // PID owning the table (-1 if none)
+    char ready;             // Set up yet
+    unsigned char group;    // Memory group
+    char huge;              // Huge pages enabled
+} mm_table_t;
+static mm_table_t* table_chunks[PID_MAX / PROC_CHUNK];
+static int table_slots = 0;            // Slots with a table allocated
+#define TABLE(i) (&table_chunks[(i) / PROC_CHUNK][(i) % PROC_CHUNK])
+
+// Reverse-map links name a PTE by its slot and page number
+#define PTE_ID(proc_index, page) ((proc_index) * MAX_PAGES_PER_PROCESS + (page))
+
+// Read-ahead statistics
+static int ra_issued = 0;     // Pages brought in by read-ahead
+static int ra_hits = 0;       // Prefetched pages referenced before eviction
+static int ra_wasted = 0;     // Prefetched pages evicted without a reference
+
+// Page contents and the RAM-backed swap device
+static unsigned char frame_data[FRAME_COUNT][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static unsigned char swap_area[SWAP_SLOTS][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static int swap_map[SWAP_SLOTS];   // Use count per swap slot
+static int swap_used = 0;
+static int swap_read_ops = 0;
+static int swap_write_ops = 0;
+static int swap_pages_in = 0;
+static int swap_pages_out = 0;
+static int last_read_slot = -2;    // Adjacent page-ins share one read I/O
+static int file_pages_in = 0;      // Pages filled from a mapped image
+
+// Copy-on-write statistics
+static int cow_forks = 0;
+static int cow_shared = 0;         // Resident pages shared at fork time
+static int cow_copies = 0;         // Private copies made on write
+
+// Same-page merging state and statistics
+static int ksm_enabled = 0;
+static int ksm_cursor = 0;                 // Next frame in the current pass
+static int ksm_buckets[KSM_BUCKETS];       // Candidate frames by content hash
+static int ksm_scanned = 0;
+static int ksm_merged = 0;
+static int ksm_unmerged = 0;               // Merged pages split again by a write
+
+// Huge page state and statistics
+#define HUGE_BASE(page) ((page) & ~(HUGE_PAGE_PAGES - 1))
+#define HUGE_REGIONS (MAX_PAGES_PER_PROCESS / HUGE_PAGE_PAGES)
+static int huge_tables = 0;                // Page tables with huge pages enabled
+static int huge_cursor = 0;                // Next region for the promotion scanner
+static int huge_faults = 0;                // Faults that mapped a whole region
+static int huge_fallbacks = 0;             // Huge faults left to base pages: no frame run
+static int huge_saved = 0;                 // Pages a huge mapping brought in, then used
+static int huge_promotions = 0;
+static int huge_demotions = 0;             // Huge pages split to evict a page
+
+// Simulated TLB and its statistics
+static tlb_entry_t tlb[TLB_ENTRIES];
+static int tlb_hits = 0;
+static int tlb_misses = 0;
+
+static void readahead_reset(int proc_index) {
+    TABLE(proc_index)->readahead.last_fault = -1;
+    TABLE(proc_index)->readahead.stride = 0;
+    TABLE(proc_index)->readahead.next = -1;
+    TABLE(proc_index)->readahead.window = RA_INIT_WINDOW;
+}
+
+// Set up a page table the first time its slot is used, so boot cost
+// does not grow with the process table
+static void table_init(int proc_index) {
+    for (int j = 0; j < MAX_PAGES_PER_PROCESS; j++) {
+        page_entry_t* pte = &TABLE(proc_index)->pages[j];
+        pte->frame_number = -1;
+        pte->valid = 0;
+        pte->allocated = 0;
+        pte->dirty = 0;
+        pte->swap_slot = -1;
+        pte->cow = 0;
+        pte->rmap_next = -1;
+        pte->shm_id = -1;
+        pte->shm_page = -1;
+        pte->file_data = 0;
+        pte->file_bytes = 0;
+        pte->huge = 0;
+    }
+    TABLE(proc_index)->pid = -1;
+    TABLE(proc_index)->group = 0;
+    TABLE(proc_index)->huge = 0;
+    readahead_reset(proc_index);
+    TABLE(proc_index)->ready = 1;
+}
+
+// Give up every page table, to be set up again on first use
+static void tables_clear() {
+    for (int i = 0; i < table_slots; i++) {
+        TABLE(i)->ready = 0;
+        TABLE(i)->huge = 0;
+    }
+}
+
+// Page tables for slot chunk n, added when the scheduler grows its
+// process table. Returns 0 if the heap is exhausted.
+int memory_grow(int n) {
+    if (!table_chunks[n]) {
+        table_chunks[n] = (mm_table_t*)kalloc(PROC_CHUNK * sizeof(mm_table_t));
+        if (!table_chunks[n]) return 0;
+        memset(table_chunks[n], 0, PROC_CHUNK * sizeof(mm_table_t));
+    }
+    table_slots = (n + 1) * PROC_CHUNK;
+    return 1;
+}
+
+// Page table of a live PID: the one in its scheduler slot, set up on
+// first use. A table still naming another PID was not released when that
+// process died, and is refused (-1) rather than taken over.
+static int table_index(int pid) {
+    int proc_index = scheduler_slot(pid);
+    if (proc_index == -1) return -1;
+    if (!TABLE(proc_index)->ready) {
+        table_init(proc_index);
+    }
+    if (TABLE(proc_index)->pid != pid && TABLE(proc_index)->pid != -1) {
+        print("Error: Page table of PID ");
+        print_int(pid);
+        print(" is held by PID ");
+        print_int(TABLE(proc_index)->pid);
+        print("\n");
+        return -1;
+    }
+    TABLE(proc_index)->pid = pid;
+    return proc_index;
+}
+
+// Copy one page
+static void copy_page(unsigned char* dst, const unsigned char* src) {
+    memcpy(dst, src, PAGE_SIZE);
+}
+
+// Fill one page with zeroes
+static void zero_page(unsigned char* dst) {
+    memset(dst, 0, PAGE_SIZE);
+}
+
+// Allocate a run of contiguous swap slots (first fit, -1 if none)
+static int swap_alloc(int count) {
+    int run = 0;
+    for (int i = 0; i < SWAP_SLOTS; i++) {
+        if (swap_map[i] != 0) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            int first = i - count + 1;
+            for (int j = first; j <= i; j++) {
+                swap_map[j] = 1;
+            }
+            swap_used += count;
+            return first;
+        }
+    }
+    return -1;
+}
+
+// Drop one reference to a swap slot
+static void swap_free(int slot) {
+    if (slot < 0 || swap_map[slot] == 0) return;
+    if (--swap_map[slot] == 0) {
+        swap_used--;
+    }
+}
+
+// Read a page from swap into a frame
+static void swap_read(int slot, int frame) {
+    copy_page(frame_data[frame], swap_area[slot]);
+    if (slot != last_read_slot + 1) {
+        swap_read_ops++;
+    }
+    swap_pages_in++;
+    last_read_slot = slot;
+}
+
+// Empty the TLB
+static void tlb_flush_all() {
+    for (int i = 0; i < TLB_ENTRIES; i++) {
+        tlb[i].proc_index = -1;
+    }
+}
+
+// Drop the TLB entries translating a page: its own, or its region's
+static void tlb_flush(int proc_index, int page) {
+    for (int i = 0; i < TLB_ENTRIES; i++) {
+        if (tlb[i].proc_index == proc_index &&
+            (tlb[i].page == page || (tlb[i].huge && tlb[i].page == HUGE_BASE(page)))) {
+            tlb[i].proc_index = -1;
+        }
+    }
+}
+
+// Translate a resident page through the TLB. A miss walks the page
+// table and replaces the least recently used entry; a huge page fills
+// one entry for its whole region.
+static void tlb_access(int proc_index, int page, int huge) {
+    int victim = 0;
+    for (int i = 0; i < TLB_ENTRIES; i++) {
+        tlb_entry_t* e = &tlb[i];
+        if (e->proc_index == proc_index &&
+            e->page == (e->huge ? HUGE_BASE(page) : page)) {
+            e->last_use = current_time;
+            tlb_hits++;
+            return;
+        }
+        if (tlb[victim].proc_index != -1 &&
+            (e->proc_index == -1 || e->last_use < tlb[victim].last_use)) {
+            victim = i;
+        }
+    }
+    
+    tlb_misses++;
+    tlb[victim].proc_index = proc_index;
+    tlb[victim].page = huge ? HUGE_BASE(page) : page;
+    tlb[victim].huge = huge;
+    tlb[victim].last_use = current_time;
+}
 
 // Initialize memory manager
 void memory_init() {
@@ -16,25 +250,94 @@ void memory_init() {
         frames[i].page_number = -1;
         frames[i].last_access = 0;
         frames[i].valid = 0;
+        frames[i].prefetched = 0;
+        frames[i].dirty = 0;
+        frames[i].swap_slot = -1;
+        frames[i].ref_count = 0;
+        frames[i].rmap = -1;
+        frames[i].shm_id = -1;
+        frames[i].shm_page = -1;
+        frames[i].checksum = 0;
+        frames[i].ksm = 0;
+        frames[i].ksm_next = -1;
+        frames[i].group = 0;
+        frames[i].huge = 0;
+        frames[i].untouched = 0;
     }
     
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        for (int j = 0; j < MAX_PAGES_PER_PROCESS; j++) {
-            page_tables[i][j].frame_number = -1;
-            page_tables[i][j].valid = 0;
-        }
+    // Every group starts unrestricted
+    for (int i = 0; i < MEMGROUP_COUNT; i++) {
+        groups[i].min = 0;
+        groups[i].max = FRAME_COUNT;
+        groups[i].used = 0;
+        groups[i].faults = 0;
+        groups[i].hits = 0;
+        groups[i].evicted = 0;
+    }
+    
+    memset(swap_map, 0, sizeof(swap_map));
+    
+    // Page tables are set up by table_index() on first use; memory_grow
+    // hands them out with the ready flag clear
+    
+    for (int i = 0; i < SHM_SEGMENTS; i++) {
+        shm_segments[i].key = -1;
+        shm_segments[i].pages = 0;
+        shm_segments[i].attached = 0;
     }
     
     current_time = 0;
     page_faults = 0;
     page_hits = 0;
+    ra_issued = 0;
+    ra_hits = 0;
+    ra_wasted = 0;
+    swap_used = 0;
+    swap_read_ops = 0;
+    swap_write_ops = 0;
+    swap_pages_in = 0;
+    swap_pages_out = 0;
+    cow_forks = 0;
+    cow_shared = 0;
+    cow_copies = 0;
+    ksm_enabled = 0;
+    ksm_cursor = 0;
+    ksm_scanned = 0;
+    ksm_merged = 0;
+    ksm_unmerged = 0;
+    
+    for (int i = 0; i < table_slots; i++) {
+        TABLE(i)->huge = 0;
+    }
+    huge_tables = 0;
+    huge_cursor = 0;
+    huge_faults = 0;
+    huge_fallbacks = 0;
+    huge_saved = 0;
+    huge_promotions = 0;
+    huge_demotions = 0;
+    tlb_flush_all();
+    tlb_hits = 0;
+    tlb_misses = 0;
 }
 
 // Show memory statistics
 void memory_show_info() {
     int used_frames = 0;
+    int dirty_frames = 0;
+    int shared_frames = 0;
+    int saved_frames = 0;
+    int ksm_saved = 0;
     for (int i = 0; i < FRAME_COUNT; i++) {
+        if (frames[i].valid && frames[i].ksm) {
+            ksm_saved += frames[i].ref_count - 1;
+        }
         if (frames[i].valid) used_frames++;
+        if (frames[i].valid && frames[i].dirty) dirty_frames++;
+        if (frames[i].valid && frames[i].ref_count > 1) {
+            shared_frames++;
+            saved_frames += frames[i].ref_count - 1;
+        }
     }
     
     print("\n");
@@ -74,6 +377,20 @@ void memory_show_info() {
     set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
     print_int(FRAME_COUNT - used_frames);
     set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("  Dirty frames: ");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print_int(dirty_frames);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("  Swap slots used: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(swap_used);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("/");
+    print_int(SWAP_SLOTS);
     print("\n\n");
     
     set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
@@ -106,13 +423,227 @@ void memory_show_info() {
         set_color(COLOR_WHITE, COLOR_BLACK);
         print("\n");
     }
+    
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  Read-ahead:\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Pages prefetched: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(ra_issued);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (used=");
+    print_int(ra_hits);
+    print(" wasted=");
+    print_int(ra_wasted);
+    print(")\n");
+    
+    // Accuracy: share of prefetched pages that were used before eviction
+    if (ra_hits + ra_wasted > 0) {
+        print("    * Accuracy: ");
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print_int((ra_hits * 100) / (ra_hits + ra_wasted));
+        print("%");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("\n");
+    }
+    
+    // Coverage: share of would-be faults that read-ahead absorbed
+    if (ra_hits + page_faults > 0) {
+        print("    * Coverage: ");
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print_int((ra_hits * 100) / (ra_hits + page_faults));
+        print("%");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("\n");
+    }
+    
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  Swap I/O:\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Reads: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(swap_read_ops);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (");
+    print_int(swap_pages_in);
+    print(" pages)\n");
+    
+    print("    * Writes: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(swap_write_ops);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (");
+    print_int(swap_pages_out);
+    print(" pages)\n");
+    
+    print("    * Image pages read: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(file_pages_in);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  Copy-on-write:\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Forks: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(cow_forks);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (");
+    print_int(cow_shared);
+    print(" pages shared)\n");
+    
+    print("    * Copies on write: ");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print_int(cow_copies);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("    * Shared frames: ");
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print_int(shared_frames);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (saving ");
+    print_int(saved_frames);
+    print(" frames)\n");
+    
+    int segments = 0;
+    int attached = 0;
+    for (int i = 0; i < SHM_SEGMENTS; i++) {
+        if (shm_segments[i].key != -1) {
+            segments++;
+            attached += shm_segments[i].attached;
+        }
+    }
+    print("    * Shared memory segments: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(segments);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (");
+    print_int(attached);
+    print(" pages attached)\n");
+    
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  Same-page merging: ");
+    if (ksm_enabled) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("on\n");
+    } else {
+        set_color(COLOR_DARK_GREY, COLOR_BLACK);
+        print("off\n");
+    }
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Pages scanned: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(ksm_scanned);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("    * Pages merged: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(ksm_merged);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (unmerged on write: ");
+    print_int(ksm_unmerged);
+    print(")\n");
+    
+    print("    * Frames saved: ");
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print_int(ksm_saved);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    int huge_frames = 0;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (frames[i].valid && frames[i].huge) huge_frames++;
+    }
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  Huge pages (");
+    print_int(HUGE_PAGE_PAGES * PAGE_SIZE / 1024);
+    print(" KB): ");
+    set_color(huge_tables ? COLOR_GREEN : COLOR_DARK_GREY, COLOR_BLACK);
+    print_int(huge_tables);
+    print(huge_tables == 1 ? " process\n" : " processes\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Mapped: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(huge_frames / HUGE_PAGE_PAGES);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (");
+    print_int(huge_frames);
+    print(" frames)\n");
+    
+    print("    * Huge faults: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(huge_faults);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (no frame run: ");
+    print_int(huge_fallbacks);
+    print(")\n");
+    
+    print("    * Faults saved: ");
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print_int(huge_saved);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    print("    * Promotions: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(huge_promotions);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" (demoted under pressure: ");
+    print_int(huge_demotions);
+    print(")\n");
+    
+    // Reach: memory the TLB translates without a page table walk
+    int reach = 0;
+    for (int i = 0; i < TLB_ENTRIES; i++) {
+        if (tlb[i].proc_index != -1) {
+            reach += tlb[i].huge ? HUGE_PAGE_PAGES : 1;
+        }
+    }
+    print("\n");
+    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+    print("  TLB (");
+    print_int(TLB_ENTRIES);
+    print(" entries):\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("    * Hits: ");
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print_int(tlb_hits);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" misses: ");
+    set_color(COLOR_RED, COLOR_BLACK);
+    print_int(tlb_misses);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    if (tlb_hits + tlb_misses > 0) {
+        print(" (");
+        print_int((tlb_hits * 100) / (tlb_hits + tlb_misses));
+        print("% hit)");
+    }
+    print("\n");
+    
+    print("    * Reach: ");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print_int(reach * PAGE_SIZE / 1024);
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print(" KB (4 KB pages only: ");
+    print_int(TLB_ENTRIES * PAGE_SIZE / 1024);
+    print(" KB, all huge: ");
+    print_int(TLB_ENTRIES * HUGE_PAGE_PAGES * PAGE_SIZE / 1024);
+    print(" KB)\n");
     print("\n");
 }
 // Show frame allocation table
 void memory_show_frames() {
     print("\n=== Frame Allocation Table ===\n");
-    print("Frame  PID  Page  Last Access\n");
-    print("-----  ---  ----  -----------\n");
+    print("Frame  PID  Page  Refs  Last Access  Flags\n");
+    print("-----  ---  ----  ----  -----------  -----\n");
     
     for (int i = 0; i < FRAME_COUNT; i++) {
         // Frame number
@@ -121,9 +652,13 @@ void memory_show_frames() {
         print("    ");
         
         if (frames[i].valid) {
-            // PID
-            if (frames[i].pid < 10) print(" ");
-            print_int(frames[i].pid);
+            // PID (a segment page nobody maps has no owner)
+            if (frames[i].pid < 0) {
+                print(" -");
+            } else {
+                if (frames[i].pid < 10) print(" ");
+                print_int(frames[i].pid);
+            }
             print("   ");
             
             // Page
@@ -131,12 +666,26 @@ void memory_show_frames() {
             print_int(frames[i].page_number);
             print("   ");
             
+            // Share count
+            if (frames[i].ref_count < 10) print(" ");
+            print_int(frames[i].ref_count);
+            print("    ");
+            
             // Last access
             if (frames[i].last_access < 10) print(" ");
             print_int(frames[i].last_access);
+            print("           ");
+            
+            // Flags: D = dirty, R = unreferenced read-ahead, S = shm,
+            // K = merged by same-page merging, H = part of a huge page
+            print(frames[i].dirty ? "D" : "-");
+            print(frames[i].prefetched ? "R" : "-");
+            print(frames[i].shm_id != -1 ? "S" : "-");
+            print(frames[i].ksm ? "K" : "-");
+            print(frames[i].huge ? "H" : "-");
             print("\n");
         } else {
-            print("---  ----  -----------\n");
+            print("---  ----  ----  -----------  -----\n");
         }
     }
     print("\n");
@@ -152,13 +701,18 @@ int memory_get_free_frame() {
     return -1;
 }
 
-// Find LRU frame for replacement
-int memory_find_lru_frame() {
-    int lru_frame = 0;
-    int oldest_time = frames[0].last_access;
+// Find LRU frame among frames with the given prefetched flag,
+// optionally restricted to clean frames and to the frames marked in
+// allowed (0: any frame). Returns -1 if none.
+static int find_lru_frame(int prefetched, int clean_only, const char* allowed) {
+    int lru_frame = -1;
+    int oldest_time = 0;
     
-    for (int i = 1; i < FRAME_COUNT; i++) {
-        if (frames[i].last_access < oldest_time) {
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (!frames[i].valid || frames[i].prefetched != prefetched) continue;
+        if (clean_only && frames[i].dirty) continue;
+        if (allowed && !allowed[i]) continue;
+        if (lru_frame == -1 || frames[i].last_access < oldest_time) {
             oldest_time = frames[i].last_access;
             lru_frame = i;
         }
@@ -167,99 +721,1537 @@ int memory_find_lru_frame() {
     return lru_frame;
 }
 
-// Allocate pages to process
-int memory_allocate_pages(int pid, int count) {
-    pcb_t* proc = scheduler_get_process(pid);
-    if (!proc) {
-        print("Error: Process not found\n");
-        return 0;
+// Pick a victim among the allowed frames (0: any). Unreferenced
+// read-ahead pages sit below every demand-loaded page, so they are
+// reclaimed first. Among demand pages a clean one near the LRU end is
+// preferred, since dropping it costs no swap write.
+static int lru_victim(const char* allowed) {
+    int frame = find_lru_frame(1, 0, allowed);
+    if (frame != -1) {
+        return frame;
     }
     
-    if (count > MAX_PAGES_PER_PROCESS) {
-        print("Error: Too many pages requested\n");
-        return 0;
+    int lru = find_lru_frame(0, 0, allowed);
+    int clean = find_lru_frame(0, 1, allowed);
+    if (clean == -1 || clean == lru) {
+        return lru;
     }
     
-    // Mark pages as allocated but not loaded
-    for (int i = 0; i < count; i++) {
-        page_tables[pid % MAX_PROCESSES][i].valid = 0;
-        page_tables[pid % MAX_PROCESSES][i].frame_number = -1;
+    // Rank of the clean candidate in LRU order
+    int rank = 0;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (frames[i].valid && !frames[i].prefetched && (!allowed || allowed[i]) &&
+            frames[i].last_access < frames[clean].last_access) {
+            rank++;
+        }
     }
     
-    return 1;
+    return (rank < WB_SCAN_DEPTH) ? clean : lru;
 }
 
-// Access a page (simulate memory access)
-void memory_access_page(int pid, int page) {
-    current_time++;
-    
-    pcb_t* proc = scheduler_get_process(pid);
-    if (!proc) {
-        print("Error: Process ");
-        print_int(pid);
-        print(" not found\n");
+// Find LRU frame for replacement, across all frames
+int memory_find_lru_frame() {
+    return lru_victim(0);
+}
+
+// Page table entry named by a reverse-map link
+static page_entry_t* pte_by_id(int id) {
+    return &TABLE(id / MAX_PAGES_PER_PROCESS)->pages[id % MAX_PAGES_PER_PROCESS];
+}
+
+// Hand frame ownership to the first remaining mapping
+static void rmap_set_owner(int frame) {
+    int id = frames[frame].rmap;
+    if (id == -1) {
+        // Only a segment page outlives its last mapping
+        frames[frame].pid = -1;
+        frames[frame].page_number = frames[frame].shm_page;
         return;
     }
+    frames[frame].pid = TABLE(id / MAX_PAGES_PER_PROCESS)->pid;
+    frames[frame].page_number = id % MAX_PAGES_PER_PROCESS;
+}
+
+// Map a frame into a page table entry and link it into the reverse map
+static void rmap_add(int frame, int proc_index, int page) {
+    int id = PTE_ID(proc_index, page);
+    page_entry_t* pte = pte_by_id(id);
     
-    if (page >= MAX_PAGES_PER_PROCESS) {
-        print("Error: Invalid page number\n");
-        return;
+    pte->frame_number = frame;
+    pte->valid = 1;
+    pte->rmap_next = frames[frame].rmap;
+    frames[frame].rmap = id;
+    frames[frame].ref_count++;
+}
+
+// Unlink a page table entry from its frame's reverse map. Only the
+// sharers of that one frame are walked.
+static void rmap_remove(int frame, int proc_index, int page) {
+    int id = PTE_ID(proc_index, page);
+    int* link = &frames[frame].rmap;
+    
+    while (*link != -1 && *link != id) {
+        link = &pte_by_id(*link)->rmap_next;
     }
+    if (*link == -1) return;
     
-    int proc_index = pid % MAX_PROCESSES;
-    page_entry_t* pte = &page_tables[proc_index][page];
+    *link = pte_by_id(id)->rmap_next;
+    pte_by_id(id)->rmap_next = -1;
+    frames[frame].ref_count--;
+    if (frames[frame].ref_count <= 1) {
+        frames[frame].ksm = 0;
+    }
     
-    // Page hit
-    if (pte->valid) {
-        page_hits++;
-        frames[pte->frame_number].last_access = current_time;
-        print("Page hit: PID=");
-        print_int(pid);
-        print(" page=");
-        print_int(page);
-        print(" frame=");
-        print_int(pte->frame_number);
-        print("\n");
-        return;
+    if (frames[frame].pid >= 0 &&
+        PTE_ID(scheduler_slot(frames[frame].pid), frames[frame].page_number) == id) {
+        rmap_set_owner(frame);
+    }
+}
+
+// Split a huge page back into base pages. The frames stay where they
+// are; only the translation changes.
+static void huge_split(int proc_index, int base) {
+    for (int i = 0; i < HUGE_PAGE_PAGES; i++) {
+        page_entry_t* pte = &TABLE(proc_index)->pages[base + i];
+        pte->huge = 0;
+        frames[pte->frame_number].huge = 0;
     }
+    tlb_flush(proc_index, base);
+}
+
+// Is a page resident and holding unwritten data?
+static int page_is_dirty(int proc_index, int page) {
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    return pte->valid && frames[pte->frame_number].dirty;
+}
+
+// Write a dirty frame to swap together with the dirty pages next to it
+// in the owning process, as one clustered I/O. Returns pages written.
+static int writeback_cluster(int frame) {
+    int owned = frames[frame].pid >= 0;
+    int proc_index = scheduler_slot(frames[frame].pid);
+    int seed = frames[frame].page_number;
+    int first = seed;
+    int last = seed;
     
-    // Page fault
-    page_faults++;
-    print("Page fault: PID=");
-    print_int(pid);
-    print(" page=");
-    print_int(page);
+    while (owned && first > 0 && last - first + 1 < WB_CLUSTER_MAX &&
+           page_is_dirty(proc_index, first - 1)) {
+        first--;
+    }
+    while (owned && last < MAX_PAGES_PER_PROCESS - 1 && last - first + 1 < WB_CLUSTER_MAX &&
+           page_is_dirty(proc_index, last + 1)) {
+        last++;
+    }
     
-    int frame = memory_get_free_frame();
+    int slot = swap_alloc(last - first + 1);
+    if (slot == -1) {
+        // Swap is fragmented: fall back to the single page
+        first = last = seed;
+        slot = swap_alloc(1);
+        if (slot == -1) {
+            return 0;
+        }
+    }
     
-    // No free frame - use LRU replacement
-    if (frame == -1) {
-        frame = memory_find_lru_frame();
+    for (int page = first; page <= last; page++) {
+        int f = (page == seed) ? frame : TABLE(proc_index)->pages[page].frame_number;
         
-        // Evict old page
-        int old_pid = frames[frame].pid;
-        int old_page = frames[frame].page_number;
-        
-        print(" (evicting PID=");
-        print_int(old_pid);
-        print(" page=");
-        print_int(old_page);
-        print(")");
-        
-        // Invalidate old page table entry
-        page_tables[old_pid % MAX_PROCESSES][old_page].valid = 0;
+        copy_page(swap_area[slot + page - first], frame_data[f]);
+        frames[f].swap_slot = slot + page - first;
+        frames[f].dirty = 0;
+        if (owned) {
+            TABLE(proc_index)->pages[page].dirty = 0;
+        }
     }
     
-    // Load new page
+    swap_write_ops++;
+    swap_pages_out += last - first + 1;
+    return last - first + 1;
+}
+
+// Background write-back pass: clean every dirty frame in clusters.
+// Returns the number of pages written.
+int memory_writeback() {
+    int written = 0;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (frames[i].valid && frames[i].dirty) {
+            written += writeback_cluster(i);
+        }
+    }
+    return written;
+}
+
+// Set up a frame for a newly mapped page (no mappings linked yet)
+static void init_frame(int frame, int pid, int page, int prefetched) {
     frames[frame].pid = pid;
     frames[frame].page_number = page;
     frames[frame].last_access = current_time;
     frames[frame].valid = 1;
+    frames[frame].prefetched = prefetched;
+    frames[frame].dirty = 0;
+    frames[frame].swap_slot = -1;
+    frames[frame].ref_count = 0;
+    frames[frame].rmap = -1;
+    frames[frame].shm_id = -1;
+    frames[frame].shm_page = -1;
+    frames[frame].checksum = 0;
+    frames[frame].ksm = 0;
+    frames[frame].huge = 0;
+    frames[frame].untouched = 0;
+    frames[frame].group = TABLE(scheduler_slot(pid))->group;
+    groups[frames[frame].group].used++;
+}
+
+// Return a frame to the free pool
+static void free_frame(int frame) {
+    groups[frames[frame].group].used--;
+    frames[frame].valid = 0;
+    frames[frame].prefetched = 0;
+    frames[frame].dirty = 0;
+    frames[frame].ref_count = 0;
+    frames[frame].rmap = -1;
+    frames[frame].shm_id = -1;
+    frames[frame].ksm = 0;
+    frames[frame].huge = 0;
+    frames[frame].untouched = 0;
+    swap_free(frames[frame].swap_slot);
+    frames[frame].swap_slot = -1;
+}
+
+// Drop one mapping of a frame. A private frame is freed with its last
+// mapping; a segment frame stays resident for the segment.
+static void unmap_page(int proc_index, int page) {
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    int frame = pte->frame_number;
     
-    pte->frame_number = frame;
-    pte->valid = 1;
+    if (pte->huge) {
+        huge_split(proc_index, HUGE_BASE(page));
+    }
+    tlb_flush(proc_index, page);
+    rmap_remove(frame, proc_index, page);
+    pte->valid = 0;
+    pte->cow = 0;
     
-    print(" -> loaded to frame=");
-    print_int(frame);
-    print("\n");
+    if (frames[frame].ref_count == 0 && frames[frame].shm_id == -1) {
+        free_frame(frame);
+    }
+}
+
+// Clear a page table entry, releasing its frame, swap and segment links
+static void release_pte(int proc_index, int page) {
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    
+    if (pte->valid) {
+        unmap_page(proc_index, page);
+    }
+    swap_free(pte->swap_slot);
+    if (pte->shm_id != -1) {
+        shm_segments[pte->shm_id].attached--;
+    }
+    
+    pte->valid = 0;
+    pte->frame_number = -1;
+    pte->dirty = 0;
+    pte->swap_slot = -1;
+    pte->cow = 0;
+    pte->shm_id = -1;
+    pte->shm_page = -1;
+    pte->file_data = 0;
+    pte->file_bytes = 0;
+}
+
+// Evict the page held by a frame, unmapping every sharer through the
+// reverse map. A dirty page is written to swap first. Returns pages
+// written, or -1 if the swap device is full and the frame stays.
+static int evict_frame(int frame) {
+    int written = 0;
+    
+    if (frames[frame].dirty) {
+        written = writeback_cluster(frame);
+        if (written == 0) {
+            return -1;
+        }
+    }
+    
+    TRACE(TRACE_EVICT, frames[frame].pid, frames[frame].page_number);
+    groups[frames[frame].group].evicted++;
+    
+    // Memory pressure reached a huge page: split it and evict only
+    // this page, so the rest of the region stays resident
+    if (frames[frame].huge) {
+        huge_split(scheduler_slot(frames[frame].pid), HUGE_BASE(frames[frame].page_number));
+        huge_demotions++;
+    }
+    
+    // Private sharers now refer to the swap copy (or to a fresh zero
+    // page); segment sharers fault back in through the segment
+    int slot = frames[frame].swap_slot;
+    int id = frames[frame].rmap;
+    while (id != -1) {
+        page_entry_t* pte = pte_by_id(id);
+        tlb_flush(id / MAX_PAGES_PER_PROCESS, id % MAX_PAGES_PER_PROCESS);
+        id = pte->rmap_next;
+        
+        pte->valid = 0;
+        pte->cow = 0;
+        pte->rmap_next = -1;
+        if (pte->shm_id == -1) {
+            pte->swap_slot = slot;
+            if (slot != -1) {
+                swap_map[slot]++;
+            }
+        }
+    }
+    
+    // A segment page keeps its swap copy in the segment itself
+    if (frames[frame].shm_id != -1) {
+        shm_segment_t* seg = &shm_segments[frames[frame].shm_id];
+        seg->frame[frames[frame].shm_page] = -1;
+        seg->swap_slot[frames[frame].shm_page] = slot;
+        frames[frame].swap_slot = -1;
+    }
+    
+    // Prefetched but never used: the stream was mispredicted, back off
+    if (frames[frame].prefetched) {
+        int proc_index = scheduler_slot(frames[frame].pid);
+        ra_wasted++;
+        TABLE(proc_index)->readahead.window /= 2;
+        if (TABLE(proc_index)->readahead.window < RA_MIN_WINDOW) {
+            TABLE(proc_index)->readahead.window = RA_MIN_WINDOW;
+        }
+    }
+    
+    free_frame(frame);
+    return written;
+}
+
+// Free frames: every resident frame is charged to one group
+static int free_frames() {
+    int used = 0;
+    for (int i = 0; i < MEMGROUP_COUNT; i++) {
+        used += groups[i].used;
+    }
+    return FRAME_COUNT - used;
+}
+
+// May a group take a free frame? Only while it is below its max.
+// Guarantees need no reserved frames: a group below its min reclaims
+// from groups above theirs, and the mins fit in memory together.
+static int group_may_grow(int group) {
+    return groups[group].used < groups[group].max && free_frames() > 0;
+}
+
+// Do limits narrow a group's choice of victim? Not while it is below
+// its max, no group has a min and none is over its max.
+static int victims_limited(int group) {
+    if (groups[group].used >= groups[group].max) return 1;
+    for (int i = 0; i < MEMGROUP_COUNT; i++) {
+        if (groups[i].min > 0 || groups[i].used > groups[i].max) return 1;
+    }
+    return 0;
+}
+
+// Mark the frames a group may reclaim: those of groups over their max,
+// else of groups over their min, else its own. A group at its max only
+// recycles its own frames. keep is never marked. Returns the count.
+static int victim_frames(int group, int keep, char* allowed) {
+    int count = 0;
+    int first = (groups[group].used >= groups[group].max) ? 2 : 0;
+    
+    for (int pass = first; pass < 3 && count == 0; pass++) {
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            memgroup_t* owner = &groups[frames[i].group];
+            allowed[i] = frames[i].valid && i != keep &&
+                         ((pass == 0 && owner->used > owner->max) ||
+                          (pass == 1 && owner->used > owner->min) ||
+                          (pass == 2 && frames[i].group == group));
+            count += allowed[i];
+        }
+    }
+    return count;
+}
+
+// Get a frame for a new page of a group: a free one, or an evicted LRU
+// victim. keep (-1: none) is never evicted. Returns -1, with the reason
+// in no_frame_reason, if the group's limits leave no frame, or if only
+// dirty victims remain and swap is full.
+static int obtain_frame(int group, int keep) {
+    if (group_may_grow(group)) {
+        return memory_get_free_frame();
+    }
+    
+    // keep is masked out on both paths: an unreferenced read-ahead frame
+    // ranks below every demand-loaded one, however recently it was used
+    char mask[FRAME_COUNT];
+    const char* allowed = 0;
+    if (victims_limited(group)) {
+        if (victim_frames(group, keep, mask) == 0) {
+            no_frame_reason = "memory group limit";
+            return -1;
+        }
+        allowed = mask;
+    } else if (keep != -1) {
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            mask[i] = frames[i].valid && i != keep;
+        }
+        allowed = mask;
+    }
+    int frame = lru_victim(allowed);
+    
+    // A dirty victim needs swap space; fall back to a clean one
+    if (frames[frame].dirty && swap_used == SWAP_SLOTS) {
+        frame = find_lru_frame(0, 1, allowed);
+        if (frame == -1) {
+            no_frame_reason = "swap device full";
+            return -1;
+        }
+    }
+    
+    printk(LOG_CONT, " (evicting PID=%d page=%d", frames[frame].pid, frames[frame].page_number);
+    if (frames[frame].ref_count > 1) {
+        printk(LOG_CONT, " x%d", frames[frame].ref_count);
+    }
+    
+    int written = evict_frame(frame);
+    if (written > 0) {
+        printk(LOG_CONT, ", wrote %d pages", written);
+    }
+    printk(LOG_CONT, ")");
+    
+    return frame;
+}
+
+// Fill a frame from a mapped image: file bytes first, zeros after
+static void file_read(const page_entry_t* pte, int frame) {
+    unsigned char* dst = frame_data[frame];
+    memcpy(dst, pte->file_data, pte->file_bytes);
+    memset(dst + pte->file_bytes, 0, PAGE_SIZE - pte->file_bytes);
+    file_pages_in++;
+}
+
+// Map a page into a frame, reading it back from swap if it was paged
+// out, from its image if it is file-backed, or zero-filling it
+static void load_frame(int frame, int pid, int page, int prefetched) {
+    int proc_index = scheduler_slot(pid);
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    
+    // A segment page is backed by the segment's swap copy
+    int* slot = &pte->swap_slot;
+    if (pte->shm_id != -1) {
+        slot = &shm_segments[pte->shm_id].swap_slot[pte->shm_page];
+    }
+    
+    if (*slot != -1) {
+        swap_read(*slot, frame);
+    } else if (pte->file_data) {
+        file_read(pte, frame);
+    } else {
+        zero_page(frame_data[frame]);
+    }
+    
+    init_frame(frame, pid, page, prefetched);
+    frames[frame].swap_slot = *slot;
+    *slot = -1;
+    
+    if (pte->shm_id != -1) {
+        frames[frame].shm_id = pte->shm_id;
+        frames[frame].shm_page = pte->shm_page;
+        shm_segments[pte->shm_id].frame[pte->shm_page] = frame;
+    }
+    
+    rmap_add(frame, proc_index, page);
+    pte->dirty = 0;
+    pte->cow = 0;
+}
+
+// Look for a resident clean private frame still holding a swap slot.
+// Huge page frames are never shared, so they are left out.
+static int swap_cache_lookup(int slot) {
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (frames[i].valid && !frames[i].dirty && frames[i].shm_id == -1 &&
+            !frames[i].huge && frames[i].swap_slot == slot) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Map an already resident frame into one more page table entry. A
+// private frame becomes copy-on-write for every sharer; a segment frame
+// stays writable by all of them.
+static void share_frame(int frame, int proc_index, int page) {
+    int cow = (frames[frame].shm_id == -1);
+    
+    if (cow) {
+        for (int id = frames[frame].rmap; id != -1; id = pte_by_id(id)->rmap_next) {
+            pte_by_id(id)->cow = 1;
+        }
+    }
+    
+    rmap_add(frame, proc_index, page);
+    TABLE(proc_index)->pages[page].dirty = 0;
+    TABLE(proc_index)->pages[page].cow = cow;
+}
+
+// Record a write: the swap copy (if any) is now stale
+static void mark_dirty(int frame, page_entry_t* pte) {
+    swap_free(frames[frame].swap_slot);
+    frames[frame].swap_slot = -1;
+    frames[frame].dirty = 1;
+    pte->dirty = 1;
+    ((unsigned int*)frame_data[frame])[0] = (unsigned int)current_time;
+}
+
+// Write to a resident page. A copy-on-write page that is still shared
+// gets a private copy first. Returns 0 if no frame was available.
+static int write_page(int pid, int page) {
+    int proc_index = scheduler_slot(pid);
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    
+    if (pte->cow && frames[pte->frame_number].ref_count > 1) {
+        // The source frame is passed as keep, so it is never the victim
+        int old = pte->frame_number;
+        int merged = frames[old].ksm;
+        int frame = obtain_frame(TABLE(proc_index)->group, old);
+        if (frame == -1) {
+            return 0;
+        }
+        
+        copy_page(frame_data[frame], frame_data[old]);
+        unmap_page(proc_index, page);
+        init_frame(frame, pid, page, 0);
+        rmap_add(frame, proc_index, page);
+        
+        cow_copies++;
+        if (merged) {
+            ksm_unmerged++;
+        }
+        printk(LOG_CONT, " (copy-on-write -> frame=%d)", frame);
+    }
+    
+    pte->cow = 0;
+    mark_dirty(pte->frame_number, pte);
+    return 1;
+}
+
+// Hash a page's contents (FNV-1a over 32-bit words)
+static unsigned int page_hash(const unsigned char* data) {
+    const unsigned int* words = (const unsigned int*)data;
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < PAGE_SIZE / 4; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Compare two frames' contents
+static int frames_equal(int a, int b) {
+    const unsigned int* wa = (const unsigned int*)frame_data[a];
+    const unsigned int* wb = (const unsigned int*)frame_data[b];
+    for (int i = 0; i < PAGE_SIZE / 4; i++) {
+        if (wa[i] != wb[i]) return 0;
+    }
+    return 1;
+}
+
+// Fold a frame into an identical one: every mapping moves over
+// copy-on-write and the duplicate is freed with its last mapping
+static void ksm_merge(int frame, int into) {
+    if (frames[frame].last_access > frames[into].last_access) {
+        frames[into].last_access = frames[frame].last_access;
+    }
+    
+    while (frames[frame].rmap != -1) {
+        int id = frames[frame].rmap;
+        int proc_index = id / MAX_PAGES_PER_PROCESS;
+        int page = id % MAX_PAGES_PER_PROCESS;
+        
+        unmap_page(proc_index, page);
+        share_frame(into, proc_index, page);
+        ksm_merged++;
+    }
+    frames[into].ksm = 1;
+}
+
+// Scan one frame for merging. A page must hash the same on two
+// consecutive passes before it is merged, so pages still being written
+// are left alone. Returns 1 if the frame was merged away.
+static int ksm_scan_frame(int frame) {
+    frame_t* f = &frames[frame];
+    
+    ksm_scanned++;
+    if (!f->valid || f->prefetched || f->huge || f->shm_id != -1 || f->ref_count == 0) {
+        return 0;
+    }
+    
+    unsigned int hash = page_hash(frame_data[frame]);
+    if (hash != f->checksum) {
+        f->checksum = hash;
+        return 0;
+    }
+    
+    int bucket = hash % KSM_BUCKETS;
+    for (int other = ksm_buckets[bucket]; other != -1; other = frames[other].ksm_next) {
+        if (other != frame && frames[other].valid && frames[other].shm_id == -1 &&
+            !frames[other].huge && frames[other].checksum == hash &&
+            frames_equal(frame, other)) {
+            ksm_merge(frame, other);
+            return 1;
+        }
+    }
+    
+    f->ksm_next = ksm_buckets[bucket];
+    ksm_buckets[bucket] = frame;
+    return 0;
+}
+
+// Advance the merge scanner by count frames. The candidate table is
+// rebuilt on every pass over the frame pool. Returns frames merged.
+static int ksm_step(int count) {
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        if (ksm_cursor == 0) {
+            for (int b = 0; b < KSM_BUCKETS; b++) {
+                ksm_buckets[b] = -1;
+            }
+        }
+        merged += ksm_scan_frame(ksm_cursor);
+        ksm_cursor = (ksm_cursor + 1) % FRAME_COUNT;
+    }
+    return merged;
+}
+
+// Turn the background merge scanner on or off
+void memory_ksm_enable(int enabled) {
+    ksm_enabled = enabled;
+}
+
+// Run one full merge pass now. Returns frames freed.
+int memory_ksm_scan() {
+    return ksm_step(FRAME_COUNT);
+}
+
+// Count the resident pages of a region that could become a huge page.
+// Every page must be allocated and private: resident ones mapped only
+// here, the others not cached in a sharer's frame. Returns -1 if not.
+static int huge_region_resident(int proc_index, int base) {
+    int resident = 0;
+    for (int i = 0; i < HUGE_PAGE_PAGES; i++) {
+        page_entry_t* pte = &TABLE(proc_index)->pages[base + i];
+        if (!pte->allocated || pte->shm_id != -1 || pte->huge) return -1;
+        if (pte->valid) {
+            if (frames[pte->frame_number].ref_count > 1) return -1;
+            resident++;
+        } else if (pte->swap_slot != -1 && swap_cache_lookup(pte->swap_slot) != -1) {
+            return -1;
+        }
+    }
+    return resident;
+}
+
+// Find an aligned frame run for a region: each frame free, or already
+// holding the region's page at that offset. The group must have room
+// for the missing pages. Returns the first frame, or -1.
+static int huge_frame_run(int proc_index, int base, int missing) {
+    memgroup_t* group = &groups[TABLE(proc_index)->group];
+    if (group->used + missing > group->max) return -1;
+    
+    for (int first = 0; first < FRAME_COUNT; first += HUGE_PAGE_PAGES) {
+        int i = 0;
+        while (i < HUGE_PAGE_PAGES) {
+            page_entry_t* pte = &TABLE(proc_index)->pages[base + i];
+            if (frames[first + i].valid && !(pte->valid && pte->frame_number == first + i)) break;
+            i++;
+        }
+        if (i == HUGE_PAGE_PAGES) return first;
+    }
+    return -1;
+}
+
+// Map a region as one huge page on the frame run starting at first.
+// Resident pages are copied into the run unless already in place; the
+// others are read in as on a fault.
+static void huge_map(int pid, int base, int first) {
+    int proc_index = scheduler_slot(pid);
+    for (int i = 0; i < HUGE_PAGE_PAGES; i++) {
+        page_entry_t* pte = &TABLE(proc_index)->pages[base + i];
+        int frame = first + i;
+        
+        if (!pte->valid) {
+            load_frame(frame, pid, base + i, 0);
+            frames[frame].untouched = 1;
+        } else if (pte->frame_number != frame) {
+            int old = pte->frame_number;
+            copy_page(frame_data[frame], frame_data[old]);
+            init_frame(frame, pid, base + i, frames[old].prefetched);
+            frames[frame].last_access = frames[old].last_access;
+            frames[frame].dirty = frames[old].dirty;
+            frames[frame].swap_slot = frames[old].swap_slot;
+            frames[old].swap_slot = -1;
+            unmap_page(proc_index, base + i);
+            rmap_add(frame, proc_index, base + i);
+        }
+        
+        pte->huge = 1;
+        frames[frame].huge = 1;
+    }
+}
+
+// Map the region around a faulting page as a huge page, if it may be
+// one and an aligned frame run is free. Returns the page's frame or -1.
+static int huge_fault(int pid, int page) {
+    int proc_index = scheduler_slot(pid);
+    int base = HUGE_BASE(page);
+    int resident = huge_region_resident(proc_index, base);
+    if (resident == -1) return -1;
+    
+    int first = huge_frame_run(proc_index, base, HUGE_PAGE_PAGES - resident);
+    if (first == -1) {
+        huge_fallbacks++;
+        return -1;
+    }
+    
+    huge_map(pid, base, first);
+    frames[first + page - base].untouched = 0;
+    huge_faults++;
+    return first + page - base;
+}
+
+// Collapse a densely populated region into a huge page. Returns 1 if
+// it was promoted.
+static int huge_promote(int proc_index, int base) {
+    int resident = huge_region_resident(proc_index, base);
+    if (resident < HUGE_PROMOTE_MIN) return 0;
+    
+    int first = huge_frame_run(proc_index, base, HUGE_PAGE_PAGES - resident);
+    if (first == -1) return 0;
+    
+    huge_map(TABLE(proc_index)->pid, base, first);
+    huge_promotions++;
+    printk(LOG_DEBUG, "Promoted PID=%d pages %d-%d to a huge page at frames %d-%d",
+           TABLE(proc_index)->pid, base, base + HUGE_PAGE_PAGES - 1,
+           first, first + HUGE_PAGE_PAGES - 1);
+    return 1;
+}
+
+// Advance the promotion scanner by count regions of page tables with
+// huge pages enabled. Other tables are skipped whole, without counting.
+static void huge_step(int count) {
+    for (int skipped = 0; count > 0 && skipped <= table_slots; ) {
+        if (huge_cursor >= table_slots * HUGE_REGIONS) huge_cursor = 0;
+        int proc_index = huge_cursor / HUGE_REGIONS;
+        if (!TABLE(proc_index)->ready || !TABLE(proc_index)->huge) {
+            huge_cursor = (proc_index + 1) * HUGE_REGIONS;
+            skipped++;
+            continue;
+        }
+        
+        huge_promote(proc_index, (huge_cursor % HUGE_REGIONS) * HUGE_PAGE_PAGES);
+        huge_cursor++;
+        count--;
+    }
+}
+
+// Set a page table's huge page option, keeping huge_tables in step
+static void table_set_huge(int proc_index, int enabled) {
+    huge_tables += enabled - TABLE(proc_index)->huge;
+    TABLE(proc_index)->huge = enabled;
+}
+
+// Turn huge pages on or off for a process. Turning them off splits its
+// huge pages. Returns 0 if the process does not exist.
+int memory_huge_enable(int pid, int enabled) {
+    if (!scheduler_get_process(pid)) {
+        return 0;
+    }
+    
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return 0;
+    table_set_huge(proc_index, enabled != 0);
+    if (!enabled) {
+        for (int base = 0; base < MAX_PAGES_PER_PROCESS; base += HUGE_PAGE_PAGES) {
+            if (TABLE(proc_index)->pages[base].huge) {
+                huge_split(proc_index, base);
+            }
+        }
+    }
+    return 1;
+}
+
+// Periodic pager work, driven by the scheduler clock
+void memory_tick(int tick) {
+    if (tick % WB_INTERVAL == 0) {
+        memory_writeback();
+    }
+    if (ksm_enabled) {
+        ksm_step(KSM_SCAN_BATCH);
+    }
+    if (huge_tables > 0) {
+        huge_step(HUGE_SCAN_BATCH);
+    }
+}
+
+// Detect a strided fault stream and prefetch ahead of it.
+// Returns the number of pages brought in.
+static int readahead_fault(int pid, int page) {
+    int proc_index = scheduler_slot(pid);
+    readahead_t* ra = &TABLE(proc_index)->readahead;
+    int stride = page - ra->last_fault;
+    
+    // Sequential if the stride repeats, or if the fault lands right
+    // after the window prefetched on the previous fault
+    int sequential = ra->last_fault != -1 &&
+                     ((stride != 0 && stride == ra->stride) || page == ra->next);
+    
+    if (ra->last_fault != -1 && page != ra->next) {
+        ra->stride = stride;
+    }
+    ra->last_fault = page;
+    ra->next = -1;
+    
+    if (!sequential) {
+        return 0;
+    }
+    
+    int issued = 0;
+    int next = page;
+    for (int i = 0; i < ra->window; i++) {
+        next += ra->stride;
+        if (next < 0 || next >= MAX_PAGES_PER_PROCESS) break;
+        
+        page_entry_t* pte = &TABLE(proc_index)->pages[next];
+        if (!pte->allocated) break;
+        if (pte->valid || pte->shm_id != -1) continue;
+        
+        // Only take free frames or cold clean demand pages the group
+        // may reclaim: read-ahead never forces a swap write or
+        // displaces another prefetch
+        int frame = -1;
+        if (group_may_grow(TABLE(proc_index)->group)) {
+            frame = memory_get_free_frame();
+        } else {
+            char mask[FRAME_COUNT];
+            const char* allowed = 0;
+            if (victims_limited(TABLE(proc_index)->group)) {
+                victim_frames(TABLE(proc_index)->group, -1, mask);
+                allowed = mask;
+            }
+            frame = find_lru_frame(0, 1, allowed);
+            if (frame == -1 || frames[frame].last_access == current_time) break;
+            evict_frame(frame);
+        }
+        
+        load_frame(frame, pid, next, 1);
+        issued++;
+    }
+    
+    ra->next = next + ra->stride;
+    ra_issued += issued;
+    return issued;
+}
+
+// Allocate pages to process
+int memory_allocate_pages(int pid, int count) {
+    pcb_t* proc = scheduler_get_process(pid);
+    if (!proc) {
+        print("Error: Process not found\n");
+        return 0;
+    }
+    
+    if (count > MAX_PAGES_PER_PROCESS) {
+        print("Error: Too many pages requested\n");
+        return 0;
+    }
+    
+    // Mark pages as allocated but not loaded, dropping any old contents
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return 0;
+    for (int i = 0; i < count; i++) {
+        release_pte(proc_index, i);
+        TABLE(proc_index)->pages[i].allocated = 1;
+    }
+    readahead_reset(proc_index);
+    
+    return 1;
+}
+
+// Release everything a process maps. Only its own page table is walked;
+// shared frames are unlinked through their reverse maps.
+void memory_release_process(int pid) {
+    int proc_index = scheduler_slot(pid);
+    if (proc_index == -1 || !TABLE(proc_index)->ready || TABLE(proc_index)->pid != pid) return;
+    
+    for (int i = 0; i < MAX_PAGES_PER_PROCESS; i++) {
+        release_pte(proc_index, i);
+        TABLE(proc_index)->pages[i].allocated = 0;
+    }
+    TABLE(proc_index)->pid = -1;
+    TABLE(proc_index)->group = 0;
+    table_set_huge(proc_index, 0);
+    readahead_reset(proc_index);
+}
+
+// Fork an address space: the child maps every resident frame and swap
+// slot of the parent copy-on-write, so no page data is copied until one
+// side writes. Segment pages stay shared. Returns the number of
+// resident pages shared, or -1.
+int memory_fork(int parent_pid, int child_pid) {
+    int src_index = table_index(parent_pid);
+    int dst_index = table_index(child_pid);
+    if (src_index == -1 || dst_index == -1) return -1;
+    
+    TABLE(dst_index)->group = TABLE(src_index)->group;
+    table_set_huge(dst_index, TABLE(src_index)->huge);
+    int shared = 0;
+    for (int i = 0; i < MAX_PAGES_PER_PROCESS; i++) {
+        page_entry_t* src = &TABLE(src_index)->pages[i];
+        page_entry_t* dst = &TABLE(dst_index)->pages[i];
+        
+        release_pte(dst_index, i);
+        dst->allocated = src->allocated;
+        dst->file_data = src->file_data;
+        dst->file_bytes = src->file_bytes;
+        
+        if (src->shm_id != -1) {
+            dst->shm_id = src->shm_id;
+            dst->shm_page = src->shm_page;
+            shm_segments[src->shm_id].attached++;
+        }
+        
+        // Huge pages are private: split them before sharing
+        if (src->valid) {
+            if (src->huge) {
+                huge_split(src_index, HUGE_BASE(i));
+            }
+            share_frame(src->frame_number, dst_index, i);
+            shared++;
+        } else if (src->swap_slot != -1) {
+            swap_map[src->swap_slot]++;
+            dst->swap_slot = src->swap_slot;
+        }
+    }
+    readahead_reset(dst_index);
+    
+    cow_forks++;
+    cow_shared += shared;
+    return shared;
+}
+
+// Create a shared memory segment, or find the one with this key.
+// Returns the segment id, or -1.
+int memory_shm_get(int key, int pages) {
+    int free_id = -1;
+    for (int i = 0; i < SHM_SEGMENTS; i++) {
+        if (shm_segments[i].key == key) {
+            return i;
+        }
+        if (shm_segments[i].key == -1 && free_id == -1) {
+            free_id = i;
+        }
+    }
+    
+    if (key < 0 || pages <= 0 || pages > SHM_MAX_PAGES || free_id == -1) {
+        return -1;
+    }
+    
+    shm_segment_t* seg = &shm_segments[free_id];
+    seg->key = key;
+    seg->pages = pages;
+    seg->attached = 0;
+    for (int i = 0; i < SHM_MAX_PAGES; i++) {
+        seg->frame[i] = -1;
+        seg->swap_slot[i] = -1;
+    }
+    return free_id;
+}
+
+// Attach a segment to a process at base_page. Pages are mapped lazily:
+// the first access maps the segment's frame if it is resident.
+// Returns the number of pages attached, or -1.
+int memory_shm_attach(int pid, int key, int base_page) {
+    if (!scheduler_get_process(pid)) {
+        return -1;
+    }
+    
+    int id = -1;
+    for (int i = 0; i < SHM_SEGMENTS; i++) {
+        if (shm_segments[i].key == key && key >= 0) {
+            id = i;
+        }
+    }
+    if (id == -1 || base_page < 0 ||
+        base_page + shm_segments[id].pages > MAX_PAGES_PER_PROCESS) {
+        return -1;
+    }
+    
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return -1;
+    for (int i = 0; i < shm_segments[id].pages; i++) {
+        page_entry_t* pte = &TABLE(proc_index)->pages[base_page + i];
+        release_pte(proc_index, base_page + i);
+        pte->allocated = 1;
+        pte->shm_id = id;
+        pte->shm_page = i;
+        shm_segments[id].attached++;
+    }
+    return shm_segments[id].pages;
+}
+
+// Back an allocated page with image bytes. Nothing is read now: the
+// first fault fills the frame, and a clean eviction simply drops it
+// since the image still holds the data. Returns 0 on a bad page.
+int memory_map_file(int pid, int page, const unsigned char* data, int bytes) {
+    if (!scheduler_get_process(pid) || page < 0 || page >= MAX_PAGES_PER_PROCESS ||
+        bytes < 0 || bytes > PAGE_SIZE) {
+        return 0;
+    }
+    
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return 0;
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    if (!pte->allocated || pte->valid || pte->shm_id != -1) {
+        return 0;
+    }
+    
+    pte->file_data = data;
+    pte->file_bytes = bytes;
+    return 1;
+}
+
+// Is a page of a process in a frame?
+int memory_page_resident(int pid, int page) {
+    int proc_index = scheduler_slot(pid);
+    if (proc_index == -1 || page < 0 || page >= MAX_PAGES_PER_PROCESS || !TABLE(proc_index)->ready ||
+        TABLE(proc_index)->pid != pid) {
+        return 0;
+    }
+    return TABLE(proc_index)->pages[page].valid;
+}
+
+// Access a page (simulate memory access)
+void memory_access_page(int pid, int page, int write) {
+    current_time++;
+    
+    pcb_t* proc = scheduler_get_process(pid);
+    if (!proc) {
+        print("Error: Process ");
+        print_int(pid);
+        print(" not found\n");
+        return;
+    }
+    
+    if (page < 0 || page >= MAX_PAGES_PER_PROCESS) {
+        print("Error: Invalid page number\n");
+        return;
+    }
+    
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return;
+    page_entry_t* pte = &TABLE(proc_index)->pages[page];
+    memgroup_t* group = &groups[TABLE(proc_index)->group];
+    
+    // Page hit
+    if (pte->valid) {
+        page_hits++;
+        group->hits++;
+        frames[pte->frame_number].last_access = current_time;
+        tlb_access(proc_index, page, pte->huge);
+        
+        // First use of a page a huge mapping brought in: a fault saved
+        if (frames[pte->frame_number].untouched) {
+            frames[pte->frame_number].untouched = 0;
+            huge_saved++;
+        }
+        
+        // First touch of a prefetched page: the stream is real, widen it
+        if (frames[pte->frame_number].prefetched) {
+            frames[pte->frame_number].prefetched = 0;
+            ra_hits++;
+            if (TABLE(proc_index)->readahead.window < RA_MAX_WINDOW) {
+                TABLE(proc_index)->readahead.window++;
+            }
+        }
+        
+        printk(LOG_INFO, "Page hit: PID=%d page=%d frame=%d", pid, page, pte->frame_number);
+        if (write && !write_page(pid, page)) {
+            printk(LOG_CONT, " -> Error: %s", no_frame_reason);
+        }
+        return;
+    }
+    
+    // Page fault
+    page_faults++;
+    group->faults++;
+    last_read_slot = -2;
+    TRACE(TRACE_FAULT, pid, page);
+    printk(LOG_INFO, "Page fault: PID=%d page=%d", pid, page);
+    
+    // The data may already be resident: a segment page mapped by another
+    // process, or a swap slot another sharer has read back in
+    int frame = -1;
+    if (pte->shm_id != -1) {
+        frame = shm_segments[pte->shm_id].frame[pte->shm_page];
+    } else if (pte->swap_slot != -1) {
+        frame = swap_cache_lookup(pte->swap_slot);
+        if (frame != -1) {
+            swap_free(pte->swap_slot);
+            pte->swap_slot = -1;
+        }
+    }
+    
+    if (frame != -1) {
+        share_frame(frame, proc_index, page);
+        frames[frame].last_access = current_time;
+        
+        // Read ahead for a sharer and now referenced: no longer a
+        // read-ahead page for the victim search
+        if (frames[frame].prefetched) {
+            frames[frame].prefetched = 0;
+            ra_hits++;
+        }
+        printk(LOG_CONT, " -> mapped resident frame=%d", frame);
+    } else if (TABLE(proc_index)->huge && (frame = huge_fault(pid, page)) != -1) {
+        int first = frame - (page - HUGE_BASE(page));
+        printk(LOG_CONT, " -> huge page at frames=%d-%d", first, first + HUGE_PAGE_PAGES - 1);
+    } else {
+        // Free frame, or LRU replacement
+        frame = obtain_frame(TABLE(proc_index)->group, -1);
+        if (frame == -1) {
+            printk(LOG_CONT, " -> Error: %s", no_frame_reason);
+            return;
+        }
+        
+        if (pte->swap_slot != -1) {
+            printk(LOG_CONT, " swap-in");
+        }
+        load_frame(frame, pid, page, 0);
+        
+        printk(LOG_CONT, " -> loaded to frame=%d", frame);
+    }
+    
+    tlb_access(proc_index, page, pte->huge);
+    if (write && !write_page(pid, page)) {
+        printk(LOG_CONT, " -> Error: %s", no_frame_reason);
+    }
+    
+    int prefetched = readahead_fault(pid, page);
+    if (prefetched > 0) {
+        printk(LOG_CONT, " (read-ahead %d pages)", prefetched);
+    }
+}
+
+// Set a group's limits. The mins of all groups must fit in memory
+// together. Returns 0 if the limits are invalid.
+int memory_group_set(int group, int min, int max) {
+    if (group < 0 || group >= MEMGROUP_COUNT || min < 0 || min > max ||
+        max < 1 || max > FRAME_COUNT) {
+        return 0;
+    }
+    
+    int reserved = min;
+    for (int i = 0; i < MEMGROUP_COUNT; i++) {
+        if (i != group) reserved += groups[i].min;
+    }
+    if (reserved > FRAME_COUNT) {
+        return 0;
+    }
+    
+    // A group now over its max gives frames back as others fault
+    groups[group].min = min;
+    groups[group].max = max;
+    return 1;
+}
+
+// Move a process into a group. Frames already charged stay with the
+// old group until they are freed. Returns 0 if either does not exist.
+int memory_group_assign(int pid, int group) {
+    if (group < 0 || group >= MEMGROUP_COUNT || !scheduler_get_process(pid)) {
+        return 0;
+    }
+    
+    int proc_index = table_index(pid);
+    if (proc_index == -1) return 0;
+    TABLE(proc_index)->group = group;
+    return 1;
+}
+
+// Print a number right-aligned in a column
+static void print_column(int value, int width) {
+    int digits = 1;
+    for (int v = value; v >= 10; v /= 10) digits++;
+    for (int i = digits; i < width; i++) print(" ");
+    print_int(value);
+}
+
+// Show each group's limits, usage and fault rate
+void memory_show_groups() {
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("\n  Group  Min  Max  Used  Procs  Faults    Hits  Fault%  Evicted\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    for (int g = 0; g < MEMGROUP_COUNT; g++) {
+        memgroup_t* group = &groups[g];
+        int procs = 0;
+        for (int i = 0; i < table_slots; i++) {
+            if (TABLE(i)->ready && TABLE(i)->pid != -1 && TABLE(i)->group == g) procs++;
+        }
+        
+        // Untouched groups with default limits are left out
+        int accesses = group->faults + group->hits;
+        if (g != 0 && procs == 0 && group->used == 0 && accesses == 0 &&
+            group->min == 0 && group->max == FRAME_COUNT) {
+            continue;
+        }
+        
+        print_column(g, 7);
+        print_column(group->min, 5);
+        print_column(group->max, 5);
+        if (group->used > group->max) {
+            set_color(COLOR_RED, COLOR_BLACK);
+        }
+        print_column(group->used, 6);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print_column(procs, 7);
+        print_column(group->faults, 8);
+        print_column(group->hits, 8);
+        print_column(accesses ? group->faults * 100 / accesses : 0, 7);
+        print("%");
+        print_column(group->evicted, 9);
+        print("\n");
+    }
+    
+    print("\n  Free frames: ");
+    print_int(free_frames());
+    print("/");
+    print_int(FRAME_COUNT);
+    print("\n\n");
+}
+
+// Counters and other scalar state, in checkpoint image order
+static int* const saved_ints[] = {
+    &current_time, &page_faults, &page_hits,
+    &ra_issued, &ra_hits, &ra_wasted,
+    &swap_used, &swap_read_ops, &swap_write_ops, &swap_pages_in, &swap_pages_out,
+    &last_read_slot, &file_pages_in,
+    &cow_forks, &cow_shared, &cow_copies,
+    &ksm_enabled, &ksm_cursor, &ksm_scanned, &ksm_merged, &ksm_unmerged,
+    &huge_tables, &huge_cursor, &huge_faults, &huge_fallbacks, &huge_saved,
+    &huge_promotions, &huge_demotions, &tlb_hits, &tlb_misses
+};
+
+// Write the frame table, page tables, swap map and the contents of
+// every page in use to a checkpoint image. Free frames and swap slots
+// are skipped. Returns the number of pages stored.
+int memory_save(ckpt_t* c) {
+    ckpt_section(c, CKPT_SEC_MEMORY);
+    for (unsigned int i = 0; i < sizeof(saved_ints) / sizeof(saved_ints[0]); i++) {
+        ckpt_put_int(c, *saved_ints[i]);
+    }
+    ckpt_put(c, frames, sizeof(frames));
+    ckpt_put(c, groups, sizeof(groups));
+    ckpt_put(c, shm_segments, sizeof(shm_segments));
+    ckpt_put(c, ksm_buckets, sizeof(ksm_buckets));
+    ckpt_put(c, swap_map, sizeof(swap_map));
+    
+    // Tables no process owns are empty, and are set up again on use
+    int tables = 0;
+    for (int i = 0; i < table_slots; i++) {
+        if (TABLE(i)->ready && TABLE(i)->pid != -1) tables++;
+    }
+    ckpt_put_int(c, tables);
+    
+    // Image pages point into the initrd, which may load elsewhere next
+    // boot: store their offset in it instead
+    for (int i = 0; i < table_slots; i++) {
+        if (!TABLE(i)->ready || TABLE(i)->pid == -1) continue;
+        ckpt_put_int(c, i);
+        ckpt_put_int(c, TABLE(i)->pid);
+        ckpt_put_int(c, TABLE(i)->group);
+        ckpt_put_int(c, TABLE(i)->huge);
+        ckpt_put(c, &TABLE(i)->readahead, sizeof(readahead_t));
+        for (int j = 0; j < MAX_PAGES_PER_PROCESS; j++) {
+            page_entry_t pte = TABLE(i)->pages[j];
+            int offset = pte.file_data ? ramfs_offset((const char*)pte.file_data) : -1;
+            pte.file_data = 0;
+            ckpt_put(c, &pte, sizeof(pte));
+            ckpt_put_int(c, offset);
+        }
+    }
+    
+    int pages = 0;
+    for (int f = 0; f < FRAME_COUNT; f++) {
+        if (!frames[f].valid) continue;
+        ckpt_put(c, frame_data[f], PAGE_SIZE);
+        pages++;
+    }
+    for (int s = 0; s < SWAP_SLOTS; s++) {
+        if (swap_map[s] == 0) continue;
+        ckpt_put(c, swap_area[s], PAGE_SIZE);
+        pages++;
+    }
+    return pages;
+}
+
+// -1 or an index below count: the pager's "none or which" fields
+static int index_ok(int index, int count) {
+    return index >= -1 && index < count;
+}
+
+// Size of one saved page table: slot, pid, group, huge flag, read-ahead
+// state, then each page's entry and image offset
+#define SAVED_TABLE_BYTES (4 * sizeof(int) + sizeof(readahead_t) + \
+    MAX_PAGES_PER_PROCESS * (sizeof(page_entry_t) + sizeof(int)))
+
+// Read the entry for PTE id from the saved tables starting at first,
+// which are in ascending slot order. Returns 0 if no table holds it.
+static int saved_pte(ckpt_t* c, unsigned int first, int tables, int id, page_entry_t* pte) {
+    if (id < 0) return 0;
+    int slot = id / MAX_PAGES_PER_PROCESS;
+    int lo = 0, hi = tables - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const unsigned char* table = c->data + first + mid * SAVED_TABLE_BYTES;
+        int saved_slot;
+        memcpy(&saved_slot, table, sizeof(int));
+        if (saved_slot < slot) {
+            lo = mid + 1;
+        } else if (saved_slot > slot) {
+            hi = mid - 1;
+        } else {
+            const unsigned char* entry = table + 4 * sizeof(int) + sizeof(readahead_t) +
+                (id % MAX_PAGES_PER_PROCESS) * (sizeof(page_entry_t) + sizeof(int));
+            memcpy(pte, entry, sizeof(page_entry_t));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Check a checkpoint's memory section without changing anything.
+// memory_load copies frames, segments, swap map and page tables in raw,
+// so every frame, swap slot, segment and reverse-map index in them must
+// be in range, each frame's reverse map must be exactly the PTEs mapping
+// it, and each swap slot's count its references. Frame and table owners
+// are processes of the image, in their slots; image pages point into
+// this initrd.
+void memory_check(ckpt_t* c) {
+    static frame_t saved_frames[FRAME_COUNT];
+    static memgroup_t saved_groups[MEMGROUP_COUNT];
+    static shm_segment_t saved_shm[SHM_SEGMENTS];
+    static int saved_buckets[KSM_BUCKETS];
+    static int saved_swap[SWAP_SLOTS];
+    static int swap_refs[SWAP_SLOTS];
+    int ints[sizeof(saved_ints) / sizeof(saved_ints[0])];
+    int mapped[FRAME_COUNT];
+    int charged[MEMGROUP_COUNT];
+    
+    ckpt_expect(c, CKPT_SEC_MEMORY);
+    for (unsigned int i = 0; i < sizeof(saved_ints) / sizeof(saved_ints[0]); i++) {
+        ints[i] = ckpt_get_int(c);
+    }
+    ckpt_get(c, saved_frames, sizeof(saved_frames));
+    ckpt_get(c, saved_groups, sizeof(saved_groups));
+    ckpt_get(c, saved_shm, sizeof(saved_shm));
+    ckpt_get(c, saved_buckets, sizeof(saved_buckets));
+    ckpt_get(c, saved_swap, sizeof(saved_swap));
+    if (c->error) return;
+    memset(swap_refs, 0, sizeof(swap_refs));
+    memset(mapped, 0, sizeof(mapped));
+    memset(charged, 0, sizeof(charged));
+    
+    // Frames: owner, page and every link in range
+    int pages = 0;
+    for (int f = 0; f < FRAME_COUNT; f++) {
+        frame_t* frame = &saved_frames[f];
+        if (!index_ok(frame->ksm_next, FRAME_COUNT)) c->error = 1;
+        if (!frame->valid) continue;
+        if ((frame->pid != -1 && scheduler_image_slot(frame->pid) == -1) ||
+            frame->group < 0 || frame->group >= MEMGROUP_COUNT ||
+            frame->page_number < 0 || frame->page_number >= MAX_PAGES_PER_PROCESS ||
+            frame->ref_count < 0 || !index_ok(frame->swap_slot, SWAP_SLOTS) ||
+            !index_ok(frame->shm_id, SHM_SEGMENTS) ||
+            (frame->shm_id != -1 && (frame->shm_page < 0 || frame->shm_page >= SHM_MAX_PAGES))) {
+            c->error = 1;
+            return;
+        }
+        if (frame->swap_slot != -1) swap_refs[frame->swap_slot]++;
+        charged[frame->group]++;
+        pages++;
+    }
+    for (int g = 0; g < MEMGROUP_COUNT; g++) {
+        memgroup_t* group = &saved_groups[g];
+        if (group->min < 0 || group->min > group->max || group->max < 1 ||
+            group->max > FRAME_COUNT || group->used != charged[g]) {
+            c->error = 1;
+        }
+    }
+    for (int b = 0; b < KSM_BUCKETS; b++) {
+        if (!index_ok(saved_buckets[b], FRAME_COUNT)) c->error = 1;
+    }
+    
+    // Segments: each resident page's frame must say it belongs there
+    for (int s = 0; s < SHM_SEGMENTS && !c->error; s++) {
+        shm_segment_t* seg = &saved_shm[s];
+        if (seg->key == -1) {
+            if (seg->pages != 0) c->error = 1;
+            continue;
+        }
+        if (seg->pages < 1 || seg->pages > SHM_MAX_PAGES) {
+            c->error = 1;
+            break;
+        }
+        for (int p = 0; p < seg->pages; p++) {
+            int f = seg->frame[p];
+            if (!index_ok(f, FRAME_COUNT) || !index_ok(seg->swap_slot[p], SWAP_SLOTS) ||
+                (f != -1 && (!saved_frames[f].valid || saved_frames[f].shm_id != s ||
+                             saved_frames[f].shm_page != p))) {
+                c->error = 1;
+                break;
+            }
+            if (seg->swap_slot[p] != -1) swap_refs[seg->swap_slot[p]]++;
+        }
+    }
+    
+    // The pager's cursors and counters that it indexes or balances with
+    for (unsigned int i = 0; i < sizeof(saved_ints) / sizeof(saved_ints[0]); i++) {
+        if ((saved_ints[i] == &ksm_cursor && (ints[i] < 0 || ints[i] >= FRAME_COUNT)) ||
+            (saved_ints[i] == &huge_cursor && ints[i] < 0)) {
+            c->error = 1;
+        }
+    }
+    
+    // Page tables, one per image process, in ascending slot order
+    int tables = ckpt_get_int(c);
+    unsigned int first = c->pos;
+    int last_slot = -1;
+    int huge = 0;
+    for (int n = 0; n < tables && !c->error; n++) {
+        int i = ckpt_get_int(c);
+        int pid = ckpt_get_int(c);
+        int group = ckpt_get_int(c);
+        readahead_t ra;
+        huge += ckpt_get_int(c) != 0;
+        ckpt_get(c, &ra, sizeof(ra));
+        if (i <= last_slot || scheduler_image_slot(pid) != i ||
+            group < 0 || group >= MEMGROUP_COUNT ||
+            ra.window < RA_MIN_WINDOW || ra.window > RA_MAX_WINDOW) {
+            c->error = 1;
+            break;
+        }
+        last_slot = i;
+        for (int j = 0; j < MAX_PAGES_PER_PROCESS; j++) {
+            page_entry_t pte;
+            ckpt_get(c, &pte, sizeof(pte));
+            int offset = ckpt_get_int(c);
+            if ((offset != -1 && !ramfs_pointer(offset)) ||
+                !index_ok(pte.swap_slot, SWAP_SLOTS) || !index_ok(pte.shm_id, SHM_SEGMENTS) ||
+                (pte.shm_id != -1 && (pte.shm_page < 0 || pte.shm_page >= saved_shm[pte.shm_id].pages)) ||
+                (pte.valid && (pte.frame_number < 0 || pte.frame_number >= FRAME_COUNT ||
+                               !saved_frames[pte.frame_number].valid))) {
+                c->error = 1;
+                break;
+            }
+            if (pte.swap_slot != -1) swap_refs[pte.swap_slot]++;
+            if (pte.valid) mapped[pte.frame_number]++;
+        }
+    }
+    if (c->error) return;
+    
+    // Each swap slot's count is exactly its references
+    int swapped = 0;
+    for (int s = 0; s < SWAP_SLOTS; s++) {
+        if (saved_swap[s] != swap_refs[s]) c->error = 1;
+        if (saved_swap[s] != 0) swapped++;
+    }
+    for (unsigned int i = 0; i < sizeof(saved_ints) / sizeof(saved_ints[0]); i++) {
+        if ((saved_ints[i] == &swap_used && ints[i] != swapped) ||
+            (saved_ints[i] == &huge_tables && ints[i] != huge)) {
+            c->error = 1;
+        }
+    }
+    
+    // Each frame's reverse map visits exactly the PTEs found mapping it
+    for (int f = 0; f < FRAME_COUNT && !c->error; f++) {
+        if (!saved_frames[f].valid) continue;
+        if (saved_frames[f].ref_count != mapped[f]) {
+            c->error = 1;
+            break;
+        }
+        int id = saved_frames[f].rmap;
+        for (int step = 0; step < mapped[f]; step++) {
+            page_entry_t pte;
+            if (!saved_pte(c, first, tables, id, &pte) || !pte.valid || pte.frame_number != f) {
+                c->error = 1;
+                break;
+            }
+            id = pte.rmap_next;
+        }
+        if (id != -1) c->error = 1;
+    }
+    
+    pages += swapped;
+    for (int p = 0; p < pages && !c->error; p++) {
+        ckpt_skip(c, PAGE_SIZE);
+    }
+}
+
+// Replace all pager state with a checkpoint image's. Returns the number
+// of pages restored, or -1 (c->error is set) with the pager emptied.
+int memory_load(ckpt_t* c) {
+    ckpt_expect(c, CKPT_SEC_MEMORY);
+    for (unsigned int i = 0; i < sizeof(saved_ints) / sizeof(saved_ints[0]); i++) {
+        *saved_ints[i] = ckpt_get_int(c);
+    }
+    ckpt_get(c, frames, sizeof(frames));
+    ckpt_get(c, groups, sizeof(groups));
+    ckpt_get(c, shm_segments, sizeof(shm_segments));
+    ckpt_get(c, ksm_buckets, sizeof(ksm_buckets));
+    ckpt_get(c, swap_map, sizeof(swap_map));
+    no_frame_reason = 0;
+    
+    // The TLB is not saved: it starts cold, as after a context switch
+    tlb_flush_all();
+    tables_clear();
+    int tables = ckpt_get_int(c);
+    for (int n = 0; n < tables && !c->error; n++) {
+        int i = ckpt_get_int(c);
+        int pid = ckpt_get_int(c);
+        if (i < 0 || i >= table_slots || scheduler_slot(pid) != i) {
+            c->error = 1;
+            break;
+        }
+        TABLE(i)->pid = pid;
+        TABLE(i)->group = ckpt_get_int(c);
+        TABLE(i)->huge = ckpt_get_int(c) != 0;
+        ckpt_get(c, &TABLE(i)->readahead, sizeof(readahead_t));
+        for (int j = 0; j < MAX_PAGES_PER_PROCESS; j++) {
+            page_entry_t* pte = &TABLE(i)->pages[j];
+            ckpt_get(c, pte, sizeof(page_entry_t));
+            int offset = ckpt_get_int(c);
+            if (offset != -1) {
+                pte->file_data = (const unsigned char*)ramfs_pointer(offset);
+                if (!pte->file_data) c->error = 1;   // Not the same initrd
+            }
+        }
+        TABLE(i)->ready = 1;
+    }
+    
+    int pages = 0;
+    for (int f = 0; f < FRAME_COUNT; f++) {
+        if (!frames[f].valid) continue;
+        ckpt_get(c, frame_data[f], PAGE_SIZE);
+        pages++;
+    }
+    for (int s = 0; s < SWAP_SLOTS; s++) {
+        if (swap_map[s] == 0) continue;
+        ckpt_get(c, swap_area[s], PAGE_SIZE);
+        pages++;
+    }
+    
+    if (c->error) {
+        memory_init();
+        tables_clear();
+        return -1;
+    }
+    return pages;
 }
@@ -6,27 +6,140 @@
 #define FRAME_COUNT 16
 #define MAX_PAGES_PER_PROCESS 32
 
+// Read-ahead window limits (in pages)
+#define RA_MIN_WINDOW 1
+#define RA_INIT_WINDOW 2
+#define RA_MAX_WINDOW (FRAME_COUNT / 4)
+
+// Swap device and write-back tuning
+#define SWAP_SLOTS 256
+#define WB_CLUSTER_MAX 8               // Most pages written by one swap I/O
+#define WB_INTERVAL 4                  // Ticks between background write-back passes
+#define WB_SCAN_DEPTH (FRAME_COUNT / 2) // LRU depth searched for a clean victim
+
+// Shared memory segments
+#define SHM_SEGMENTS 8
+#define SHM_MAX_PAGES 8
+
+// Same-page merging scanner
+#define KSM_BUCKETS 32
+#define KSM_SCAN_BATCH 4               // Frames scanned per scheduler tick
+
+// Memory groups: frame quotas for sets of processes. Group 0 holds
+// every process not assigned elsewhere.
+#define MEMGROUP_COUNT 8
+
+// Huge pages: an aligned run of pages mapped by one translation and
+// backed by an aligned run of as many frames. PSE maps 4 MB this way;
+// with FRAME_COUNT frames the run is scaled down to 4 pages.
+#define HUGE_PAGE_PAGES 4
+#define HUGE_PROMOTE_MIN 3             // Resident pages that make a region dense
+#define HUGE_SCAN_BATCH 2              // Regions examined per scheduler tick
+
+// Simulated TLB: fully associative, LRU replacement
+#define TLB_ENTRIES 8
+
 // Frame structure
 typedef struct {
     int pid;           // Process using this frame (-1 if free)
     int page_number;   // Page number stored in this frame
     int last_access;   // Last access time (for LRU)
     int valid;         // Frame is in use
+    int prefetched;    // Loaded by read-ahead and not referenced yet
+    int dirty;         // Contents differ from the swap copy
+    int swap_slot;     // Swap slot holding a clean copy (-1 if none)
+    int ref_count;     // Page table entries mapping this frame
+    int rmap;          // First PTE mapping this frame (-1 if none)
+    int shm_id;        // Shared memory segment owning this frame (-1 if private)
+    int shm_page;      // Page within that segment
+    unsigned int checksum; // Content hash seen by the last merge scan
+    int ksm;           // Holds pages merged by same-page merging
+    int ksm_next;      // Next merge candidate in the same hash bucket
+    int group;         // Memory group charged for this frame
+    int huge;          // Backs a page of a huge mapping
+    int untouched;     // Brought in by a huge mapping, not referenced yet
 } frame_t;
 
 // Page table entry
 typedef struct {
     int frame_number;  // Physical frame number
     int valid;         // Page is loaded in memory
+    int allocated;     // Page was handed out by allocpages
+    int dirty;         // Page was written since it was loaded
+    int swap_slot;     // Swap slot holding the page while not resident
+    int cow;           // Shared copy-on-write: copy before writing
+    int rmap_next;     // Next PTE mapping the same frame (-1 ends the chain)
+    int shm_id;        // Shared memory segment backing this page (-1 if private)
+    int shm_page;      // Page within that segment
+    const unsigned char* file_data; // Image bytes backing the page (0 if anonymous)
+    int file_bytes;    // Bytes taken from file_data; the rest is zero-filled
+    int huge;          // Translated by its region's huge page
 } page_entry_t;
 
+// Per-process read-ahead state
+typedef struct {
+    int last_fault;    // Page of the previous fault (-1 if none)
+    int stride;        // Distance between the last two faults
+    int next;          // Page expected to fault next if the stream continues
+    int window;        // Pages to prefetch on a sequential fault
+} readahead_t;
+
+// Shared memory segment: a page table of its own that processes attach to
+typedef struct {
+    int key;                        // User-chosen key (-1 if unused)
+    int pages;                      // Segment size in pages
+    int attached;                   // Page table entries linked to the segment
+    int frame[SHM_MAX_PAGES];       // Resident frame per page (-1 if none)
+    int swap_slot[SHM_MAX_PAGES];   // Swap copy per page (-1 if none)
+} shm_segment_t;
+
+// Memory group: frames charged to it, and its limits. Frames up to
+// min are never reclaimed for another group; past max the group only
+// recycles its own frames.
+typedef struct {
+    int min;                        // Frames guaranteed
+    int max;                        // Most frames the group may hold
+    int used;                       // Frames charged to the group
+    int faults;
+    int hits;
+    int evicted;                    // Frames reclaimed from the group
+} memgroup_t;
+
+// TLB entry: one page, or a whole region for a huge page
+typedef struct {
+    int proc_index;    // Page table translated (-1 if empty)
+    int page;          // Page, or first page of the region
+    int huge;
+    int last_use;      // Access time, for LRU replacement
+} tlb_entry_t;
+
+struct ckpt;
+
 // Memory management functions
 void memory_init();
+int memory_grow(int n);
 void memory_show_info();
 void memory_show_frames();
 int memory_allocate_pages(int pid, int count);
-void memory_access_page(int pid, int page);
+void memory_access_page(int pid, int page, int write);
+int memory_writeback();
+void memory_tick(int tick);
+int memory_fork(int parent_pid, int child_pid);
+void memory_release_process(int pid);
+int memory_shm_get(int key, int pages);
+int memory_shm_attach(int pid, int key, int base_page);
+int memory_map_file(int pid, int page, const unsigned char* data, int bytes);
+int memory_page_resident(int pid, int page);
+void memory_ksm_enable(int enabled);
+int memory_ksm_scan();
 int memory_get_free_frame();
 int memory_find_lru_frame();
+int memory_group_set(int group, int min, int max);
+int memory_group_assign(int pid, int group);
+void memory_show_groups();
+int memory_huge_enable(int pid, int enabled);
+int memory_save(struct ckpt* c);
+int memory_load(struct ckpt* c);
+void memory_check(struct ckpt* c);
 
 #endif
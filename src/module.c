@@ -0,0 +1,127 @@
+// module.c - Boot module registry
+#include "kernel.h"
+#include "module.h"
+
+static boot_module_t modules[MAX_MODULES];
+static int num_modules = 0;
+static const char* kernel_cmdline = 0;
+static unsigned int modules_end = 0;   // Highest address GRUB loaded a module at
+
+// Name a module after the last path component of the first word of its
+// command line ("/boot/scripts/demo.msh" -> "demo.msh")
+static void module_set_name(boot_module_t* mod, const char* cmdline, int index) {
+    const char* start = cmdline;
+    const char* p = cmdline;
+    int len = 0;
+    
+    if (cmdline) {
+        while (*p && *p != ' ') {
+            if (*p == '/') start = p + 1;
+            p++;
+        }
+        while (start + len < p && len < MODULE_NAME_LEN - 1) {
+            mod->name[len] = start[len];
+            len++;
+        }
+    }
+    
+    if (len == 0) {
+        // Unnamed module: "moduleN"
+        const char* base = "module";
+        while (base[len]) {
+            mod->name[len] = base[len];
+            len++;
+        }
+        if (index >= 10) mod->name[len++] = '0' + index / 10;
+        mod->name[len++] = '0' + index % 10;
+    }
+    mod->name[len] = '\0';
+}
+
+// Record the modules GRUB loaded. Returns the number found.
+int module_init(unsigned int magic, multiboot_info_t* mbi) {
+    num_modules = 0;
+    kernel_cmdline = 0;
+    modules_end = 0;
+    
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !mbi) {
+        return 0;
+    }
+    if (mbi->flags & MULTIBOOT_INFO_CMDLINE) {
+        kernel_cmdline = (const char*)mbi->cmdline;
+    }
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS)) {
+        return 0;
+    }
+    
+    multiboot_module_t* mods = (multiboot_module_t*)mbi->mods_addr;
+    for (unsigned int i = 0; i < mbi->mods_count; i++) {
+        if (mods[i].mod_end > modules_end) modules_end = mods[i].mod_end;
+    }
+    for (unsigned int i = 0; i < mbi->mods_count && num_modules < MAX_MODULES; i++) {
+        boot_module_t* mod = &modules[num_modules];
+        mod->data = (const char*)mods[i].mod_start;
+        mod->size = mods[i].mod_end - mods[i].mod_start;
+        module_set_name(mod, (const char*)mods[i].cmdline, num_modules);
+        num_modules++;
+    }
+    
+    return num_modules;
+}
+
+int module_count() {
+    return num_modules;
+}
+
+const boot_module_t* module_get(int index) {
+    if (index < 0 || index >= num_modules) return 0;
+    return &modules[index];
+}
+
+// End of the highest module (0 if none): the kernel heap starts above it
+unsigned int module_end() {
+    return modules_end;
+}
+
+// Look up "name" or "name=value" among the words of the kernel command
+// line (the first word is the kernel's path). Returns the value, "" for
+// a bare word, or 0 if the option is absent. The value is copied and
+// stays valid until the next call.
+const char* boot_option(const char* name) {
+    static char value[BOOT_OPTION_MAX];
+    
+    if (!kernel_cmdline) return 0;
+    
+    const char* p = kernel_cmdline;
+    while (*p && *p != ' ') p++;
+    while (*p) {
+        while (*p == ' ') p++;
+        
+        int i = 0;
+        while (name[i] && p[i] == name[i]) i++;
+        if (name[i] == '\0' && (p[i] == '\0' || p[i] == ' ')) return "";
+        if (name[i] == '\0' && p[i] == '=') {
+            p += i + 1;
+            int len = 0;
+            while (p[len] && p[len] != ' ' && len < BOOT_OPTION_MAX - 1) {
+                value[len] = p[len];
+                len++;
+            }
+            value[len] = '\0';
+            return value;
+        }
+        
+        while (*p && *p != ' ') p++;
+    }
+    return 0;
+}
+
+// Find a module by name
+const boot_module_t* module_find(const char* name) {
+    for (int i = 0; i < num_modules; i++) {
+        if (strcmp(modules[i].name, name) == 0) {
+            return &modules[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+// module.h - Boot modules loaded by GRUB
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "multiboot.h"
+
+#define MAX_MODULES 16
+#define MODULE_NAME_LEN 32
+#define BOOT_OPTION_MAX 64        // Longest command-line option value kept
+
+// A file GRUB loaded next to the kernel
+typedef struct {
+    char name[MODULE_NAME_LEN];   // Last path component of the module line
+    const char* data;
+    unsigned int size;
+} boot_module_t;
+
+// Module functions
+int module_init(unsigned int magic, multiboot_info_t* mbi);
+int module_count();
+const boot_module_t* module_get(int index);
+const boot_module_t* module_find(const char* name);
+const char* boot_option(const char* name);
+unsigned int module_end();
+
+#endif
@@ -0,0 +1,63 @@
+// multiboot.h - Multiboot (v1) information structures
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// multiboot_info_t flags
+#define MULTIBOOT_INFO_MEMORY   0x001
+#define MULTIBOOT_INFO_CMDLINE  0x004
+#define MULTIBOOT_INFO_MODS     0x008
+#define MULTIBOOT_INFO_FRAMEBUFFER 0x1000
+
+// framebuffer_type values
+#define MULTIBOOT_FRAMEBUFFER_INDEXED 0
+#define MULTIBOOT_FRAMEBUFFER_RGB     1
+#define MULTIBOOT_FRAMEBUFFER_TEXT    2
+
+// Boot module descriptor
+typedef struct {
+    unsigned int mod_start;
+    unsigned int mod_end;
+    unsigned int cmdline;
+    unsigned int reserved;
+} multiboot_module_t;
+
+// Boot information passed in EBX
+typedef struct {
+    unsigned int flags;
+    unsigned int mem_lower;
+    unsigned int mem_upper;
+    unsigned int boot_device;
+    unsigned int cmdline;
+    unsigned int mods_count;
+    unsigned int mods_addr;
+    unsigned int syms[4];
+    unsigned int mmap_length;
+    unsigned int mmap_addr;
+    unsigned int drives_length;
+    unsigned int drives_addr;
+    unsigned int config_table;
+    unsigned int boot_loader_name;
+    unsigned int apm_table;
+    unsigned int vbe_control_info;
+    unsigned int vbe_mode_info;
+    unsigned short vbe_mode;
+    unsigned short vbe_interface_seg;
+    unsigned short vbe_interface_off;
+    unsigned short vbe_interface_len;
+    unsigned long long framebuffer_addr;
+    unsigned int framebuffer_pitch;    // Bytes per scan line
+    unsigned int framebuffer_width;    // Pixels (characters for TEXT)
+    unsigned int framebuffer_height;
+    unsigned char framebuffer_bpp;
+    unsigned char framebuffer_type;
+    unsigned char red_position;        // RGB: bit position and size of each field
+    unsigned char red_size;
+    unsigned char green_position;
+    unsigned char green_size;
+    unsigned char blue_position;
+    unsigned char blue_size;
+} __attribute__((packed)) multiboot_info_t;
+
+#endif
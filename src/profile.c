@@ -0,0 +1,140 @@
+// profile.c - Sampling profiler: PIT interrupts histogram the interrupted EIP
+#include "kernel.h"
+#include "profile.h"
+#include "ksyms.h"
+#include "irq.h"
+
+static volatile unsigned int counts[PROFILE_MAX_SYMBOLS];
+static volatile unsigned int samples = 0;
+static volatile unsigned int unknown = 0;   // EIP outside the symbol table
+static int running = 0;
+
+// Find the function containing an address: the last symbol at or
+// below it. Returns -1 if it lies before the first symbol.
+static int ksym_find(unsigned int addr) {
+    int low = 0;
+    int high = ksym_count - 1;
+    int found = -1;
+    
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (ksyms[mid].addr <= addr) {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Timer interrupt: charge one sample to the interrupted function
+static void profile_sample(unsigned int eip) {
+    int sym = ksym_find(eip);
+    samples++;
+    if (sym < 0 || sym >= PROFILE_MAX_SYMBOLS) {
+        unknown++;
+    } else {
+        counts[sym]++;
+    }
+}
+
+// Clear the histogram and start taking PIT interrupts
+void profile_start() {
+    for (int i = 0; i < PROFILE_MAX_SYMBOLS; i++) {
+        counts[i] = 0;
+    }
+    samples = 0;
+    unknown = 0;
+    
+    irq_register(IRQ_TIMER, profile_sample);
+    pit_set_frequency(PROFILE_HZ);
+    irq_unmask(IRQ_TIMER);
+    running = 1;
+    __asm__ volatile ("sti");
+}
+
+void profile_stop() {
+    __asm__ volatile ("cli");
+    irq_mask(IRQ_TIMER);
+    running = 0;
+}
+
+// Print a sample share as a percentage with one decimal
+static void print_share(unsigned int count, unsigned int total) {
+    unsigned int tenths = (unsigned int)udiv64((unsigned long long)count * 1000, total);
+    if (tenths < 1000) print(" ");
+    if (tenths < 100) print(" ");
+    print_int(tenths / 10);
+    print(".");
+    print_int(tenths % 10);
+    print("%");
+}
+
+// Print one report row
+static void print_row(unsigned int count, unsigned int total, const char* name) {
+    print("  ");
+    print_share(count, total);
+    print("  ");
+    int digits = 1;
+    for (unsigned int v = count; v >= 10; v /= 10) digits++;
+    for (int i = digits; i < 8; i++) print(" ");
+    print_int(count);
+    print("  ");
+    print(name);
+    print("\n");
+}
+
+// Show the functions with the most samples
+void profile_report() {
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("\n  Profile (");
+    print_int(PROFILE_HZ);
+    print(" Hz sampling, ");
+    print_int(ksym_count);
+    print(" symbols)");
+    print(running ? " - running\n" : "\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    unsigned int total = samples;
+    if (total == 0) {
+        print("  No samples (profile start, then run a workload)\n\n");
+        return;
+    }
+    
+    print("  Samples: ");
+    print_int(total);
+    print("\n\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("   Share   Samples  Function\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    
+    // Pick the largest remaining bucket PROFILE_TOP times
+    int limit = ksym_count < PROFILE_MAX_SYMBOLS ? ksym_count : PROFILE_MAX_SYMBOLS;
+    unsigned int shown = 0;
+    unsigned int prev_count = 0xFFFFFFFF;
+    int prev_sym = -1;
+    for (int n = 0; n < PROFILE_TOP; n++) {
+        int best = -1;
+        for (int i = 0; i < limit; i++) {
+            if (counts[i] == 0) continue;
+            // Order by count, then by symbol index, below the previous pick
+            if (counts[i] > prev_count || (counts[i] == prev_count && i <= prev_sym)) continue;
+            if (best == -1 || counts[i] > counts[best]) best = i;
+        }
+        if (best == -1) break;
+        
+        print_row(counts[best], total, ksyms[best].name);
+        shown += counts[best];
+        prev_count = counts[best];
+        prev_sym = best;
+    }
+    
+    if (unknown > 0) {
+        print_row(unknown, total, "[unknown]");
+    }
+    if (total - shown - unknown > 0) {
+        print_row(total - shown - unknown, total, "[other functions]");
+    }
+    print("\n");
+}
@@ -0,0 +1,14 @@
+// profile.h - Timer-driven sampling profiler
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define PROFILE_HZ 1000                // PIT samples per second
+#define PROFILE_MAX_SYMBOLS 1024       // Histogram buckets
+#define PROFILE_TOP 10                 // Functions shown by the report
+
+// Profiler functions
+void profile_start();
+void profile_stop();
+void profile_report();
+
+#endif
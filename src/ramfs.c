@@ -0,0 +1,415 @@
+// ramfs.c - Read-only RAM filesystem unpacked from a ustar initrd
+#include "kernel.h"
+#include "ramfs.h"
+
+// ustar header layout
+#define TAR_BLOCK 512
+#define TAR_NAME 0
+#define TAR_NAME_LEN 100
+#define TAR_MODE 100
+#define TAR_SIZE 124
+#define TAR_MTIME 136
+#define TAR_TYPE 156
+#define TAR_MAGIC 257
+#define TAR_PREFIX 345
+#define TAR_PREFIX_LEN 155
+
+static ramfs_inode_t inodes[RAMFS_MAX_INODES];
+static int num_inodes = 0;
+static int dir_hash[RAMFS_HASH_BUCKETS];    // Heads of (parent, name) chains
+static const char* archive = 0;             // Start of the initrd module
+static unsigned int archive_size = 0;
+static unsigned int file_bytes = 0;
+
+// Hash a directory entry by its parent and name
+static unsigned int entry_hash(int parent, const char* name, int len) {
+    unsigned int hash = 2166136261u ^ (unsigned int)parent;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (RAMFS_HASH_BUCKETS - 1);
+}
+
+// Compare a stored name with a length-delimited path component
+static int name_equal(const char* stored, const char* name, int len) {
+    for (int i = 0; i < len; i++) {
+        if (stored[i] != name[i]) return 0;
+    }
+    return stored[len] == '\0';
+}
+
+// Find an entry in a directory: one hash and a short chain walk
+static int dir_lookup(int dir, const char* name, int len) {
+    if (len >= RAMFS_NAME_LEN) len = RAMFS_NAME_LEN - 1;
+    
+    int ino = dir_hash[entry_hash(dir, name, len)];
+    while (ino != -1) {
+        if (inodes[ino].parent == dir && name_equal(inodes[ino].name, name, len)) {
+            return ino;
+        }
+        ino = inodes[ino].hash_next;
+    }
+    return -1;
+}
+
+// Create an entry in a directory. Returns -1 if the inode table is full.
+static int new_inode(int parent, const char* name, int len, int type) {
+    if (num_inodes >= RAMFS_MAX_INODES) return -1;
+    if (len >= RAMFS_NAME_LEN) len = RAMFS_NAME_LEN - 1;
+    
+    int ino = num_inodes++;
+    ramfs_inode_t* node = &inodes[ino];
+    for (int i = 0; i < len; i++) node->name[i] = name[i];
+    node->name[len] = '\0';
+    node->type = type;
+    node->parent = parent;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->mode = (type == RAMFS_DIR) ? 0755 : 0644;
+    node->mtime = 0;
+    node->size = 0;
+    node->data = 0;
+    
+    // Append to the parent so listings keep archive order
+    if (ino != RAMFS_ROOT) {
+        int* link = &inodes[parent].first_child;
+        while (*link != -1) link = &inodes[*link].next_sibling;
+        *link = ino;
+    }
+    
+    unsigned int bucket = entry_hash(parent, node->name, len);
+    node->hash_next = dir_hash[bucket];
+    dir_hash[bucket] = ino;
+    
+    return ino;
+}
+
+// Add a path from the archive, creating missing parent directories.
+// Returns the inode of the last component, or -1.
+static int add_path(const char* path, int type) {
+    int dir = RAMFS_ROOT;
+    const char* p = path;
+    
+    while (1) {
+        while (*p == '/') p++;
+        if (*p == '\0') return dir;
+        
+        const char* name = p;
+        while (*p && *p != '/') p++;
+        int len = p - name;
+        while (*p == '/') p++;
+        int last = (*p == '\0');
+        
+        if (len == 1 && name[0] == '.') {
+            if (last) return dir;
+            continue;
+        }
+        
+        int ino = dir_lookup(dir, name, len);
+        if (ino == -1) {
+            ino = new_inode(dir, name, len, last ? type : RAMFS_DIR);
+            if (ino == -1) return -1;
+        } else if (!last && inodes[ino].type != RAMFS_DIR) {
+            return -1;
+        }
+        
+        if (last) return ino;
+        dir = ino;
+    }
+}
+
+// Parse a NUL/space terminated octal header field
+static unsigned int parse_octal(const char* field, int width) {
+    unsigned int value = 0;
+    for (int i = 0; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+// Build the inode tree from a ustar archive. Returns the number of files.
+int ramfs_init(const boot_module_t* mod) {
+    num_inodes = 0;
+    file_bytes = 0;
+    archive = 0;
+    archive_size = 0;
+    for (int i = 0; i < RAMFS_HASH_BUCKETS; i++) {
+        dir_hash[i] = -1;
+    }
+    new_inode(RAMFS_ROOT, "", 0, RAMFS_DIR);
+    inodes[RAMFS_ROOT].parent = RAMFS_ROOT;
+    
+    if (!mod) return 0;
+    archive = mod->data;
+    archive_size = mod->size;
+    
+    int files = 0;
+    unsigned int pos = 0;
+    while (pos + TAR_BLOCK <= mod->size) {
+        const char* hdr = mod->data + pos;
+        if (hdr[TAR_NAME] == '\0') break;   // Zero block ends the archive
+        if (hdr[TAR_MAGIC] != 'u' || hdr[TAR_MAGIC + 1] != 's' || hdr[TAR_MAGIC + 2] != 't' ||
+            hdr[TAR_MAGIC + 3] != 'a' || hdr[TAR_MAGIC + 4] != 'r') {
+            break;
+        }
+        
+        unsigned int size = parse_octal(hdr + TAR_SIZE, 12);
+        unsigned int data = pos + TAR_BLOCK;
+        if (data + size > mod->size) break;
+        
+        // Full name is prefix "/" name
+        char path[TAR_PREFIX_LEN + TAR_NAME_LEN + 2];
+        int len = 0;
+        for (int i = 0; i < TAR_PREFIX_LEN && hdr[TAR_PREFIX + i]; i++) path[len++] = hdr[TAR_PREFIX + i];
+        if (len > 0) path[len++] = '/';
+        for (int i = 0; i < TAR_NAME_LEN && hdr[TAR_NAME + i]; i++) path[len++] = hdr[TAR_NAME + i];
+        path[len] = '\0';
+        
+        char type = hdr[TAR_TYPE];
+        int ino = -1;
+        if (type == '5') {
+            ino = add_path(path, RAMFS_DIR);
+        } else if (type == '0' || type == '\0') {
+            ino = add_path(path, RAMFS_FILE);
+            if (ino != -1 && inodes[ino].type == RAMFS_FILE) {
+                inodes[ino].data = mod->data + data;
+                inodes[ino].size = size;
+                file_bytes += size;
+                files++;
+            }
+        }
+        // Links and extended headers are skipped
+        
+        if (ino != -1) {
+            inodes[ino].mode = parse_octal(hdr + TAR_MODE, 8) & 0777;
+            inodes[ino].mtime = parse_octal(hdr + TAR_MTIME, 12);
+        }
+        
+        pos = data + ((size + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1));
+    }
+    
+    return files;
+}
+
+// Resolve an absolute or root-relative path. Returns -1 if not found.
+int ramfs_lookup(const char* path) {
+    int ino = RAMFS_ROOT;
+    const char* p = path;
+    
+    while (1) {
+        while (*p == '/') p++;
+        if (*p == '\0') return ino;
+        
+        const char* name = p;
+        while (*p && *p != '/') p++;
+        int len = p - name;
+        
+        if (inodes[ino].type != RAMFS_DIR) return -1;
+        
+        if (len == 1 && name[0] == '.') continue;
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            ino = inodes[ino].parent;
+            continue;
+        }
+        
+        ino = dir_lookup(ino, name, len);
+        if (ino == -1) return -1;
+    }
+}
+
+const ramfs_inode_t* ramfs_inode(int ino) {
+    if (ino < 0 || ino >= num_inodes) return 0;
+    return &inodes[ino];
+}
+
+// Zero-copy access: a pointer into the initrd and the bytes left from offset
+const char* ramfs_map(int ino, unsigned int offset, unsigned int* len) {
+    const ramfs_inode_t* node = ramfs_inode(ino);
+    if (!node || node->type != RAMFS_FILE || offset > node->size) {
+        *len = 0;
+        return 0;
+    }
+    *len = node->size - offset;
+    return node->data + offset;
+}
+
+// Position of a pointer into the archive, so it can be kept across
+// boots (the module may load elsewhere). -1 if it points outside.
+int ramfs_offset(const char* ptr) {
+    if (!archive || ptr < archive || ptr >= archive + archive_size) return -1;
+    return ptr - archive;
+}
+
+// Pointer back from ramfs_offset (0 if out of range)
+const char* ramfs_pointer(int offset) {
+    if (!archive || offset < 0 || (unsigned int)offset >= archive_size) return 0;
+    return archive + offset;
+}
+
+// The whole archive, for identifying the initrd by its contents
+const char* ramfs_archive(unsigned int* size) {
+    *size = archive_size;
+    return archive;
+}
+
+// Copying read for callers that need their own buffer
+int ramfs_read(int ino, unsigned int offset, char* buf, unsigned int len) {
+    unsigned int avail;
+    const char* src = ramfs_map(ino, offset, &avail);
+    if (!src) return -1;
+    
+    if (len > avail) len = avail;
+    memcpy(buf, src, len);
+    return len;
+}
+
+// Find a file by boot module name or initrd path. Returns its contents
+// (in place) and size, or 0 if there is no such file.
+const char* ramfs_open(const char* name, unsigned int* size) {
+    const boot_module_t* mod = module_find(name);
+    if (mod) {
+        *size = mod->size;
+        return mod->data;
+    }
+    
+    int ino = ramfs_lookup(name);
+    if (ino != -1 && inodes[ino].type == RAMFS_FILE) {
+        return ramfs_map(ino, 0, size);
+    }
+    *size = 0;
+    return 0;
+}
+
+// Print permission bits as octal
+static void print_octal(unsigned int value) {
+    char buf[12];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (value & 7);
+        value >>= 3;
+    } while (value);
+    print_char('0');
+    while (i > 0) print_char(buf[--i]);
+}
+
+// Resolve a path for a shell command, reporting failures
+static int lookup_or_report(const char* path) {
+    int ino = ramfs_lookup(path);
+    if (ino == -1) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: No such file or directory: ");
+        print(path);
+        print("\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    }
+    return ino;
+}
+
+// Print one directory entry
+static void print_entry(int ino) {
+    const ramfs_inode_t* node = &inodes[ino];
+    
+    print("  ");
+    print(node->type == RAMFS_DIR ? "d " : "- ");
+    
+    int width = 1;
+    for (unsigned int n = node->size; n >= 10; n /= 10) width++;
+    for (int i = width; i < 8; i++) print(" ");
+    print_int(node->size);
+    print("  ");
+    
+    if (node->type == RAMFS_DIR) {
+        set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
+        print(node->name);
+        print("/");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        print(node->name);
+    }
+    print("\n");
+}
+
+// List a directory
+void ramfs_list(const char* path) {
+    int ino = lookup_or_report(path);
+    if (ino == -1) return;
+    
+    if (inodes[ino].type == RAMFS_FILE) {
+        print_entry(ino);
+        return;
+    }
+    
+    int entries = 0;
+    for (int child = inodes[ino].first_child; child != -1; child = inodes[child].next_sibling) {
+        print_entry(child);
+        entries++;
+    }
+    if (entries == 0) {
+        print(archive ? "  (empty)\n" : "  (no initrd loaded)\n");
+    }
+}
+
+// Print a file straight from the initrd
+void ramfs_cat(const char* path) {
+    int ino = lookup_or_report(path);
+    if (ino == -1) return;
+    
+    if (inodes[ino].type != RAMFS_FILE) {
+        print("Not a file: ");
+        print(path);
+        print("\n");
+        return;
+    }
+    
+    unsigned int len;
+    const char* data = ramfs_map(ino, 0, &len);
+    for (unsigned int i = 0; i < len; i++) {
+        print_char(data[i]);
+    }
+    if (len > 0 && data[len - 1] != '\n') print("\n");
+}
+
+// Show inode details
+void ramfs_stat(const char* path) {
+    int ino = lookup_or_report(path);
+    if (ino == -1) return;
+    
+    const ramfs_inode_t* node = &inodes[ino];
+    
+    print("\n  Inode:  ");
+    print_int(ino);
+    print("\n  Type:   ");
+    print(node->type == RAMFS_DIR ? "directory" : "regular file");
+    print("\n  Size:   ");
+    print_int(node->size);
+    print(" bytes\n  Mode:   ");
+    print_octal(node->mode);
+    print("\n  Mtime:  ");
+    print_int(node->mtime);
+    print("\n  Parent: ");
+    print_int(node->parent);
+    
+    if (node->type == RAMFS_DIR) {
+        int entries = 0;
+        for (int child = node->first_child; child != -1; child = inodes[child].next_sibling) {
+            entries++;
+        }
+        print("\n  Entries: ");
+        print_int(entries);
+    } else {
+        print("\n  Data:   initrd offset ");
+        print_int(node->data - archive);
+        print(" (zero-copy)");
+    }
+    
+    if (ino == RAMFS_ROOT) {
+        print("\n  Filesystem: ");
+        print_int(num_inodes);
+        print("/");
+        print_int(RAMFS_MAX_INODES);
+        print(" inodes, ");
+        print_int(file_bytes);
+        print(" bytes in files");
+    }
+    print("\n\n");
+}
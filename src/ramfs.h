@@ -0,0 +1,47 @@
+// ramfs.h - Read-only RAM filesystem backed by the initrd module
+#ifndef RAMFS_H
+#define RAMFS_H
+
+#include "module.h"
+
+#define RAMFS_MODULE "initrd.tar"     // GRUB module holding the archive
+#define RAMFS_MAX_INODES 128
+#define RAMFS_NAME_LEN 32
+#define RAMFS_HASH_BUCKETS 64         // Directory entry hash (power of two)
+#define RAMFS_ROOT 0                  // Inode number of "/"
+
+// Inode types
+#define RAMFS_FILE 1
+#define RAMFS_DIR  2
+
+// Inode: files point straight into the archive, nothing is copied
+typedef struct {
+    char name[RAMFS_NAME_LEN];
+    int type;          // RAMFS_FILE or RAMFS_DIR (0 if unused)
+    int parent;        // Parent directory inode
+    int first_child;   // Directories: first entry (-1 if empty)
+    int next_sibling;  // Next entry in the parent directory
+    int hash_next;     // Next inode in the same lookup bucket
+    unsigned int mode; // Permission bits from the archive
+    unsigned int mtime;
+    unsigned int size;
+    const char* data;  // File contents inside the module
+} ramfs_inode_t;
+
+// Filesystem functions
+int ramfs_init(const boot_module_t* mod);
+int ramfs_lookup(const char* path);
+const ramfs_inode_t* ramfs_inode(int ino);
+const char* ramfs_map(int ino, unsigned int offset, unsigned int* len);
+int ramfs_read(int ino, unsigned int offset, char* buf, unsigned int len);
+int ramfs_offset(const char* ptr);
+const char* ramfs_pointer(int offset);
+const char* ramfs_archive(unsigned int* size);
+const char* ramfs_open(const char* name, unsigned int* size);
+
+// Shell commands
+void ramfs_list(const char* path);
+void ramfs_cat(const char* path);
+void ramfs_stat(const char* path);
+
+#endif
@@ -1,21 +1,195 @@
 // scheduler.c - CPU scheduler implementation
 #include "kernel.h"
 #include "scheduler.h"
+#include "memory.h"
+#include "ipc.h"
+#include "elf.h"
+#include "trace.h"
+#include "timer.h"
+#include "log.h"
+#include "checkpoint.h"
+
+// The process table grows PROC_CHUNK PCBs at a time from the kernel
+// heap. Slot i lives in chunks[i / PROC_CHUNK]; page tables, mailboxes
+// and exec images are kept per slot too and grow with it.
+static pcb_t* chunks[PID_MAX / PROC_CHUNK];
+static int process_slots = 0;      // Slots used so far; the rest are untouched
+static int capacity = 0;           // Slots in the allocated chunks
+static int free_top = -1;          // Free-slot stack, linked through next_free
+
+// PID -> slot, as a two-level radix table: leaves of PID_LEAF slots
+// (-1: no process) are allocated the first time a PID in range is used
+static int* pid_index[PID_MAX / PID_LEAF];
 
-static pcb_t process_table[MAX_PROCESSES];
 static int next_pid = 1;
 static int current_pid = -1;
 static sched_mode_t sched_mode = SCHED_FCFS;
 static int time_quantum = 4;
 static int current_tick = 0;
 
-// Initialize scheduler
+// READY processes, in the order they became ready. Waiting processes
+// are on a wait queue or only have a timer, never here.
+static wait_queue_t ready_queue;
+
+// Time slice of the running process
+static ktimer_t quantum_timer;
+static int quantum_expired = 0;
+
+// System-wide scheduling statistics (schedstat)
+static unsigned int stat_dispatches = 0;
+static unsigned int stat_switches = 0;     // Dispatches of another process than the last
+static unsigned int stat_voluntary = 0;
+static unsigned int stat_involuntary = 0;
+static unsigned int stat_busy = 0;         // Ticks a process ran
+static unsigned int stat_idle = 0;
+static unsigned int stat_latency[SCHED_LAT_BUCKETS];
+static unsigned long long stat_latency_total = 0;
+static unsigned int stat_latency_max = 0;
+static int last_run_pid = -1;
+static int stats_since = 0;                // Tick of the last reset
+
+#define PCB(i) (&chunks[(i) / PROC_CHUNK][(i) % PROC_CHUNK])
+
+// Initialize scheduler. Table slots are set up as they are first
+// handed out, so this does not depend on the table size.
 void scheduler_init() {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        process_table[i].pid = -1;
-        process_table[i].state = PROC_TERMINATED;
-    }
+    process_slots = 0;
+    free_top = -1;
     current_tick = 0;
+    ready_queue.head = 0;
+    ready_queue.tail = 0;
+    timer_init();
+    scheduler_reset_stats();
+}
+
+// Wait queues: FIFO lists linked through the PCBs
+
+void wait_queue_init(wait_queue_t* queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+static void queue_push(wait_queue_t* queue, pcb_t* proc) {
+    proc->queue = queue;
+    proc->queue_next = 0;
+    proc->queue_prev = queue->tail;
+    if (queue->tail) {
+        queue->tail->queue_next = proc;
+    } else {
+        queue->head = proc;
+    }
+    queue->tail = proc;
+}
+
+static void queue_remove(pcb_t* proc) {
+    wait_queue_t* queue = proc->queue;
+    if (!queue) return;
+    
+    if (proc->queue_prev) {
+        proc->queue_prev->queue_next = proc->queue_next;
+    } else {
+        queue->head = proc->queue_next;
+    }
+    if (proc->queue_next) {
+        proc->queue_next->queue_prev = proc->queue_prev;
+    } else {
+        queue->tail = proc->queue_prev;
+    }
+    proc->queue = 0;
+    proc->queue_next = 0;
+    proc->queue_prev = 0;
+}
+
+// A slot's PCB is reused and chunks come from the heap uncleared
+static void reset_links(pcb_t* proc) {
+    proc->queue = 0;
+    proc->queue_next = 0;
+    proc->queue_prev = 0;
+    memset(&proc->timer, 0, sizeof(proc->timer));
+}
+
+static void make_ready(pcb_t* proc) {
+    proc->state = PROC_READY;
+    proc->stats.ready_since = current_tick;
+    queue_push(&ready_queue, proc);
+}
+
+// Slot of a PID, or -1
+static int pid_slot(int pid) {
+    if (pid <= 0 || pid >= PID_MAX) return -1;
+    int* leaf = pid_index[pid / PID_LEAF];
+    return leaf ? leaf[pid % PID_LEAF] : -1;
+}
+
+// Slot of a live PID, or -1. Other subsystems key per-process state by it.
+int scheduler_slot(int pid) {
+    return pid_slot(pid);
+}
+
+// Point a PID at a slot (-1 to remove it). Returns 0 if a new index
+// leaf was needed and the heap is exhausted.
+static int pid_set(int pid, int slot) {
+    int** leaf = &pid_index[pid / PID_LEAF];
+    if (!*leaf) {
+        if (slot == -1) return 1;
+        *leaf = (int*)kalloc(PID_LEAF * sizeof(int));
+        if (!*leaf) return 0;
+        memset(*leaf, 0xFF, PID_LEAF * sizeof(int));
+    }
+    (*leaf)[pid % PID_LEAF] = slot;
+    return 1;
+}
+
+// Next unused PID. PIDs wrap at PID_MAX, skipping ones still in use,
+// so the search is short unless nearly every PID is live.
+static int alloc_pid() {
+    for (int tries = 1; tries < PID_MAX; tries++) {
+        int pid = next_pid++;
+        if (next_pid == PID_MAX) next_pid = 1;
+        if (pid_slot(pid) == -1) return pid;
+    }
+    return -1;
+}
+
+// Add a chunk of slots: the PCBs and each subsystem's per-slot state.
+// Whatever was allocated before a failure is kept for the next attempt.
+// Returns 0 if the table is at PID_MAX or the heap is exhausted.
+static int grow_table() {
+    int n = capacity / PROC_CHUNK;
+    if (capacity == PID_MAX) return 0;
+    if (!chunks[n]) {
+        chunks[n] = (pcb_t*)kalloc(PROC_CHUNK * sizeof(pcb_t));
+        if (!chunks[n]) return 0;
+    }
+    if (!memory_grow(n) || !ipc_grow(n) || !elf_grow(n)) return 0;
+    capacity += PROC_CHUNK;
+    return 1;
+}
+
+// Take a slot from the free stack, or the next never-used one, growing
+// the table by a chunk when it is full. Returns -1 if out of memory.
+static int claim_slot() {
+    if (free_top != -1) {
+        int i = free_top;
+        free_top = PCB(i)->next_free;
+        return i;
+    }
+    if (process_slots == capacity && !grow_table()) return -1;
+    return process_slots++;
+}
+
+// Give a PID to a claimed slot. Returns the PID, or -1 (and the slot
+// goes back on the free stack) if none can be had.
+static int assign_pid(int i) {
+    int pid = alloc_pid();
+    if (pid == -1 || !pid_set(pid, i)) {
+        PCB(i)->pid = -1;
+        PCB(i)->next_free = free_top;
+        free_top = i;
+        return -1;
+    }
+    PCB(i)->pid = pid;
+    return pid;
 }
 
 // Set scheduling mode
@@ -30,146 +204,306 @@ void scheduler_set_quantum(int quantum) {
 
 // Create new process
 int scheduler_create_process(int burst, int priority) {
-    // Find free slot
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].pid == -1) {
-            process_table[i].pid = next_pid++;
-            process_table[i].state = PROC_READY;
-            process_table[i].priority = priority;
-            process_table[i].burst_time = burst;
-            process_table[i].remaining_time = burst;
-            process_table[i].arrival_time = current_tick;
-            process_table[i].waiting_time = 0;
-            process_table[i].turnaround_time = 0;
-            process_table[i].time_slice = time_quantum;
-            
-            return process_table[i].pid;
-        }
+    int i = claim_slot();
+    if (i == -1) {
+        return -1;  // No free slot
+    }
+    
+    if (assign_pid(i) == -1) {
+        return -1;
     }
-    return -1;  // No free slot
+    PCB(i)->priority = priority;
+    PCB(i)->burst_time = burst;
+    PCB(i)->remaining_time = burst;
+    PCB(i)->arrival_time = current_tick;
+    PCB(i)->waiting_time = 0;
+    PCB(i)->turnaround_time = 0;
+    reset_links(PCB(i));
+    memset(&PCB(i)->stats, 0, sizeof(sched_stats_t));
+    make_ready(PCB(i));
+    
+    return PCB(i)->pid;
+}
+
+// Fork process: the child gets a copy of the parent's PCB
+int scheduler_fork_process(int pid) {
+    pcb_t* parent = scheduler_get_process(pid);
+    if (!parent) {
+        return -1;
+    }
+    
+    int i = claim_slot();
+    if (i == -1) {
+        return -1;  // No free slot
+    }
+    
+    *PCB(i) = *parent;
+    if (assign_pid(i) == -1) {
+        return -1;
+    }
+    PCB(i)->arrival_time = current_tick;
+    PCB(i)->waiting_time = 0;
+    PCB(i)->turnaround_time = 0;
+    reset_links(PCB(i));
+    memset(&PCB(i)->stats, 0, sizeof(sched_stats_t));
+    make_ready(PCB(i));
+    
+    return PCB(i)->pid;
 }
 
 // Kill process
 int scheduler_kill_process(int pid) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].pid == pid) {
-            process_table[i].state = PROC_TERMINATED;
-            process_table[i].pid = -1;
-            if (current_pid == pid) {
-                current_pid = -1;
-            }
-            return 1;
-        }
+    int i = pid_slot(pid);
+    if (i == -1) {
+        return 0;
     }
-    return 0;
+    
+    queue_remove(PCB(i));
+    timer_cancel(&PCB(i)->timer);
+    if (current_pid == pid) {
+        timer_cancel(&quantum_timer);
+    }
+    memory_release_process(pid);
+    ipc_reset(pid);
+    pid_set(pid, -1);
+    PCB(i)->state = PROC_TERMINATED;
+    PCB(i)->pid = -1;
+    PCB(i)->next_free = free_top;
+    free_top = i;
+    if (current_pid == pid) {
+        current_pid = -1;
+    }
+    return 1;
+}
+
+// Kill every process, finished ones included
+void scheduler_kill_all() {
+    for (int i = 0; i < process_slots; i++) {
+        if (PCB(i)->pid != -1) scheduler_kill_process(PCB(i)->pid);
+    }
+}
+
+// Take a process off the CPU or the ready queue. Returns 0 if it is
+// already waiting or has finished.
+static int stop_process(pcb_t* proc) {
+    if (proc->state == PROC_READY) {
+        proc->waiting_time += current_tick - proc->stats.ready_since;
+        queue_remove(proc);
+    } else if (proc->state == PROC_RUNNING) {
+        timer_cancel(&quantum_timer);
+        current_pid = -1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Timer callback: a sleep ended, or a wait timed out
+static void wait_expired(int pid) {
+    pcb_t* proc = scheduler_get_process(pid);
+    if (!proc || proc->state != PROC_WAITING) return;
+    
+    int timed_out = proc->queue != 0;
+    queue_remove(proc);
+    make_ready(proc);
+    printk(LOG_INFO, timed_out ? "Process %d timed out waiting" : "Process %d woke up", pid);
+}
+
+// Block a process on a queue (0 for none) for up to timeout ticks
+// (0: until woken)
+static int block_process(int pid, wait_queue_t* queue, int timeout) {
+    pcb_t* proc = scheduler_get_process(pid);
+    if (!proc) {
+        return 0;
+    }
+    int was_running = (proc->state == PROC_RUNNING);
+    if (!stop_process(proc)) {
+        return 0;
+    }
+    
+    if (was_running) {
+        proc->stats.voluntary++;
+        stat_voluntary++;
+    }
+    proc->state = PROC_WAITING;
+    if (queue) {
+        queue_push(queue, proc);
+    }
+    if (timeout > 0) {
+        timer_add(&proc->timer, timeout, wait_expired, pid);
+    }
+    return 1;
+}
+
+// Put a process to sleep (PROC_WAITING) for a number of ticks
+int scheduler_sleep(int pid, int ticks) {
+    if (ticks <= 0) return 0;
+    return block_process(pid, 0, ticks);
+}
+
+// Block a process on a wait queue until scheduler_wake_one reaches it
+// or, if timeout > 0, that many ticks pass
+int scheduler_wait(wait_queue_t* queue, int pid, int timeout) {
+    return block_process(pid, queue, timeout);
+}
+
+// Make a waiting process ready again, whatever it waits for
+int scheduler_wake(int pid) {
+    pcb_t* proc = scheduler_get_process(pid);
+    if (!proc || proc->state != PROC_WAITING) {
+        return 0;
+    }
+    
+    queue_remove(proc);
+    timer_cancel(&proc->timer);
+    make_ready(proc);
+    return 1;
+}
+
+// Wake the longest waiter on a queue. Returns its PID, or -1 if the
+// queue is empty.
+int scheduler_wake_one(wait_queue_t* queue) {
+    pcb_t* proc = queue->head;
+    if (!proc) {
+        return -1;
+    }
+    int pid = proc->pid;
+    scheduler_wake(pid);
+    return pid;
 }
 
 // Get process by PID
 pcb_t* scheduler_get_process(int pid) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].pid == pid) {
-            return &process_table[i];
-        }
-    }
-    return 0;
+    int i = pid_slot(pid);
+    return i == -1 ? 0 : PCB(i);
 }
 
-// Pick next process based on scheduling algorithm
-static int pick_next_process() {
-    int selected = -1;
+// Pick next process based on scheduling algorithm. Only the ready
+// queue is searched.
+static pcb_t* pick_next_process() {
+    pcb_t* selected = 0;
     
     if (sched_mode == SCHED_FCFS) {
         // First Come First Serve - pick oldest ready process
         int earliest = 0x7FFFFFFF;
-        for (int i = 0; i < MAX_PROCESSES; i++) {
-            if (process_table[i].pid != -1 && 
-                process_table[i].state == PROC_READY &&
-                process_table[i].arrival_time < earliest) {
-                earliest = process_table[i].arrival_time;
-                selected = i;
+        for (pcb_t* proc = ready_queue.head; proc; proc = proc->queue_next) {
+            if (proc->arrival_time < earliest) {
+                earliest = proc->arrival_time;
+                selected = proc;
             }
         }
     } else if (sched_mode == SCHED_RR) {
-        // Round Robin - pick next ready process after current
-        int start = (current_pid == -1) ? 0 : (current_pid % MAX_PROCESSES + 1);
-        for (int count = 0; count < MAX_PROCESSES; count++) {
-            int i = (start + count) % MAX_PROCESSES;
-            if (process_table[i].pid != -1 && 
-                process_table[i].state == PROC_READY) {
-                selected = i;
-                break;
-            }
-        }
+        // Round Robin - the queue is in turn order
+        selected = ready_queue.head;
     } else if (sched_mode == SCHED_PRIORITY) {
         // Priority - pick highest priority ready process
         int highest_priority = -1;
-        for (int i = 0; i < MAX_PROCESSES; i++) {
-            if (process_table[i].pid != -1 && 
-                process_table[i].state == PROC_READY &&
-                process_table[i].priority > highest_priority) {
-                highest_priority = process_table[i].priority;
-                selected = i;
+        for (pcb_t* proc = ready_queue.head; proc; proc = proc->queue_next) {
+            if (proc->priority > highest_priority) {
+                highest_priority = proc->priority;
+                selected = proc;
             }
         }
     }
     
+    if (selected) {
+        queue_remove(selected);
+    }
     return selected;
 }
 
+// log2 bucket of a latency: 0, 1, 2-3, 4-7, ...
+static int latency_bucket(unsigned int ticks) {
+    if (ticks == 0) return 0;
+    int bucket = 32 - __builtin_clz(ticks);
+    return bucket < SCHED_LAT_BUCKETS ? bucket : SCHED_LAT_BUCKETS - 1;
+}
+
+// Count a dispatch and the time the process sat on the ready queue
+static void account_dispatch(pcb_t* proc) {
+    sched_stats_t* stats = &proc->stats;
+    unsigned int latency = current_tick - stats->ready_since;
+    int bucket = latency_bucket(latency);
+    
+    proc->waiting_time += latency;
+    stats->dispatches++;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) stats->latency_max = latency;
+    if (stats->latency_hist[bucket] != 0xFFFF) stats->latency_hist[bucket]++;
+    
+    stat_dispatches++;
+    stat_latency[bucket]++;
+    stat_latency_total += latency;
+    if (latency > stat_latency_max) stat_latency_max = latency;
+    if (proc->pid != last_run_pid) stat_switches++;
+    last_run_pid = proc->pid;
+}
+
+// Timer callback: the running process used up its time slice
+static void quantum_expire(int pid) {
+    if (pid == current_pid) {
+        quantum_expired = 1;
+    }
+}
+
 // Scheduler tick - execute one time unit
 void scheduler_tick() {
     current_tick++;
     
+    // Sleeps, wait timeouts and the time slice
+    timer_tick();
+    
     // If current process is running, execute it
+    int ran = 0;
     if (current_pid != -1) {
         pcb_t* proc = scheduler_get_process(current_pid);
         if (proc && proc->state == PROC_RUNNING) {
             proc->remaining_time--;
-            proc->time_slice--;
+            proc->stats.cpu_ticks++;
+            ran = 1;
             
             // Process completed
             if (proc->remaining_time <= 0) {
                 proc->state = PROC_TERMINATED;
                 proc->turnaround_time = current_tick - proc->arrival_time;
-                print("Process ");
-                print_int(proc->pid);
-                print(" completed (turnaround=");
-                print_int(proc->turnaround_time);
-                print(")\n");
+                timer_cancel(&quantum_timer);
+                TRACE(TRACE_COMPLETE, proc->pid, proc->turnaround_time);
+                printk(LOG_INFO, "Process %d completed (turnaround=%d)", proc->pid, proc->turnaround_time);
                 current_pid = -1;
             }
             // Time slice expired (RR only)
-            else if (sched_mode == SCHED_RR && proc->time_slice <= 0) {
-                proc->state = PROC_READY;
-                proc->time_slice = time_quantum;
-                print("Process ");
-                print_int(proc->pid);
-                print(" preempted (quantum expired)\n");
+            else if (sched_mode == SCHED_RR && quantum_expired) {
+                proc->stats.involuntary++;
+                stat_involuntary++;
+                make_ready(proc);
+                TRACE(TRACE_PREEMPT, proc->pid, proc->remaining_time);
+                printk(LOG_INFO, "Process %d preempted (quantum expired)", proc->pid);
                 current_pid = -1;
             }
         }
     }
+    if (ran) {
+        stat_busy++;
+    } else {
+        stat_idle++;
+    }
     
     // Pick next process if needed
     if (current_pid == -1) {
-        int next = pick_next_process();
-        if (next != -1) {
-            current_pid = process_table[next].pid;
-            process_table[next].state = PROC_RUNNING;
-            process_table[next].time_slice = time_quantum;
-            print("Process ");
-            print_int(current_pid);
-            print(" started\n");
+        pcb_t* next = pick_next_process();
+        if (next) {
+            current_pid = next->pid;
+            next->state = PROC_RUNNING;
+            account_dispatch(next);
+            quantum_expired = 0;
+            timer_add(&quantum_timer, time_quantum, quantum_expire, current_pid);
+            TRACE(TRACE_DISPATCH, current_pid, next->remaining_time);
+            printk(LOG_INFO, "Process %d started", current_pid);
         }
     }
     
-    // Update waiting time for ready processes
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].pid != -1 && 
-            process_table[i].state == PROC_READY) {
-            process_table[i].waiting_time++;
-        }
-    }
+    // Background pager work (write-back)
+    memory_tick(current_tick);
 }
 
 // List all processes
@@ -204,32 +538,32 @@ void scheduler_list_processes() {
     print("  +-----+----------+------+-------+--------+------+\n");
     
     int count = 0;
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].pid != -1 && 
-            process_table[i].state != PROC_TERMINATED) {
+    for (int i = 0; i < process_slots; i++) {
+        if (PCB(i)->pid != -1 && 
+            PCB(i)->state != PROC_TERMINATED) {
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  | ");
             
             set_color(COLOR_YELLOW, COLOR_BLACK);
-            if (process_table[i].pid < 10) print(" ");
-            print_int(process_table[i].pid);
+            if (PCB(i)->pid < 10) print(" ");
+            print_int(PCB(i)->pid);
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  | ");
             
             // Color based on state
-            if (process_table[i].state == PROC_RUNNING) {
+            if (PCB(i)->state == PROC_RUNNING) {
                 set_color(COLOR_GREEN, COLOR_BLACK);
-            } else if (process_table[i].state == PROC_READY) {
+            } else if (PCB(i)->state == PROC_READY) {
                 set_color(COLOR_CYAN, COLOR_BLACK);
             } else {
                 set_color(COLOR_DARK_GREY, COLOR_BLACK);
             }
             
-            print(state_names[process_table[i].state]);
+            print(state_names[PCB(i)->state]);
             int len = 0;
-            const char* s = state_names[process_table[i].state];
+            const char* s = state_names[PCB(i)->state];
             while (s[len]) len++;
             for (int j = len; j < 8; j++) print(" ");
             
@@ -237,29 +571,31 @@ void scheduler_list_processes() {
             print(" |  ");
             
             set_color(COLOR_WHITE, COLOR_BLACK);
-            print_int(process_table[i].priority);
-            if (process_table[i].priority < 10) print(" ");
+            print_int(PCB(i)->priority);
+            if (PCB(i)->priority < 10) print(" ");
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  |   ");
             
             set_color(COLOR_WHITE, COLOR_BLACK);
-            if (process_table[i].burst_time < 10) print(" ");
-            print_int(process_table[i].burst_time);
+            if (PCB(i)->burst_time < 10) print(" ");
+            print_int(PCB(i)->burst_time);
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  |    ");
             
             set_color(COLOR_WHITE, COLOR_BLACK);
-            if (process_table[i].remaining_time < 10) print(" ");
-            print_int(process_table[i].remaining_time);
+            if (PCB(i)->remaining_time < 10) print(" ");
+            print_int(PCB(i)->remaining_time);
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  |  ");
             
             set_color(COLOR_WHITE, COLOR_BLACK);
-            if (process_table[i].waiting_time < 10) print(" ");
-            print_int(process_table[i].waiting_time);
+            int waited = PCB(i)->waiting_time;
+            if (PCB(i)->state == PROC_READY) waited += current_tick - PCB(i)->stats.ready_since;
+            if (waited < 10) print(" ");
+            print_int(waited);
             
             set_color(COLOR_DARK_GREY, COLOR_BLACK);
             print("  |\n");
@@ -286,3 +622,557 @@ void scheduler_list_processes() {
     set_color(COLOR_WHITE, COLOR_BLACK);
     print("\n");
 }
+
+static int count_digits(unsigned int value) {
+    int digits = 1;
+    for (; value >= 10; value /= 10) digits++;
+    return digits;
+}
+
+// Print a number right-aligned in a column
+static void print_padded(unsigned int value, int width) {
+    for (int i = count_digits(value); i < width; i++) print(" ");
+    print_int(value);
+}
+
+// Print a fixed-point value (thousandths) as "n.nnn"
+static void print_milli(unsigned int value) {
+    print_int(value / 1000);
+    print(".");
+    unsigned int frac = value % 1000;
+    if (frac < 100) print("0");
+    if (frac < 10) print("0");
+    print_int(frac);
+}
+
+// Latency histogram, one log2 bucket per line with a bar scaled to
+// the largest bucket. Empty buckets at either end are skipped.
+static void print_latency_histogram(const unsigned int* hist) {
+    int lo = 0, hi = SCHED_LAT_BUCKETS - 1;
+    while (lo <= hi && hist[lo] == 0) lo++;
+    while (hi >= lo && hist[hi] == 0) hi--;
+    if (lo > hi) {
+        print("    (no dispatches)\n");
+        return;
+    }
+    
+    unsigned int peak = 0;
+    for (int b = lo; b <= hi; b++) {
+        if (hist[b] > peak) peak = hist[b];
+    }
+    
+    for (int b = lo; b <= hi; b++) {
+        // Bucket b holds latencies in [2^(b-1), 2^b)
+        unsigned int from = b == 0 ? 0 : 1u << (b - 1);
+        unsigned int to = b == 0 ? 0 : (1u << b) - 1;
+        int len = 4 + count_digits(from);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("    ");
+        print_int(from);
+        if (b == SCHED_LAT_BUCKETS - 1) {
+            print("+");
+            len++;
+        } else if (to != from) {
+            print("-");
+            print_int(to);
+            len += 1 + count_digits(to);
+        }
+        for (; len < 16; len++) print(" ");
+        print_padded(hist[b], 7);
+        print(" ");
+        
+        int bar = (int)udiv64((unsigned long long)hist[b] * 40, peak);
+        if (bar == 0 && hist[b] != 0) bar = 1;
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        for (int i = 0; i < bar; i++) print_char('#');
+        print("\n");
+    }
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// CPU share of a process since it was created, in thousandths
+static unsigned int cpu_share(pcb_t* proc) {
+    int since = proc->arrival_time > stats_since ? proc->arrival_time : stats_since;
+    unsigned int age = current_tick - since;
+    if (age == 0) return 0;
+    return (unsigned int)udiv64((unsigned long long)proc->stats.cpu_ticks * 1000, age);
+}
+
+// Jain's fairness index of the CPU shares of runnable processes, in
+// thousandths: 1000 when all got the same share, 1000/n when one
+// process got all of it. Returns -1 with fewer than two to compare.
+static int fairness_index(int* runnable) {
+    unsigned long long sum = 0, sum_sq = 0;
+    int n = 0;
+    for (int i = 0; i < process_slots; i++) {
+        pcb_t* proc = PCB(i);
+        if (proc->pid == -1 || 
+            (proc->state != PROC_READY && proc->state != PROC_RUNNING) ||
+            proc->arrival_time == current_tick || stats_since == current_tick) {
+            continue;
+        }
+        unsigned int share = cpu_share(proc);
+        sum += share;
+        sum_sq += (unsigned long long)share * share;
+        n++;
+    }
+    *runnable = n;
+    if (n < 2 || sum_sq == 0) return -1;
+    
+    // J = sum^2 / (n * sum_sq). Shares are at most 1000, so the
+    // numerator fits 64 bits; shrink both until the divisor fits udiv64.
+    unsigned long long num = sum * sum * 1000;
+    unsigned long long den = sum_sq * n;
+    while (den >> 32) {
+        num >>= 1;
+        den >>= 1;
+    }
+    return (int)udiv64(num, (unsigned int)den);
+}
+
+// Mean ready-queue latency of a process, in ticks
+static unsigned int mean_latency(const sched_stats_t* stats) {
+    if (stats->dispatches == 0) return 0;
+    return stats->latency_total / stats->dispatches;
+}
+
+// One process: its counters and latency histogram
+static void show_process_stats(pcb_t* proc) {
+    const sched_stats_t* stats = &proc->stats;
+    unsigned int hist[SCHED_LAT_BUCKETS];
+    for (int b = 0; b < SCHED_LAT_BUCKETS; b++) hist[b] = stats->latency_hist[b];
+    
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  CPU ticks:     ");
+    print_int(stats->cpu_ticks);
+    print(" (");
+    print_milli(cpu_share(proc));
+    print(" of the CPU since tick ");
+    print_int(proc->arrival_time > stats_since ? proc->arrival_time : stats_since);
+    print(")\n");
+    print("  Dispatches:    ");
+    print_int(stats->dispatches);
+    print("\n  Switches out:  ");
+    print_int(stats->voluntary);
+    print(" voluntary, ");
+    print_int(stats->involuntary);
+    print(" preempted\n");
+    print("  Ready latency: mean ");
+    print_int(mean_latency(stats));
+    print(", max ");
+    print_int(stats->latency_max);
+    print(" ticks\n\n");
+    
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("  Latency (ticks) Count\n");
+    print_latency_histogram(hist);
+}
+
+// Show scheduling statistics: system-wide with a per-process table
+// (pid 0), or for one process
+void scheduler_show_stats(int pid) {
+    const char* state_names[] = {"NEW", "READY", "RUN", "WAIT", "DONE"};
+    pcb_t* proc = 0;
+    if (pid != 0) {
+        proc = scheduler_get_process(pid);
+        if (!proc) {
+            set_color(COLOR_RED, COLOR_BLACK);
+            print("Error: Process not found\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+            return;
+        }
+    }
+    
+    print("\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("              Scheduler Statistics\n");
+    set_color(COLOR_CYAN, COLOR_BLACK);
+    print("  ===============================================\n");
+    
+    if (proc) {
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print("  Process ");
+        print_int(pid);
+        print(" (");
+        print(state_names[proc->state]);
+        print(")\n");
+        show_process_stats(proc);
+        print("\n");
+        return;
+    }
+    
+    unsigned int ticks = stat_busy + stat_idle;
+    
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  Ticks:         ");
+    print_int(stat_busy);
+    print(" busy, ");
+    print_int(stat_idle);
+    print(" idle");
+    if (ticks != 0) {
+        print(" (");
+        print_int((unsigned int)udiv64((unsigned long long)stat_busy * 100, ticks));
+        print("% utilised)");
+    }
+    print("\n  Dispatches:    ");
+    print_int(stat_dispatches);
+    print(" (");
+    print_int(stat_switches);
+    print(" context switches)\n");
+    print("  Switches out:  ");
+    print_int(stat_voluntary);
+    print(" voluntary, ");
+    print_int(stat_involuntary);
+    print(" preempted\n");
+    
+    int runnable;
+    int fairness = fairness_index(&runnable);
+    print("  Fairness:      ");
+    if (fairness < 0) {
+        print("n/a");
+    } else {
+        print_milli(fairness);
+        print(" (Jain, ");
+        print_int(runnable);
+        print(" runnable)");
+    }
+    print("\n\n");
+    
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("  Latency (ticks) Count\n");
+    print_latency_histogram(stat_latency);
+    print("\n");
+    
+    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("    PID State   CPU  Share   Disp    Vol  Invol AvgLat MaxLat\n");
+    int count = 0;
+    for (int i = 0; i < process_slots; i++) {
+        proc = PCB(i);
+        if (proc->pid == -1) continue;
+        const sched_stats_t* stats = &proc->stats;
+        
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print_padded(proc->pid, 7);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        print(" ");
+        print(state_names[proc->state]);
+        int len = 0;
+        while (state_names[proc->state][len]) len++;
+        for (int j = len; j < 5; j++) print(" ");
+        print_padded(stats->cpu_ticks, 6);
+        print("  ");
+        print_milli(cpu_share(proc));
+        print_padded(stats->dispatches, 7);
+        print_padded(stats->voluntary, 7);
+        print_padded(stats->involuntary, 7);
+        print_padded(mean_latency(stats), 7);
+        print_padded(stats->latency_max, 7);
+        print("\n");
+        count++;
+    }
+    if (count == 0) {
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print("       No processes\n");
+    }
+    
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  Mean ready latency: ");
+    print_int(stat_dispatches ? (unsigned int)udiv64(stat_latency_total, stat_dispatches) : 0);
+    print(" ticks, max ");
+    print_int(stat_latency_max);
+    print("\n\n");
+}
+
+// Zero the statistics. Ready processes keep the tick they became
+// ready, so their next dispatch still measures the full wait.
+void scheduler_reset_stats() {
+    stat_dispatches = 0;
+    stat_switches = 0;
+    stat_voluntary = 0;
+    stat_involuntary = 0;
+    stat_busy = 0;
+    stat_idle = 0;
+    memset(stat_latency, 0, sizeof(stat_latency));
+    stat_latency_total = 0;
+    stat_latency_max = 0;
+    stats_since = current_tick;
+    
+    for (int i = 0; i < process_slots; i++) {
+        int ready_since = PCB(i)->stats.ready_since;
+        memset(&PCB(i)->stats, 0, sizeof(sched_stats_t));
+        PCB(i)->stats.ready_since = ready_since;
+    }
+}
+
+// A process in a checkpoint image: the PCB without its links, and
+// what it was waiting for
+typedef struct {
+    int pid;
+    int slot;                     // Page tables and mailboxes are kept by slot
+    int state;
+    int priority;
+    int burst_time;
+    int remaining_time;
+    int arrival_time;
+    int waiting_time;
+    int turnaround_time;
+    unsigned int timer_left;      // Ticks to its sleep or wait timeout (0: none)
+    int on_mailbox;               // Blocked receiving on its mailbox
+    sched_stats_t stats;
+} saved_pcb_t;
+
+// Ticks until a pending timer fires (0 if not pending)
+static unsigned int timer_left(const ktimer_t* timer) {
+    return timer_pending(timer) ? timer->expires - timer_now() : 0;
+}
+
+// Write the process table, ready queue order and scheduler state to a
+// checkpoint image. Returns the number of processes saved.
+int scheduler_save(ckpt_t* c) {
+    ckpt_section(c, CKPT_SEC_SCHED);
+    ckpt_put_int(c, next_pid);
+    ckpt_put_int(c, sched_mode);
+    ckpt_put_int(c, time_quantum);
+    ckpt_put_int(c, current_tick);
+    ckpt_put_int(c, current_pid);
+    ckpt_put_int(c, quantum_expired);
+    ckpt_put_int(c, timer_left(&quantum_timer));
+    
+    ckpt_put_int(c, stat_dispatches);
+    ckpt_put_int(c, stat_switches);
+    ckpt_put_int(c, stat_voluntary);
+    ckpt_put_int(c, stat_involuntary);
+    ckpt_put_int(c, stat_busy);
+    ckpt_put_int(c, stat_idle);
+    ckpt_put(c, stat_latency, sizeof(stat_latency));
+    ckpt_put(c, &stat_latency_total, sizeof(stat_latency_total));
+    ckpt_put_int(c, stat_latency_max);
+    ckpt_put_int(c, last_run_pid);
+    ckpt_put_int(c, stats_since);
+    
+    int count = 0;
+    for (int i = 0; i < process_slots; i++) {
+        if (PCB(i)->pid != -1) count++;
+    }
+    ckpt_put_int(c, count);
+    
+    for (int i = 0; i < process_slots; i++) {
+        pcb_t* proc = PCB(i);
+        if (proc->pid == -1) continue;
+        
+        saved_pcb_t rec;
+        rec.pid = proc->pid;
+        rec.slot = i;
+        rec.state = proc->state;
+        rec.priority = proc->priority;
+        rec.burst_time = proc->burst_time;
+        rec.remaining_time = proc->remaining_time;
+        rec.arrival_time = proc->arrival_time;
+        rec.waiting_time = proc->waiting_time;
+        rec.turnaround_time = proc->turnaround_time;
+        rec.timer_left = timer_left(&proc->timer);
+        rec.on_mailbox = proc->state == PROC_WAITING && proc->queue != 0;
+        rec.stats = proc->stats;
+        ckpt_put(c, &rec, sizeof(rec));
+    }
+    
+    // Ready queue, front first
+    int ready = 0;
+    for (pcb_t* proc = ready_queue.head; proc; proc = proc->queue_next) ready++;
+    ckpt_put_int(c, ready);
+    for (pcb_t* proc = ready_queue.head; proc; proc = proc->queue_next) {
+        ckpt_put_int(c, proc->pid);
+    }
+    return count;
+}
+
+// Slot of each PID in the image being checked (-1: not in it), from the
+// kernel heap on first restore, and slots seen and READY by the check
+static int* image_slot = 0;
+static unsigned int slot_used[PID_MAX / 32];
+static unsigned int slot_ready[PID_MAX / 32];
+
+#define BIT_TEST(map, i) ((map)[(i) / 32] & (1u << ((i) % 32)))
+#define BIT_SET(map, i) ((map)[(i) / 32] |= 1u << ((i) % 32))
+#define BIT_CLEAR(map, i) ((map)[(i) / 32] &= ~(1u << ((i) % 32)))
+
+// Check a checkpoint's scheduler section without changing anything:
+// PIDs and slots unique and in range, the ready queue made of exactly
+// the READY processes, the current process RUNNING. Records each PID's
+// slot for ipc_check and memory_check (scheduler_image_slot).
+void scheduler_check(ckpt_t* c) {
+    ckpt_expect(c, CKPT_SEC_SCHED);
+    if (!image_slot) {
+        image_slot = (int*)kalloc(PID_MAX * sizeof(int));
+        if (!image_slot) c->error = 1;
+    }
+    if (c->error) return;
+    memset(image_slot, 0xFF, PID_MAX * sizeof(int));
+    memset(slot_used, 0, sizeof(slot_used));
+    memset(slot_ready, 0, sizeof(slot_ready));
+    
+    int saved_next_pid = ckpt_get_int(c);
+    int mode = ckpt_get_int(c);
+    int quantum = ckpt_get_int(c);
+    ckpt_skip(c, sizeof(int));                   // current_tick
+    int running_pid = ckpt_get_int(c);
+    ckpt_skip(c, 2 * sizeof(int));               // quantum_expired, timer_left
+    ckpt_skip(c, 6 * sizeof(int) + sizeof(stat_latency) + sizeof(stat_latency_total) +
+                 3 * sizeof(int));               // System-wide statistics
+    if (saved_next_pid <= 0 || saved_next_pid >= PID_MAX ||
+        mode < SCHED_FCFS || mode > SCHED_PRIORITY || quantum <= 0) {
+        c->error = 1;
+    }
+    
+    int count = ckpt_get_int(c);
+    int ready = 0;
+    int running_found = running_pid == -1;
+    for (int n = 0; n < count && !c->error; n++) {
+        saved_pcb_t rec;
+        ckpt_get(c, &rec, sizeof(rec));
+        if (rec.pid <= 0 || rec.pid >= PID_MAX || image_slot[rec.pid] != -1 ||
+            rec.slot < 0 || rec.slot >= PID_MAX || BIT_TEST(slot_used, rec.slot) ||
+            rec.state < PROC_NEW || rec.state > PROC_TERMINATED) {
+            c->error = 1;
+            break;
+        }
+        image_slot[rec.pid] = rec.slot;
+        BIT_SET(slot_used, rec.slot);
+        if (rec.state == PROC_READY) {
+            BIT_SET(slot_ready, rec.slot);
+            ready++;
+        }
+        if (rec.pid == running_pid) {
+            running_found = rec.state == PROC_RUNNING;
+        }
+    }
+    if (!running_found || ckpt_get_int(c) != ready) {
+        c->error = 1;
+    }
+    
+    // Each READY process on the queue once
+    for (int n = 0; n < ready && !c->error; n++) {
+        int pid = ckpt_get_int(c);
+        int slot = (pid > 0 && pid < PID_MAX) ? image_slot[pid] : -1;
+        if (slot == -1 || !BIT_TEST(slot_ready, slot)) {
+            c->error = 1;
+            break;
+        }
+        BIT_CLEAR(slot_ready, slot);
+    }
+}
+
+// Slot a PID has in the image scheduler_check last passed, or -1
+int scheduler_image_slot(int pid) {
+    if (!image_slot || pid <= 0 || pid >= PID_MAX) return -1;
+    return image_slot[pid];
+}
+
+// Claim a given slot for a restored process, growing the table up to
+// it. Returns 0 if it is out of range, taken, or the heap is exhausted.
+static int take_slot(int i) {
+    if (i < 0 || i >= PID_MAX) return 0;
+    while (capacity <= i) {
+        if (!grow_table()) return 0;
+    }
+    for (; process_slots <= i; process_slots++) {
+        PCB(process_slots)->pid = -1;
+    }
+    return PCB(i)->pid == -1;
+}
+
+// Replace every process with the ones in a checkpoint image. Killing
+// the old ones first also empties their page tables and mailboxes,
+// which the memory and IPC sections then refill. Each process gets
+// back the slot it was saved from, since those are keyed by slot.
+// Returns the number of processes restored, or -1 (c->error is set).
+int scheduler_load(ckpt_t* c) {
+    ckpt_expect(c, CKPT_SEC_SCHED);
+    if (c->error) return -1;
+    
+    scheduler_kill_all();
+    timer_cancel(&quantum_timer);
+    wait_queue_init(&ready_queue);
+    
+    next_pid = ckpt_get_int(c);
+    sched_mode = (sched_mode_t)ckpt_get_int(c);
+    time_quantum = ckpt_get_int(c);
+    current_tick = ckpt_get_int(c);
+    current_pid = ckpt_get_int(c);
+    quantum_expired = ckpt_get_int(c);
+    unsigned int quantum_left = ckpt_get_int(c);
+    if (!timer_set_now(current_tick)) c->error = 1;
+    
+    stat_dispatches = ckpt_get_int(c);
+    stat_switches = ckpt_get_int(c);
+    stat_voluntary = ckpt_get_int(c);
+    stat_involuntary = ckpt_get_int(c);
+    stat_busy = ckpt_get_int(c);
+    stat_idle = ckpt_get_int(c);
+    ckpt_get(c, stat_latency, sizeof(stat_latency));
+    ckpt_get(c, &stat_latency_total, sizeof(stat_latency_total));
+    stat_latency_max = ckpt_get_int(c);
+    last_run_pid = ckpt_get_int(c);
+    stats_since = ckpt_get_int(c);
+    
+    int count = ckpt_get_int(c);
+    for (int n = 0; n < count && !c->error; n++) {
+        saved_pcb_t rec;
+        ckpt_get(c, &rec, sizeof(rec));
+        int i = rec.slot;
+        if (c->error || rec.pid <= 0 || rec.pid >= PID_MAX || pid_slot(rec.pid) != -1 ||
+            !take_slot(i) || !pid_set(rec.pid, i)) {
+            c->error = 1;
+            break;
+        }
+        
+        pcb_t* proc = PCB(i);
+        proc->pid = rec.pid;
+        proc->state = (proc_state_t)rec.state;
+        proc->priority = rec.priority;
+        proc->burst_time = rec.burst_time;
+        proc->remaining_time = rec.remaining_time;
+        proc->arrival_time = rec.arrival_time;
+        proc->waiting_time = rec.waiting_time;
+        proc->turnaround_time = rec.turnaround_time;
+        proc->stats = rec.stats;
+        reset_links(proc);
+        
+        if (rec.on_mailbox) {
+            queue_push(ipc_wait_queue(proc->pid), proc);
+        }
+        if (rec.timer_left) {
+            timer_add(&proc->timer, rec.timer_left, wait_expired, proc->pid);
+        }
+    }
+    
+    // Slots left empty go back on the free stack, lowest on top
+    free_top = -1;
+    for (int i = process_slots - 1; i >= 0; i--) {
+        if (PCB(i)->pid != -1) continue;
+        PCB(i)->next_free = free_top;
+        free_top = i;
+    }
+    
+    int ready = ckpt_get_int(c);
+    for (int n = 0; n < ready && !c->error; n++) {
+        pcb_t* proc = scheduler_get_process(ckpt_get_int(c));
+        if (!proc || proc->state != PROC_READY || proc->queue) {
+            c->error = 1;
+            break;
+        }
+        queue_push(&ready_queue, proc);
+    }
+    
+    pcb_t* running = current_pid == -1 ? 0 : scheduler_get_process(current_pid);
+    if (current_pid != -1 && (!running || running->state != PROC_RUNNING)) {
+        c->error = 1;
+        current_pid = -1;
+    }
+    if (!c->error && current_pid != -1 && quantum_left) {
+        timer_add(&quantum_timer, quantum_left, quantum_expire, current_pid);
+    }
+    return c->error ? -1 : count;
+}
@@ -2,7 +2,12 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
-#define MAX_PROCESSES 64
+#include "timer.h"
+
+#define PID_MAX 65536                  // PIDs are 1..PID_MAX-1, reused after wrapping
+#define PROC_CHUNK 64                  // Slots added each time the process table grows
+#define PID_LEAF 1024                  // PIDs per leaf of the PID index
+#define SCHED_LAT_BUCKETS 16           // log2 buckets of ready-to-dispatch latency
 
 // Process states
 typedef enum {
@@ -20,17 +25,44 @@ typedef enum {
     SCHED_PRIORITY = 2
 } sched_mode_t;
 
-// Process Control Block
+struct pcb;
+struct ckpt;
+
+// FIFO of processes: the ready queue, or processes blocked on an event
+typedef struct wait_queue {
+    struct pcb* head;
+    struct pcb* tail;
+} wait_queue_t;
+
+// Scheduling statistics of a process (schedstat). Kept up to date at
+// enqueue, dispatch and each tick: a few increments each.
 typedef struct {
+    int ready_since;              // Tick it last joined the ready queue
+    unsigned int cpu_ticks;       // Ticks spent running
+    unsigned int dispatches;
+    unsigned int voluntary;       // Left the CPU to sleep or wait
+    unsigned int involuntary;     // Preempted when its time slice ran out
+    unsigned int latency_total;   // Ready-to-dispatch ticks, summed
+    unsigned int latency_max;
+    unsigned short latency_hist[SCHED_LAT_BUCKETS]; // Saturating counts
+} sched_stats_t;
+
+// Process Control Block
+typedef struct pcb {
     int pid;
     proc_state_t state;
     int priority;
     int burst_time;
     int remaining_time;
     int arrival_time;
-    int waiting_time;
+    int waiting_time;   // Ticks spent ready, counted when it leaves the queue
     int turnaround_time;
-    int time_slice;
+    int next_free;      // Free-slot stack link while the slot is unused
+    wait_queue_t* queue;          // Queue the process is on (0 if none)
+    struct pcb* queue_next;
+    struct pcb* queue_prev;
+    ktimer_t timer;               // Sleep or wait timeout
+    sched_stats_t stats;
 } pcb_t;
 
 // Scheduler functions
@@ -39,8 +71,22 @@ void scheduler_set_mode(sched_mode_t mode);
 void scheduler_set_quantum(int quantum);
 int scheduler_create_process(int burst, int priority);
 int scheduler_kill_process(int pid);
+void scheduler_kill_all();
+int scheduler_fork_process(int pid);
+void wait_queue_init(wait_queue_t* queue);
+int scheduler_sleep(int pid, int ticks);
+int scheduler_wait(wait_queue_t* queue, int pid, int timeout);
+int scheduler_wake(int pid);
+int scheduler_wake_one(wait_queue_t* queue);
 void scheduler_tick();
 void scheduler_list_processes();
+void scheduler_show_stats(int pid);
+void scheduler_reset_stats();
+int scheduler_save(struct ckpt* c);
+int scheduler_load(struct ckpt* c);
+void scheduler_check(struct ckpt* c);
+int scheduler_image_slot(int pid);
 pcb_t* scheduler_get_process(int pid);
+int scheduler_slot(int pid);
 
 #endif
@@ -3,38 +3,44 @@
 #include "shell.h"
 #include "scheduler.h"
 #include "memory.h"
+#include "module.h"
+#include "ramfs.h"
+#include "bcache.h"
+#include "ipc.h"
+#include "syscall.h"
+#include "elf.h"
+#include "trace.h"
+#include "profile.h"
+#include "boottime.h"
+#include "klib.h"
+#include "bench.h"
+#include "log.h"
+#include "checkpoint.h"
 
-// String functions
-int strlen(const char* str) {
-    int len = 0;
-    while (str[len]) len++;
-    return len;
-}
+// Command registry and its perfect hash
+static const shell_command_t* commands[SHELL_MAX_COMMANDS];
+static int command_count = 0;
+static const shell_command_t* command_slots[SHELL_HASH_SLOTS];
+static unsigned char bucket_seed[SHELL_HASH_BUCKETS];
 
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char*)s1 - *(unsigned char*)s2;
-}
+// Script state
+static shell_var_t vars[SHELL_MAX_VARS];
+static int source_depth = 0;
 
-int atoi(const char* str) {
-    int result = 0;
-    int sign = 1;
-    
-    if (*str == '-') {
-        sign = -1;
-        str++;
-    }
-    
-    while (*str >= '0' && *str <= '9') {
-        result = result * 10 + (*str - '0');
-        str++;
-    }
-    
-    return sign * result;
-}
+static void shell_dispatch(char** args, int argc);
+
+// Help section titles and colors, indexed by cmd_group_t
+static const struct {
+    const char* title;
+    unsigned char color;
+} command_groups[CMD_GROUP_COUNT] = {
+    {"SYSTEM COMMANDS",    COLOR_LIGHT_GREEN},
+    {"PROCESS COMMANDS",   COLOR_LIGHT_CYAN},
+    {"SCHEDULER COMMANDS", COLOR_LIGHT_MAGENTA},
+    {"MEMORY COMMANDS",    COLOR_LIGHT_BLUE},
+    {"SCRIPT COMMANDS",    COLOR_YELLOW},
+    {"FILE COMMANDS",      COLOR_LIGHT_RED},
+};
 
 // Parse command into arguments
 void parse_command(char* input, char** args, int* argc) {
@@ -56,8 +62,11 @@ void parse_command(char* input, char** args, int* argc) {
     args[*argc] = 0;
 }
 
-// Command: help
-void cmd_help() {
+// Command: help (generated from the command table)
+static void cmd_help(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    
     print("\n");
     set_color(COLOR_CYAN, COLOR_BLACK);
     print("  ===============================================\n");
@@ -66,34 +75,30 @@ void cmd_help() {
     set_color(COLOR_CYAN, COLOR_BLACK);
     print("  ===============================================\n\n");
     
-    set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
-    print("  >> SYSTEM COMMANDS:\n");
-    set_color(COLOR_WHITE, COLOR_BLACK);
-    print("     help              - Show this help message\n");
-    print("     clear             - Clear screen\n");
-    print("     echo <text>       - Print text\n\n");
-    
-    set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
-    print("  >> PROCESS COMMANDS:\n");
-    set_color(COLOR_WHITE, COLOR_BLACK);
-    print("     ps                - List all processes\n");
-    print("     run <burst> <prio>- Create new process\n");
-    print("     kill <pid>        - Terminate process\n\n");
-    
-    set_color(COLOR_LIGHT_MAGENTA, COLOR_BLACK);
-    print("  >> SCHEDULER COMMANDS:\n");
-    set_color(COLOR_WHITE, COLOR_BLACK);
-    print("     scheduler mode <fcfs|rr|priority>\n");
-    print("     scheduler quantum <n>  - Set time quantum\n");
-    print("     scheduler tick    - Simulate clock tick\n\n");
-    
-    set_color(COLOR_LIGHT_BLUE, COLOR_BLACK);
-    print("  >> MEMORY COMMANDS:\n");
-    set_color(COLOR_WHITE, COLOR_BLACK);
-    print("     meminfo           - Show memory stats\n");
-    print("     frames            - Show frame table\n");
-    print("     allocpages <pid> <n>   - Allocate pages\n");
-    print("     access <pid> <page>    - Access a page\n\n");
+    for (int group = 0; group < CMD_GROUP_COUNT; group++) {
+        set_color(command_groups[group].color, COLOR_BLACK);
+        print("  >> ");
+        print(command_groups[group].title);
+        print(":\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        
+        for (int i = 0; i < command_count; i++) {
+            if ((int)commands[i]->group != group) continue;
+            
+            print("     ");
+            print(commands[i]->usage);
+            int len = strlen(commands[i]->usage);
+            if (len >= HELP_USAGE_WIDTH) {
+                print("\n     ");
+                len = 0;
+            }
+            for (int j = len; j < HELP_USAGE_WIDTH; j++) print(" ");
+            print("- ");
+            print(commands[i]->help);
+            print("\n");
+        }
+        print("\n");
+    }
     
     set_color(COLOR_YELLOW, COLOR_BLACK);
     print("  TIP: ");
@@ -102,12 +107,14 @@ void cmd_help() {
 }
 
 // Command: clear
-void cmd_clear() {
+static void cmd_clear(char** args, int argc) {
+    (void)args;
+    (void)argc;
     clear_screen();
 }
 
 // Command: echo
-void cmd_echo(char** args, int argc) {
+static void cmd_echo(char** args, int argc) {
     for (int i = 1; i < argc; i++) {
         print(args[i]);
         if (i < argc - 1) print(" ");
@@ -115,17 +122,122 @@ void cmd_echo(char** args, int argc) {
     print("\n");
 }
 
+// Command: trace
+static void cmd_trace(char** args, int argc) {
+    if (argc < 2) {
+        trace_show_status();
+    } else if (strcmp(args[1], "start") == 0) {
+        trace_start();
+        print("Tracing started (");
+        print_int(TRACE_RECORDS);
+        print(" records per CPU)\n");
+    } else if (strcmp(args[1], "stop") == 0) {
+        trace_stop();
+        trace_show_status();
+    } else if (strcmp(args[1], "dump") == 0) {
+        if (argc < 3) {
+            trace_dump(TRACE_DUMP_TEXT);
+        } else if (strcmp(args[2], "serial") == 0) {
+            trace_dump(TRACE_DUMP_SERIAL);
+            print("Trace written to COM1\n");
+        } else if (strcmp(args[2], "raw") == 0) {
+            trace_dump(TRACE_DUMP_RAW);
+            print("Raw trace written to COM1\n");
+        } else {
+            print("Usage: trace dump [serial|raw]\n");
+        }
+    } else {
+        print("Usage: trace [start|stop|dump [serial|raw]]\n");
+    }
+}
+
+// Command: dmesg
+static void cmd_dmesg(char** args, int argc) {
+    if (argc < 2) {
+        log_dump();
+    } else if (strcmp(args[1], "clear") == 0) {
+        log_clear();
+        print("Kernel log cleared\n");
+    } else if (strcmp(args[1], "level") == 0) {
+        if (argc > 2 && !log_set_level(args[2])) {
+            set_color(COLOR_RED, COLOR_BLACK);
+            print("Error: Unknown log level (err, warn, info or debug)\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+            return;
+        }
+        print("Console log level: ");
+        print(log_level_name(log_level()));
+        print("\n");
+    } else {
+        print("Usage: dmesg [clear|level [err|warn|info|debug]]\n");
+    }
+}
+
+// Command: checkpoint
+static void cmd_checkpoint(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    checkpoint_save();
+}
+
+// Command: restore
+static void cmd_restore(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    checkpoint_restore();
+}
+
+// Command: boottime
+static void cmd_boottime(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    boot_show_times();
+}
+
+// Command: klibbench
+static void cmd_klibbench(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    klib_benchmark();
+}
+
+// Command: bench
+static void cmd_bench(char** args, int argc) {
+    if (argc > 1 && strcmp(args[1], "list") == 0) {
+        bench_list();
+        return;
+    }
+    bench_run(argc > 1 ? args[1] : 0);
+}
+
+// Command: profile
+static void cmd_profile(char** args, int argc) {
+    (void)argc;
+    if (strcmp(args[1], "start") == 0) {
+        profile_start();
+        print("Profiling at ");
+        print_int(PROFILE_HZ);
+        print(" Hz\n");
+    } else if (strcmp(args[1], "stop") == 0) {
+        profile_stop();
+        print("Profiling stopped\n");
+    } else if (strcmp(args[1], "report") == 0) {
+        profile_report();
+    } else {
+        print("Usage: profile <start|stop|report>\n");
+    }
+}
+
 // Command: ps (implemented in scheduler.c)
-void cmd_ps() {
+static void cmd_ps(char** args, int argc) {
+    (void)args;
+    (void)argc;
     scheduler_list_processes();
 }
 
 // Command: run
-void cmd_run(char** args, int argc) {
-    if (argc < 3) {
-        print("Usage: run <burst_time> <priority>\n");
-        return;
-    }
+static void cmd_run(char** args, int argc) {
+    (void)argc;
     
     int burst = atoi(args[1]);
     int priority = atoi(args[2]);
@@ -155,12 +267,34 @@ void cmd_run(char** args, int argc) {
     }
 }
 
-// Command: kill
-void cmd_kill(char** args, int argc) {
-    if (argc < 2) {
-        print("Usage: kill <pid>\n");
-        return;
+// Command: sleep
+static void cmd_sleep(char** args, int argc) {
+    (void)argc;
+    
+    int pid = atoi(args[1]);
+    int ticks = atoi(args[2]);
+    if (ticks <= 0) {
+        print("Usage: sleep <pid> <ticks>\n");
+    } else if (scheduler_sleep(pid, ticks)) {
+        print("Process ");
+        print_int(pid);
+        print(" sleeping for ");
+        print_int(ticks);
+        print(" ticks\n");
+    } else if (scheduler_get_process(pid)) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process is not ready or running\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
     }
+}
+
+// Command: kill
+static void cmd_kill(char** args, int argc) {
+    (void)argc;
     
     int pid = atoi(args[1]);
     if (scheduler_kill_process(pid)) {
@@ -176,13 +310,186 @@ void cmd_kill(char** args, int argc) {
     }
 }
 
-// Command: scheduler
-void cmd_scheduler(char** args, int argc) {
-    if (argc < 2) {
-        print("Usage: scheduler <mode|quantum|tick>\n");
+// Command: fork
+static void cmd_fork(char** args, int argc) {
+    (void)argc;
+    
+    int pid = atoi(args[1]);
+    int child = scheduler_fork_process(pid);
+    if (child < 0) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found or maximum processes reached\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return;
+    }
+    
+    int shared = memory_fork(pid, child);
+    if (shared < 0) {
+        scheduler_kill_process(child);
+        return;
+    }
+    
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("Forked PID=");
+    print_int(pid);
+    print(" -> child PID=");
+    print_int(child);
+    print(" (");
+    print_int(shared);
+    print(" frames shared copy-on-write)\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: send
+static void cmd_send(char** args, int argc) {
+    int from = atoi(args[1]);
+    int to = atoi(args[2]);
+    
+    // Message text: the remaining words joined by spaces
+    char text[IPC_MSG_MAX];
+    int len = 0;
+    for (int i = 3; i < argc; i++) {
+        for (int j = 0; args[i][j] && len < IPC_MSG_MAX; j++) {
+            text[len++] = args[i][j];
+        }
+        if (i < argc - 1 && len < IPC_MSG_MAX) text[len++] = ' ';
+    }
+    
+    if (from != 0 && !scheduler_get_process(from)) {
+        print("Sender PID ");
+        print_int(from);
+        print(" not found\n");
+        return;
+    }
+    
+    int result = ipc_send(from, to, text, len);
+    if (result == IPC_NO_PROCESS) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found\n");
+    } else if (result == IPC_FULL) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Mailbox of PID ");
+        print_int(to);
+        print(" is full\n");
+    } else {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Sent ");
+        print_int(len);
+        print(" bytes to PID ");
+        print_int(to);
+        if (result == IPC_WOKE) print(" (woke it)");
+        print("\n");
+    }
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: recv
+static void cmd_recv(char** args, int argc) {
+    (void)argc;
+    int pid = atoi(args[1]);
+    int timeout = argc > 2 ? atoi(args[2]) : IPC_FOREVER;
+    ipc_msg_t msg;
+    
+    if (timeout <= 0) timeout = IPC_FOREVER;
+    int result = ipc_recv(pid, &msg, timeout);
+    if (result == IPC_NO_PROCESS) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else if (result == IPC_BLOCKED) {
+        print("No messages: PID ");
+        print_int(pid);
+        print(" is waiting\n");
+    } else if (result == IPC_EMPTY) {
+        print("No messages (PID ");
+        print_int(pid);
+        print(" is not ready or running)\n");
+    } else {
+        set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+        print("PID ");
+        print_int(pid);
+        print(" <- PID ");
+        print_int(msg.sender);
+        print(": ");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        for (int i = 0; i < msg.length; i++) print_char(msg.data[i]);
+        print(" (");
+        print_int(ipc_pending(pid));
+        print(" more queued)\n");
+    }
+}
+
+// Command: ipcbench
+static void cmd_ipcbench(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    ipc_benchmark();
+}
+
+// Command: user
+static void cmd_user(char** args, int argc) {
+    int pid = (argc > 1) ? atoi(args[1]) : 0;
+    if (pid != 0 && !scheduler_get_process(pid)) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
         return;
     }
     
+    int code = user_run(pid);
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("User task exited with code ");
+    print_int(code);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: exec
+static void cmd_exec(char** args, int argc) {
+    (void)argc;
+    int pid = elf_exec(args[1]);
+    if (pid == -1) return;
+    
+    const elf_image_t* image = elf_image(pid);
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("Loaded ");
+    print(image->name);
+    print(" as PID ");
+    print_int(pid);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  File size:     ");
+    print_int(image->file_size);
+    print(" bytes\n");
+    print("  Image pages:   ");
+    print_int(image->image_pages);
+    print(" (");
+    print_int(image->file_pages);
+    print(" file-backed)\n");
+    print("  Pages touched: ");
+    print_int(image->startup_pages);
+    print(" (entry + stack), rest load on demand\n");
+    
+    int code;
+    if (!elf_run(pid, &code)) return;
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("PID ");
+    print_int(pid);
+    print(" exited with code ");
+    print_int(code);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: syscallbench
+static void cmd_syscallbench(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    syscall_benchmark();
+}
+
+// Command: scheduler
+static void cmd_scheduler(char** args, int argc) {
     if (strcmp(args[1], "mode") == 0) {
         if (argc < 3) {
             print("Usage: scheduler mode <fcfs|rr|priority>\n");
@@ -234,22 +541,44 @@ void cmd_scheduler(char** args, int argc) {
     }
 }
 
+// Command: schedstat
+static void cmd_schedstat(char** args, int argc) {
+    if (argc < 2) {
+        scheduler_show_stats(0);
+    } else if (strcmp(args[1], "reset") == 0) {
+        scheduler_reset_stats();
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Scheduler statistics reset\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        int pid = atoi(args[1]);
+        if (pid <= 0) {
+            set_color(COLOR_RED, COLOR_BLACK);
+            print("Error: Invalid PID\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+            return;
+        }
+        scheduler_show_stats(pid);
+    }
+}
+
 // Command: meminfo
-void cmd_meminfo() {
+static void cmd_meminfo(char** args, int argc) {
+    (void)args;
+    (void)argc;
     memory_show_info();
 }
 
 // Command: frames
-void cmd_frames() {
+static void cmd_frames(char** args, int argc) {
+    (void)args;
+    (void)argc;
     memory_show_frames();
 }
 
 // Command: allocpages
-void cmd_allocpages(char** args, int argc) {
-    if (argc < 3) {
-        print("Usage: allocpages <pid> <count>\n");
-        return;
-    }
+static void cmd_allocpages(char** args, int argc) {
+    (void)argc;
     
     int pid = atoi(args[1]);
     int count = atoi(args[2]);
@@ -270,58 +599,614 @@ void cmd_allocpages(char** args, int argc) {
 }
 
 // Command: access
-void cmd_access(char** args, int argc) {
-    if (argc < 3) {
-        print("Usage: access <pid> <page>\n");
-        return;
+static void cmd_access(char** args, int argc) {
+    int pid = atoi(args[1]);
+    int page = atoi(args[2]);
+    int write = (argc > 3 && strcmp(args[3], "w") == 0);
+    
+    memory_access_page(pid, page, write);
+}
+
+// Command: sync
+static void cmd_sync(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    int written = memory_writeback();
+    set_color(COLOR_GREEN, COLOR_BLACK);
+    print("Wrote back ");
+    print_int(written);
+    print(" dirty pages");
+    
+    if (ata_drive()->present) {
+        int sectors = bcache_sync();
+        print(", ");
+        print_int(sectors < 0 ? 0 : sectors);
+        print(" dirty sectors");
     }
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: shmget
+static void cmd_shmget(char** args, int argc) {
+    (void)argc;
+    
+    int key = atoi(args[1]);
+    int pages = atoi(args[2]);
+    int id = memory_shm_get(key, pages);
+    
+    if (id >= 0) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Shared memory key=");
+        print_int(key);
+        print(" -> segment ");
+        print_int(id);
+        print("\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Could not create segment (max ");
+        print_int(SHM_MAX_PAGES);
+        print(" pages, ");
+        print_int(SHM_SEGMENTS);
+        print(" segments)\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    }
+}
+
+// Command: shmattach
+static void cmd_shmattach(char** args, int argc) {
+    (void)argc;
     
     int pid = atoi(args[1]);
-    int page = atoi(args[2]);
+    int key = atoi(args[2]);
+    int page = atoi(args[3]);
+    int pages = memory_shm_attach(pid, key, page);
     
-    memory_access_page(pid, page);
+    if (pages > 0) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Attached key=");
+        print_int(key);
+        print(" to PID ");
+        print_int(pid);
+        print(" pages ");
+        print_int(page);
+        print("-");
+        print_int(page + pages - 1);
+        print("\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Could not attach segment\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    }
 }
 
-// Execute command
-void shell_execute(char* input) {
-    char* args[MAX_ARGS];
-    int argc;
+// Command: ksm
+static void cmd_ksm(char** args, int argc) {
+    (void)argc;
     
-    parse_command(input, args, &argc);
+    if (strcmp(args[1], "on") == 0) {
+        memory_ksm_enable(1);
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Same-page merging enabled\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else if (strcmp(args[1], "off") == 0) {
+        memory_ksm_enable(0);
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print("Same-page merging disabled\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else if (strcmp(args[1], "scan") == 0) {
+        int merged = memory_ksm_scan();
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Merge pass freed ");
+        print_int(merged);
+        print(" frames\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    } else {
+        print("Unknown ksm command\n");
+    }
+}
+
+// Command: hugepage
+static void cmd_hugepage(char** args, int argc) {
+    int pid = atoi(args[1]);
+    int enabled = argc < 3 || strcmp(args[2], "off") != 0;
     
-    if (argc == 0) return;
+    if (argc >= 3 && enabled && strcmp(args[2], "on") != 0) {
+        print("Usage: hugepage <pid> [on|off]\n");
+        return;
+    }
+    if (!memory_huge_enable(pid, enabled)) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Process not found\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return;
+    }
     
-    // Execute command
-    if (strcmp(args[0], "help") == 0) {
-        cmd_help();
-    } else if (strcmp(args[0], "clear") == 0) {
-        cmd_clear();
-    } else if (strcmp(args[0], "echo") == 0) {
-        cmd_echo(args, argc);
-    } else if (strcmp(args[0], "ps") == 0) {
-        cmd_ps();
-    } else if (strcmp(args[0], "run") == 0) {
-        cmd_run(args, argc);
-    } else if (strcmp(args[0], "kill") == 0) {
-        cmd_kill(args, argc);
-    } else if (strcmp(args[0], "scheduler") == 0) {
-        cmd_scheduler(args, argc);
-    } else if (strcmp(args[0], "meminfo") == 0) {
-        cmd_meminfo();
-    } else if (strcmp(args[0], "frames") == 0) {
-        cmd_frames();
-    } else if (strcmp(args[0], "allocpages") == 0) {
-        cmd_allocpages(args, argc);
-    } else if (strcmp(args[0], "access") == 0) {
-        cmd_access(args, argc);
+    set_color(enabled ? COLOR_GREEN : COLOR_YELLOW, COLOR_BLACK);
+    print("Huge pages ");
+    print(enabled ? "enabled" : "disabled");
+    print(" for PID ");
+    print_int(pid);
+    print("\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+}
+
+// Command: memgroup
+static void cmd_memgroup(char** args, int argc) {
+    if (argc < 2) {
+        memory_show_groups();
+    } else if (strcmp(args[1], "set") == 0 && argc >= 5) {
+        int group = atoi(args[2]);
+        if (memory_group_set(group, atoi(args[3]), atoi(args[4]))) {
+            set_color(COLOR_GREEN, COLOR_BLACK);
+            print("Group ");
+            print_int(group);
+            print(": min=");
+            print(args[3]);
+            print(" max=");
+            print(args[4]);
+            print(" frames\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        } else {
+            set_color(COLOR_RED, COLOR_BLACK);
+            print("Error: Need group < ");
+            print_int(MEMGROUP_COUNT);
+            print(", min <= max, 1 <= max <= ");
+            print_int(FRAME_COUNT);
+            print(" and all mins <= ");
+            print_int(FRAME_COUNT);
+            print("\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
+    } else if (strcmp(args[1], "assign") == 0 && argc >= 4) {
+        int pid = atoi(args[2]);
+        int group = atoi(args[3]);
+        if (memory_group_assign(pid, group)) {
+            set_color(COLOR_GREEN, COLOR_BLACK);
+            print("PID ");
+            print_int(pid);
+            print(" moved to memory group ");
+            print_int(group);
+            print("\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        } else {
+            set_color(COLOR_RED, COLOR_BLACK);
+            print("Error: Process or group not found\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
     } else {
+        print("Usage: memgroup [set <group> <min> <max> | assign <pid> <group>]\n");
+    }
+}
+
+// Copy a string, truncating to max - 1 characters
+static void copy_string(char* dst, const char* src, int max) {
+    int i = 0;
+    while (src[i] && i < max - 1) {
+        dst[i] = src[i];
+        i++;
+    }
+    dst[i] = '\0';
+}
+
+// Format a non-negative integer
+static void int_to_string(int num, char* buf) {
+    char tmp[12];
+    int i = 0;
+    
+    do {
+        tmp[i++] = '0' + (num % 10);
+        num /= 10;
+    } while (num > 0);
+    
+    int j = 0;
+    while (i > 0) buf[j++] = tmp[--i];
+    buf[j] = '\0';
+}
+
+// Look up a shell variable
+const char* shell_get_var(const char* name) {
+    for (int i = 0; i < SHELL_MAX_VARS; i++) {
+        if (vars[i].used && strcmp(vars[i].name, name) == 0) {
+            return vars[i].value;
+        }
+    }
+    return 0;
+}
+
+// Set a shell variable (value 0 removes it). Returns 0 if the table is full.
+int shell_set_var(const char* name, const char* value) {
+    int free_slot = -1;
+    
+    for (int i = 0; i < SHELL_MAX_VARS; i++) {
+        if (vars[i].used && strcmp(vars[i].name, name) == 0) {
+            if (value) {
+                copy_string(vars[i].value, value, SHELL_VAR_VALUE_LEN);
+            } else {
+                vars[i].used = 0;
+            }
+            return 1;
+        }
+        if (!vars[i].used && free_slot == -1) free_slot = i;
+    }
+    
+    if (!value) return 1;
+    if (free_slot == -1) return 0;
+    
+    copy_string(vars[free_slot].name, name, SHELL_VAR_NAME_LEN);
+    copy_string(vars[free_slot].value, value, SHELL_VAR_VALUE_LEN);
+    vars[free_slot].used = 1;
+    return 1;
+}
+
+// Substitute a $variable argument; unset variables expand to ""
+static char* expand_arg(char* arg) {
+    if (arg[0] == '$' && arg[1]) {
+        const char* value = shell_get_var(arg + 1);
+        return (char*)(value ? value : "");
+    }
+    return arg;
+}
+
+// Run every line of a script through the shell. Scripts are boot
+// modules or initrd files. Returns the commands executed, or -1 on error.
+int shell_source(const char* name) {
+    unsigned int size;
+    const char* data = ramfs_open(name, &size);
+    if (!data) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Script not found: ");
+        print(name);
+        print("\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return -1;
+    }
+    if (source_depth >= SHELL_MAX_SOURCE_DEPTH) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Scripts nested too deeply\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return -1;
+    }
+    
+    char line[MAX_INPUT];
+    int len = 0;
+    int executed = 0;
+    
+    source_depth++;
+    for (unsigned int pos = 0; pos <= size; pos++) {
+        char c = (pos < size) ? data[pos] : '\n';
+        
+        if (c == '\n' || c == '\r') {
+            line[len] = '\0';
+            len = 0;
+            
+            // Skip blank lines and # comments
+            char* start = line;
+            while (*start == ' ' || *start == '\t') start++;
+            if (*start == '\0' || *start == '#') continue;
+            
+            shell_execute(start);
+            executed++;
+        } else if (len < MAX_INPUT - 1) {
+            line[len++] = c;
+        }
+    }
+    source_depth--;
+    
+    return executed;
+}
+
+// Command: source
+static void cmd_source(char** args, int argc) {
+    if (argc < 2) {
+        // No script given: list what GRUB loaded
+        set_color(COLOR_YELLOW, COLOR_BLACK);
+        print("\nBoot modules:\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        if (module_count() == 0) {
+            print("  (none)\n");
+        }
+        for (int i = 0; i < module_count(); i++) {
+            const boot_module_t* mod = module_get(i);
+            print("  ");
+            print(mod->name);
+            print(" (");
+            print_int(mod->size);
+            print(" bytes)\n");
+        }
+        print("\n");
+        return;
+    }
+    
+    int executed = shell_source(args[1]);
+    if (executed >= 0) {
+        set_color(COLOR_GREEN, COLOR_BLACK);
+        print("Script ");
+        print(args[1]);
+        print(": ");
+        print_int(executed);
+        print(" commands\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    }
+}
+
+// Command: repeat
+static void cmd_repeat(char** args, int argc) {
+    int count = atoi(expand_arg(args[1]));
+    if (count <= 0) {
+        print("Count must be positive\n");
+        return;
+    }
+    
+    // $i holds the iteration number
+    char index[12];
+    for (int i = 0; i < count; i++) {
+        int_to_string(i, index);
+        shell_set_var("i", index);
+        shell_dispatch(args + 2, argc - 2);
+    }
+}
+
+// Command: set
+static void cmd_set(char** args, int argc) {
+    if (argc == 1) {
+        int shown = 0;
+        for (int i = 0; i < SHELL_MAX_VARS; i++) {
+            if (!vars[i].used) continue;
+            print(vars[i].name);
+            print("=");
+            print(vars[i].value);
+            print("\n");
+            shown++;
+        }
+        if (shown == 0) print("No variables set\n");
+        return;
+    }
+    
+    if (!shell_set_var(args[1], argc > 2 ? args[2] : 0)) {
+        set_color(COLOR_RED, COLOR_BLACK);
+        print("Error: Too many variables\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+    }
+}
+
+// Command: quiet
+static void cmd_quiet(char** args, int argc) {
+    console_quiet++;
+    shell_dispatch(args + 1, argc - 1);
+    console_quiet--;
+}
+
+// Command: ls
+static void cmd_ls(char** args, int argc) {
+    ramfs_list(argc > 1 ? args[1] : "/");
+}
+
+// Command: cat
+static void cmd_cat(char** args, int argc) {
+    (void)argc;
+    ramfs_cat(args[1]);
+}
+
+// Command: stat
+static void cmd_stat(char** args, int argc) {
+    (void)argc;
+    ramfs_stat(args[1]);
+}
+
+// Command: diskinfo
+static void cmd_diskinfo(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    bcache_show_info();
+}
+
+// Command: diskbench
+static void cmd_diskbench(char** args, int argc) {
+    (void)args;
+    (void)argc;
+    bcache_benchmark();
+}
+
+// Built-in commands. Adding a command only takes a row here.
+static const shell_command_t builtin_commands[] = {
+    {"help",       cmd_help,       1, "help",                  "Show this help message",       CMD_GROUP_SYSTEM, 0},
+    {"clear",      cmd_clear,      1, "clear",                 "Clear screen",                 CMD_GROUP_SYSTEM, 0},
+    {"echo",       cmd_echo,       1, "echo <text>",           "Print text",                   CMD_GROUP_SYSTEM, 0},
+    {"boottime",   cmd_boottime,   1, "boottime",              "Show boot phase timings",      CMD_GROUP_SYSTEM, 0},
+    {"klibbench",  cmd_klibbench,  1, "klibbench",             "Compare memcpy/strlen variants", CMD_GROUP_SYSTEM, 0},
+    {"bench",      cmd_bench,      1, "bench [name|list]",     "Run kernel benchmarks (cycles)", CMD_GROUP_SYSTEM, 0},
+    {"profile",    cmd_profile,    2, "profile <start|stop|report>", "Sample where time is spent", CMD_GROUP_SYSTEM, 0},
+    {"trace",      cmd_trace,      1, "trace [start|stop|dump]", "Event tracing (dump: serial/raw)", CMD_GROUP_SYSTEM, 0},
+    {"dmesg",      cmd_dmesg,      1, "dmesg [clear|level [lvl]]", "Kernel log, console log level", CMD_GROUP_SYSTEM, 0},
+    {"checkpoint", cmd_checkpoint, 1, "checkpoint",            "Save processes and memory state", CMD_GROUP_SYSTEM, 0},
+    {"restore",    cmd_restore,    1, "restore",               "Reload the last checkpoint",   CMD_GROUP_SYSTEM, 0},
+    {"ps",         cmd_ps,         1, "ps",                    "List all processes",           CMD_GROUP_PROCESS, 0},
+    {"run",        cmd_run,        3, "run <burst> <prio>",    "Create new process",           CMD_GROUP_PROCESS, 0},
+    {"kill",       cmd_kill,       2, "kill <pid>",            "Terminate process",            CMD_GROUP_PROCESS, 0},
+    {"sleep",      cmd_sleep,      3, "sleep <pid> <ticks>",   "Block a process for a while",  CMD_GROUP_PROCESS, 0},
+    {"fork",       cmd_fork,       2, "fork <pid>",            "Copy-on-write clone of process", CMD_GROUP_PROCESS, 0},
+    {"send",       cmd_send,       3, "send <from> <to> <msg>", "Queue a message (from 0: shell)", CMD_GROUP_PROCESS, 0},
+    {"recv",       cmd_recv,       2, "recv <pid> [ticks]",    "Receive, or wait for, a message", CMD_GROUP_PROCESS, 0},
+    {"ipcbench",   cmd_ipcbench,   1, "ipcbench",              "Message queue throughput/latency", CMD_GROUP_PROCESS, 0},
+    {"user",       cmd_user,       1, "user [pid]",            "Run the demo task in ring 3",  CMD_GROUP_PROCESS, 0},
+    {"exec",       cmd_exec,       2, "exec <program>",        "Load and run an ELF program", CMD_GROUP_PROCESS, 0},
+    {"syscallbench", cmd_syscallbench, 1, "syscallbench",      "Null system call latency",     CMD_GROUP_PROCESS, 0},
+    {"scheduler",  cmd_scheduler,  2, "scheduler <mode|quantum|tick>", "Set mode, quantum or tick", CMD_GROUP_SCHEDULER, 0},
+    {"schedstat",  cmd_schedstat,  1, "schedstat [pid|reset]", "Run-queue latency, switches, CPU share", CMD_GROUP_SCHEDULER, 0},
+    {"meminfo",    cmd_meminfo,    1, "meminfo",               "Show memory stats",            CMD_GROUP_MEMORY, 0},
+    {"frames",     cmd_frames,     1, "frames",                "Show frame table",             CMD_GROUP_MEMORY, 0},
+    {"allocpages", cmd_allocpages, 3, "allocpages <pid> <n>",  "Allocate pages",               CMD_GROUP_MEMORY, 0},
+    {"access",     cmd_access,     3, "access <pid> <page> [w]", "Access (or write) a page",   CMD_GROUP_MEMORY, 0},
+    {"sync",       cmd_sync,       1, "sync",                  "Write back pages and sectors", CMD_GROUP_MEMORY, 0},
+    {"shmget",     cmd_shmget,     3, "shmget <key> <n>",      "Create shared segment",        CMD_GROUP_MEMORY, 0},
+    {"shmattach",  cmd_shmattach,  4, "shmattach <pid> <key> <page>", "Map segment at page",   CMD_GROUP_MEMORY, 0},
+    {"ksm",        cmd_ksm,        2, "ksm <on|off|scan>",     "Same-page merging",            CMD_GROUP_MEMORY, 0},
+    {"hugepage",   cmd_hugepage,   2, "hugepage <pid> [on|off]", "Huge pages for a process",   CMD_GROUP_MEMORY, 0},
+    {"memgroup",   cmd_memgroup,   1, "memgroup [set|assign]", "Frame quotas per process group", CMD_GROUP_MEMORY, 0},
+    {"source",     cmd_source,     1, "source [script]",       "Run a script (none: list)",    CMD_GROUP_SCRIPT, 0},
+    {"repeat",     cmd_repeat,     3, "repeat <n> <cmd>",      "Run a command n times ($i)",   CMD_GROUP_SCRIPT, 1},
+    {"set",        cmd_set,        1, "set [name] [value]",    "Set, clear or list variables", CMD_GROUP_SCRIPT, 0},
+    {"quiet",      cmd_quiet,      2, "quiet <cmd>",           "Run without console output",   CMD_GROUP_SCRIPT, 1},
+    {"ls",         cmd_ls,         1, "ls [path]",             "List an initrd directory",     CMD_GROUP_FILE, 0},
+    {"cat",        cmd_cat,        2, "cat <path>",            "Print a file",                 CMD_GROUP_FILE, 0},
+    {"stat",       cmd_stat,       2, "stat <path>",           "Show inode details",           CMD_GROUP_FILE, 0},
+    {"diskinfo",   cmd_diskinfo,   1, "diskinfo",              "Show disk and cache stats",    CMD_GROUP_FILE, 0},
+    {"diskbench",  cmd_diskbench,  1, "diskbench",             "Disk IOPS, cache on and off",  CMD_GROUP_FILE, 0},
+};
+
+// Hash a command name. Seed 0 picks the first-level bucket; each bucket
+// then stores the seed that sends its names to free slots.
+static unsigned int name_hash(const char* name, unsigned int seed) {
+    unsigned int hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+// Rebuild the perfect hash over all registered commands (hash and
+// displace): the largest buckets are placed first, each trying seeds
+// until all of its names land in distinct empty slots.
+static int build_command_hash() {
+    int bucket_size[SHELL_HASH_BUCKETS];
+    int placed[SHELL_HASH_BUCKETS];
+    
+    for (int i = 0; i < SHELL_HASH_SLOTS; i++) {
+        command_slots[i] = 0;
+    }
+    for (int b = 0; b < SHELL_HASH_BUCKETS; b++) {
+        bucket_size[b] = 0;
+        placed[b] = 0;
+        bucket_seed[b] = 0;
+    }
+    for (int i = 0; i < command_count; i++) {
+        bucket_size[name_hash(commands[i]->name, 0) & (SHELL_HASH_BUCKETS - 1)]++;
+    }
+    
+    for (int round = 0; round < SHELL_HASH_BUCKETS; round++) {
+        // Next bucket: the largest one not yet placed
+        int bucket = -1;
+        for (int b = 0; b < SHELL_HASH_BUCKETS; b++) {
+            if (!placed[b] && (bucket == -1 || bucket_size[b] > bucket_size[bucket])) {
+                bucket = b;
+            }
+        }
+        placed[bucket] = 1;
+        if (bucket_size[bucket] == 0) break;
+        
+        int seed;
+        for (seed = 1; seed < 256; seed++) {
+            int ok = 1;
+            for (int i = 0; i < command_count && ok; i++) {
+                if ((name_hash(commands[i]->name, 0) & (SHELL_HASH_BUCKETS - 1)) != (unsigned int)bucket) continue;
+                int slot = name_hash(commands[i]->name, seed) & (SHELL_HASH_SLOTS - 1);
+                if (command_slots[slot]) {
+                    ok = 0;
+                } else {
+                    command_slots[slot] = commands[i];
+                }
+            }
+            if (ok) break;
+            
+            // Undo this attempt
+            for (int i = 0; i < SHELL_HASH_SLOTS; i++) {
+                if (command_slots[i] &&
+                    (name_hash(command_slots[i]->name, 0) & (SHELL_HASH_BUCKETS - 1)) == (unsigned int)bucket) {
+                    command_slots[i] = 0;
+                }
+            }
+        }
+        if (seed == 256) {
+            return 0;
+        }
+        bucket_seed[bucket] = (unsigned char)seed;
+    }
+    return 1;
+}
+
+// Register a command. Returns 0 if the table is full, the name is
+// taken, or no perfect hash exists for the new set.
+int shell_register_command(const shell_command_t* cmd) {
+    if (command_count >= SHELL_MAX_COMMANDS || shell_find_command(cmd->name)) {
+        return 0;
+    }
+    
+    commands[command_count++] = cmd;
+    if (!build_command_hash()) {
+        command_count--;
+        build_command_hash();
+        return 0;
+    }
+    return 1;
+}
+
+// Look up a command: two hashes and one string compare
+const shell_command_t* shell_find_command(const char* name) {
+    unsigned int bucket = name_hash(name, 0) & (SHELL_HASH_BUCKETS - 1);
+    unsigned int slot = name_hash(name, bucket_seed[bucket]) & (SHELL_HASH_SLOTS - 1);
+    const shell_command_t* cmd = command_slots[slot];
+    
+    if (cmd && strcmp(cmd->name, name) == 0) {
+        return cmd;
+    }
+    return 0;
+}
+
+// Register the built-in commands
+void shell_init() {
+    command_count = 0;
+    for (unsigned int i = 0; i < sizeof(builtin_commands) / sizeof(builtin_commands[0]); i++) {
+        shell_register_command(&builtin_commands[i]);
+    }
+}
+
+// Expand $variables and run one parsed command
+static void shell_dispatch(char** args, int argc) {
+    char* expanded[MAX_ARGS + 1];
+    
+    expanded[0] = expand_arg(args[0]);
+    const shell_command_t* cmd = shell_find_command(expanded[0]);
+    if (!cmd) {
         set_color(COLOR_RED, COLOR_BLACK);
         print("Unknown command: ");
-        print(args[0]);
+        print(expanded[0]);
         print("\n");
         set_color(COLOR_WHITE, COLOR_BLACK);
         print("Type 'help' for available commands\n");
+        return;
+    }
+    
+    if (argc < cmd->min_args) {
+        print("Usage: ");
+        print(cmd->usage);
+        print("\n");
+        return;
+    }
+    
+    // Prefix commands get the raw words so that each inner run
+    // sees the variables as they are at that point
+    for (int i = 1; i < argc; i++) {
+        expanded[i] = cmd->raw_args ? args[i] : expand_arg(args[i]);
     }
+    expanded[argc] = 0;
+    
+    cmd->handler(expanded, argc);
+    log_flush();
+}
+
+// Execute command
+void shell_execute(char* input) {
+    char* args[MAX_ARGS + 1];
+    int argc;
+    
+    parse_command(input, args, &argc);
+    
+    if (argc == 0) return;
+    
+    shell_dispatch(args, argc);
 }
 
 // Main shell loop
@@ -330,6 +1215,9 @@ void shell_loop() {
     int input_pos = 0;
     
     while (1) {
+        // Kernel messages logged outside commands (boot, user mode)
+        log_flush();
+        
         set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
         print("minios");
         set_color(COLOR_YELLOW, COLOR_BLACK);
@@ -5,22 +5,64 @@
 #define MAX_INPUT 256
 #define MAX_ARGS 16
 
+// Command table limits
+#define SHELL_MAX_COMMANDS 64
+#define SHELL_HASH_SLOTS 128      // Perfect hash table size (power of two)
+#define SHELL_HASH_BUCKETS 32     // First-level buckets (power of two)
+#define HELP_USAGE_WIDTH 22       // Usage column width in help output
+
+// Scripts and variables
+#define SHELL_MAX_VARS 16
+#define SHELL_VAR_NAME_LEN 16
+#define SHELL_VAR_VALUE_LEN 32
+#define SHELL_MAX_SOURCE_DEPTH 4
+#define SHELL_AUTORUN "autorun.msh"  // Sourced at boot when loaded
+
+// Help sections
+typedef enum {
+    CMD_GROUP_SYSTEM,
+    CMD_GROUP_PROCESS,
+    CMD_GROUP_SCHEDULER,
+    CMD_GROUP_MEMORY,
+    CMD_GROUP_SCRIPT,
+    CMD_GROUP_FILE,
+    CMD_GROUP_COUNT
+} cmd_group_t;
+
+// Command handler: args[0] is the command name
+typedef void (*shell_handler_t)(char** args, int argc);
+
+// Command table entry
+typedef struct {
+    const char* name;
+    shell_handler_t handler;
+    int min_args;          // Required argc, including the name
+    const char* usage;     // Shown by help and on missing arguments
+    const char* help;      // One-line description
+    cmd_group_t group;
+    int raw_args;          // Handler expands $variables itself (prefix commands)
+} shell_command_t;
+
+// Shell variable, expanded from $name
+typedef struct {
+    char name[SHELL_VAR_NAME_LEN];
+    char value[SHELL_VAR_VALUE_LEN];
+    int used;
+} shell_var_t;
+
 // Shell functions
+void shell_init();
 void shell_loop();
 void shell_execute(char* input);
 void parse_command(char* input, char** args, int* argc);
 
-// Built-in commands
-void cmd_help();
-void cmd_clear();
-void cmd_echo(char** args, int argc);
-void cmd_ps();
-void cmd_run(char** args, int argc);
-void cmd_kill(char** args, int argc);
-void cmd_scheduler(char** args, int argc);
-void cmd_meminfo();
-void cmd_frames();
-void cmd_allocpages(char** args, int argc);
-void cmd_access(char** args, int argc);
+// Command registration
+int shell_register_command(const shell_command_t* cmd);
+const shell_command_t* shell_find_command(const char* name);
+
+// Scripts
+int shell_source(const char* name);
+const char* shell_get_var(const char* name);
+int shell_set_var(const char* name, const char* value);
 
 #endif
@@ -0,0 +1,231 @@
+// syscall.c - System call table, entry setup and ring 3 tasks
+#include "kernel.h"
+#include "gdt.h"
+#include "idt.h"
+#include "syscall.h"
+#include "scheduler.h"
+
+static int sysenter_ok = 0;
+static int user_active = 0;            // A ring 3 task is running
+static int user_pid = 0;               // PID the ring 3 task runs as
+static int syscall_counts[SYS_COUNT];
+
+static unsigned char user_stack[USER_STACK_SIZE] __attribute__((aligned(16)));
+
+// Cycle totals written by the ring 3 benchmark task
+static volatile unsigned long long bench_int80_cycles;
+static volatile unsigned long long bench_sysenter_cycles;
+
+static void wrmsr(unsigned int msr, unsigned int value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+// CPUID.1:EDX bit 11 advertises sysenter/sysexit
+static int cpu_has_sep() {
+    unsigned int eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx >> 11) & 1;
+}
+
+// write(buf, len): print up to len characters
+static int sys_write(int buf, int len, int unused) {
+    (void)unused;
+    const char* text = (const char*)buf;
+    if (!text || len < 0 || len > 1024) return -1;
+    
+    for (int i = 0; i < len; i++) {
+        print_char(text[i]);
+    }
+    return len;
+}
+
+// yield(): let the scheduler run one tick
+static int sys_yield(int unused1, int unused2, int unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    scheduler_tick();
+    return 0;
+}
+
+// exit(code): leave ring 3 for good
+static int sys_exit(int code, int unused1, int unused2) {
+    (void)unused1;
+    (void)unused2;
+    user_active = 0;
+    user_return(code);
+    return 0;
+}
+
+// getpid()
+static int sys_getpid(int unused1, int unused2, int unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    return user_pid;
+}
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    sys_write,
+    sys_yield,
+    sys_exit,
+    sys_getpid,
+};
+
+// Called from both entry paths with the caller's registers
+int syscall_dispatch(int number, int arg1, int arg2, int arg3) {
+    if ((unsigned int)number >= SYS_COUNT) {
+        return -1;
+    }
+    syscall_counts[number]++;
+    return syscall_table[number](arg1, arg2, arg3);
+}
+
+// CPU exception: kill the ring 3 task, or stop if the kernel faulted
+void syscall_fault(int vector) {
+    set_color(COLOR_RED, COLOR_BLACK);
+    print("Exception ");
+    print_int(vector);
+    
+    if (user_active) {
+        print(" in user mode: task killed\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        user_active = 0;
+        user_return(-1);
+    }
+    print(" in kernel mode: system halted\n");
+}
+
+// Install the int 0x80 gate and, when the CPU has it, the sysenter MSRs
+void syscall_init() {
+    idt_set_gate(SYSCALL_VECTOR, (unsigned int)syscall_int80, IDT_USER_GATE);
+    
+    sysenter_ok = cpu_has_sep();
+    if (sysenter_ok) {
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+        wrmsr(MSR_SYSENTER_ESP, gdt_kernel_stack());
+        wrmsr(MSR_SYSENTER_EIP, (unsigned int)syscall_sysenter);
+    }
+}
+
+int syscall_has_sysenter() {
+    return sysenter_ok;
+}
+
+// Ring 3 side of the two entry methods
+static inline int user_int80(int number, int arg1, int arg2, int arg3) {
+    int result;
+    __asm__ volatile ("int $0x80"
+                      : "=a"(result)
+                      : "a"(number), "b"(arg1), "S"(arg2), "D"(arg3)
+                      : "memory");
+    return result;
+}
+
+static inline int user_fast(int number, int arg1, int arg2, int arg3) {
+    int result;
+    __asm__ volatile ("movl %%esp, %%ecx\n\t"
+                      "movl $1f, %%edx\n\t"
+                      "sysenter\n"
+                      "1:"
+                      : "=a"(result)
+                      : "a"(number), "b"(arg1), "S"(arg2), "D"(arg3)
+                      : "ecx", "edx", "memory");
+    return result;
+}
+
+// Demo task: runs in ring 3 and only talks to the kernel via system calls
+static void user_demo() {
+    static const char hello[] = "Hello from ring 3! My PID is ";
+    static const char bye[] = "Yielded once, now exiting\n";
+    char digits[12];
+    
+    user_int80(SYS_WRITE, (int)hello, sizeof(hello) - 1, 0);
+    
+    int pid = sysenter_ok ? user_fast(SYS_GETPID, 0, 0, 0) : user_int80(SYS_GETPID, 0, 0, 0);
+    int len = 0;
+    do {
+        digits[len++] = '0' + pid % 10;
+        pid /= 10;
+    } while (pid > 0);
+    for (int i = 0; i < len / 2; i++) {
+        char c = digits[i];
+        digits[i] = digits[len - 1 - i];
+        digits[len - 1 - i] = c;
+    }
+    digits[len++] = '\n';
+    user_int80(SYS_WRITE, (int)digits, len, 0);
+    
+    user_int80(SYS_YIELD, 0, 0, 0);
+    user_int80(SYS_WRITE, (int)bye, sizeof(bye) - 1, 0);
+    user_int80(SYS_EXIT, 0, 0, 0);
+}
+
+// Benchmark task: time null system calls through each entry method
+static void user_bench() {
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < SYSCALL_BENCH_CALLS; i++) {
+        user_int80(SYS_GETPID, 0, 0, 0);
+    }
+    bench_int80_cycles = rdtsc() - start;
+    
+    if (sysenter_ok) {
+        start = rdtsc();
+        for (int i = 0; i < SYSCALL_BENCH_CALLS; i++) {
+            user_fast(SYS_GETPID, 0, 0, 0);
+        }
+        bench_sysenter_cycles = rdtsc() - start;
+    }
+    
+    user_int80(SYS_EXIT, 0, 0, 0);
+}
+
+// Run a task in ring 3 until it exits
+static int user_start(void (*entry)(), unsigned int stack_top, int pid) {
+    user_pid = pid;
+    user_active = 1;
+    return user_enter(entry, stack_top);
+}
+
+// Run the demo task as a process (0: no process)
+int user_run(int pid) {
+    return user_start(user_demo, (unsigned int)(user_stack + USER_STACK_SIZE), pid);
+}
+
+// Run a program copied into memory as a process, on its own stack
+int user_exec(int pid, unsigned int entry, unsigned int stack_top) {
+    return user_start((void (*)())entry, stack_top, pid);
+}
+
+// syscallbench: cycles per null system call for each entry method
+void syscall_benchmark() {
+    bench_int80_cycles = 0;
+    bench_sysenter_cycles = 0;
+    
+    // Baseline: the dispatcher called directly from ring 0
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < SYSCALL_BENCH_CALLS; i++) {
+        syscall_dispatch(SYS_GETPID, 0, 0, 0);
+    }
+    unsigned int direct = (unsigned int)udiv64(rdtsc() - start, SYSCALL_BENCH_CALLS);
+    
+    if (user_start(user_bench, (unsigned int)(user_stack + USER_STACK_SIZE), 0) < 0) return;
+    
+    print("\n  ");
+    print_int(SYSCALL_BENCH_CALLS);
+    print(" getpid() calls per method\n\n");
+    set_color(COLOR_YELLOW, COLOR_BLACK);
+    print("  Method              Cycles/call\n");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("  direct (ring 0)     ");
+    print_int(direct);
+    print("\n  int 0x80            ");
+    print_int((int)udiv64(bench_int80_cycles, SYSCALL_BENCH_CALLS));
+    print("\n  sysenter/sysexit    ");
+    if (sysenter_ok) {
+        print_int((int)udiv64(bench_sysenter_cycles, SYSCALL_BENCH_CALLS));
+    } else {
+        print("not supported");
+    }
+    print("\n\n");
+}
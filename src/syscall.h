@@ -0,0 +1,40 @@
+// syscall.h - System calls and ring 3 tasks
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+// Call numbers (eax); arguments in ebx, esi, edi
+#define SYS_WRITE  0                   // write(buf, len)
+#define SYS_YIELD  1                   // yield()
+#define SYS_EXIT   2                   // exit(code)
+#define SYS_GETPID 3                   // getpid()
+#define SYS_COUNT  4
+
+#define SYSCALL_VECTOR 0x80
+#define USER_STACK_SIZE 8192
+#define SYSCALL_BENCH_CALLS 10000
+
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+typedef int (*syscall_fn_t)(int arg1, int arg2, int arg3);
+
+// System call functions
+void syscall_init();
+int syscall_dispatch(int number, int arg1, int arg2, int arg3);
+void syscall_fault(int vector);
+int syscall_has_sysenter();
+
+// Ring 3 tasks
+int user_run(int pid);
+int user_exec(int pid, unsigned int entry, unsigned int stack_top);
+void syscall_benchmark();
+
+// asm/syscall.asm
+void syscall_int80();
+void syscall_sysenter();
+int user_enter(void (*entry)(), unsigned int user_esp);
+void user_return(int code);
+
+#endif
@@ -0,0 +1,126 @@
+// timer.c - Timing wheel: O(1) add, cancel and expiry
+#include "kernel.h"
+#include "timer.h"
+
+// Level L holds timers due within TIMER_SLOTS^(L+1) ticks, in the slot
+// picked by bits 6L..6L+5 of their expiry tick. When the level below
+// wraps, the next slot of a level is cascaded down. Each timer moves at
+// most TIMER_LEVELS - 1 times, so a tick costs the same however many
+// timers are pending.
+static ktimer_t* wheel[TIMER_LEVELS][TIMER_SLOTS];
+static unsigned int next_tick = 1;     // First tick not yet run
+static int pending = 0;
+
+void timer_init() {
+    next_tick = 1;
+    pending = 0;
+}
+
+// Ticks run so far
+unsigned int timer_now() {
+    return next_tick - 1;
+}
+
+// Move the clock to a saved tick (checkpoint restore). Pending timers
+// are placed relative to the clock, so there must be none.
+int timer_set_now(unsigned int now) {
+    if (pending != 0) return 0;
+    next_tick = now + 1;
+    return 1;
+}
+
+int timer_count() {
+    return pending;
+}
+
+int timer_pending(const ktimer_t* timer) {
+    return timer->pprev != 0;
+}
+
+// Link a timer into the slot for its expiry, relative to next_tick
+static void place(ktimer_t* timer) {
+    unsigned int delta = timer->expires - next_tick;
+    if (delta > TIMER_MAX_DELAY) {
+        delta = TIMER_MAX_DELAY;
+        timer->expires = next_tick + delta;
+    }
+    
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1u << ((level + 1) * TIMER_SLOT_BITS))) {
+        level++;
+    }
+    ktimer_t** slot = &wheel[level][(timer->expires >> (level * TIMER_SLOT_BITS)) & TIMER_MASK];
+    
+    timer->next = *slot;
+    if (*slot) (*slot)->pprev = &timer->next;
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+static void detach(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = 0;
+    timer->pprev = 0;
+}
+
+// Call fn(arg) after delay ticks (at least one). A pending timer is
+// moved to the new time.
+void timer_add(ktimer_t* timer, unsigned int delay, timer_fn_t fn, int arg) {
+    if (timer->pprev) {
+        detach(timer);
+    } else {
+        pending++;
+    }
+    if (delay == 0) delay = 1;
+    
+    timer->expires = timer_now() + delay;
+    timer->fn = fn;
+    timer->arg = arg;
+    place(timer);
+}
+
+// Stop a timer. Returns 0 if it was not pending.
+int timer_cancel(ktimer_t* timer) {
+    if (!timer->pprev) return 0;
+    detach(timer);
+    pending--;
+    return 1;
+}
+
+// Re-place every timer in one slot of a level. Returns the slot index.
+static int cascade(int level, int index) {
+    ktimer_t* timer = wheel[level][index];
+    wheel[level][index] = 0;
+    while (timer) {
+        ktimer_t* next = timer->next;
+        place(timer);
+        timer = next;
+    }
+    return index;
+}
+
+// Advance one tick and run the timers due on it
+void timer_tick() {
+    unsigned int tick = next_tick;
+    
+    // Crossing into a new block of a level: pull its timers down
+    int index = tick & TIMER_MASK;
+    for (int level = 1; level < TIMER_LEVELS && index == 0; level++) {
+        index = cascade(level, (tick >> (level * TIMER_SLOT_BITS)) & TIMER_MASK);
+    }
+    
+    // Detach the due list first: callbacks may add timers or cancel
+    // ones still on it
+    ktimer_t* due = wheel[0][tick & TIMER_MASK];
+    wheel[0][tick & TIMER_MASK] = 0;
+    if (due) due->pprev = &due;
+    next_tick = tick + 1;
+    
+    while (due) {
+        ktimer_t* timer = due;
+        detach(timer);
+        pending--;
+        timer->fn(timer->arg);
+    }
+}
@@ -0,0 +1,32 @@
+// timer.h - Hierarchical timing wheel driven by the scheduler tick
+#ifndef TIMER_H
+#define TIMER_H
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)     // Slots per level
+#define TIMER_MASK (TIMER_SLOTS - 1)
+#define TIMER_MAX_DELAY ((1 << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1)
+
+typedef void (*timer_fn_t)(int arg);
+
+// A timer, embedded in its owner. Zeroed means not pending.
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;         // Link pointing at this timer (0 if not pending)
+    unsigned int expires;          // Tick it fires on
+    timer_fn_t fn;
+    int arg;
+} ktimer_t;
+
+// Timer functions
+void timer_init();
+void timer_add(ktimer_t* timer, unsigned int delay, timer_fn_t fn, int arg);
+int timer_cancel(ktimer_t* timer);
+int timer_pending(const ktimer_t* timer);
+unsigned int timer_now();
+int timer_set_now(unsigned int now);
+int timer_count();
+void timer_tick();
+
+#endif
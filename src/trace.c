@@ -0,0 +1,171 @@
+// trace.c - Per-CPU ring buffers of binary trace records
+#include "kernel.h"
+#include "trace.h"
+
+int trace_enabled = 0;
+
+static trace_ring_t rings[TRACE_CPUS];
+static unsigned long long trace_start_tsc = 0;
+
+// Event names and the meaning of their two arguments
+static const struct {
+    const char* name;
+    const char* a;
+    const char* b;
+} trace_events[TRACE_EVENT_COUNT] = {
+    {"?",        "a",    "b"},
+    {"dispatch", "pid",  "left"},
+    {"preempt",  "pid",  "left"},
+    {"complete", "pid",  "turnaround"},
+    {"fault",    "pid",  "page"},
+    {"evict",    "pid",  "page"},
+    {"key",      "char", "scancode"},
+};
+
+// Only one CPU runs the kernel; rings are indexed by CPU so that more
+// CPUs would each write their own without locking
+static inline int trace_cpu() {
+    return 0;
+}
+
+// Append a record to this CPU's ring
+void trace_record(int event, int a, int b) {
+    int cpu = trace_cpu();
+    trace_ring_t* ring = &rings[cpu];
+    trace_record_t* rec = &ring->records[ring->head & (TRACE_RECORDS - 1)];
+    
+    rec->tsc = rdtsc();
+    rec->event = (unsigned char)event;
+    rec->cpu = (unsigned char)cpu;
+    rec->a = (unsigned short)a;
+    rec->b = (unsigned int)b;
+    ring->head++;
+}
+
+// Clear the rings and enable every tracepoint
+void trace_start() {
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++) {
+        rings[cpu].head = 0;
+    }
+    trace_start_tsc = rdtsc();
+    trace_enabled = 1;
+}
+
+void trace_stop() {
+    trace_enabled = 0;
+}
+
+// Records still held by a ring
+static unsigned int ring_count(const trace_ring_t* ring) {
+    return ring->head < TRACE_RECORDS ? ring->head : TRACE_RECORDS;
+}
+
+// Dump output goes to the console or, for serial dumps, to COM1
+static int dump_to_serial = 0;
+
+static void dump_print(const char* str) {
+    if (dump_to_serial) {
+        serial_print(str);
+    } else {
+        print(str);
+    }
+}
+
+static void dump_uint(unsigned int value) {
+    char buf[11];
+    int i = 10;
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    dump_print(&buf[i]);
+}
+
+static void dump_raw(const void* data, int bytes) {
+    const char* p = (const char*)data;
+    for (int i = 0; i < bytes; i++) {
+        serial_write(p[i]);
+    }
+}
+
+// Print one record as "[time us] cpuN event a=.. b=.."
+static void dump_record(const trace_record_t* rec) {
+    int event = rec->event < TRACE_EVENT_COUNT ? rec->event : 0;
+    
+    dump_print("[");
+    dump_uint(tsc_to_us(rec->tsc - trace_start_tsc));
+    dump_print(" us] cpu");
+    dump_uint(rec->cpu);
+    dump_print(" ");
+    dump_print(trace_events[event].name);
+    dump_print(" ");
+    dump_print(trace_events[event].a);
+    dump_print("=");
+    if (event == TRACE_KEY && rec->a >= ' ' && rec->a < 0x7F) {
+        char c[4] = {'\'', (char)rec->a, '\'', '\0'};
+        dump_print(c);
+    } else {
+        dump_uint(rec->a);
+    }
+    dump_print(" ");
+    dump_print(trace_events[event].b);
+    dump_print("=");
+    dump_uint(rec->b);
+    dump_print("\n");
+}
+
+// Dump every ring, oldest record first. A raw dump writes the magic,
+// the record count and then the records exactly as stored.
+void trace_dump(int format) {
+    int was_enabled = trace_enabled;
+    trace_enabled = 0;
+    dump_to_serial = (format != TRACE_DUMP_TEXT);
+    
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++) {
+        const trace_ring_t* ring = &rings[cpu];
+        unsigned int count = ring_count(ring);
+        unsigned int first = ring->head - count;
+        
+        if (format == TRACE_DUMP_RAW) {
+            unsigned int header[2] = {TRACE_RAW_MAGIC, count};
+            dump_raw(header, sizeof(header));
+        }
+        for (unsigned int i = first; i != ring->head; i++) {
+            const trace_record_t* rec = &ring->records[i & (TRACE_RECORDS - 1)];
+            if (format == TRACE_DUMP_RAW) {
+                dump_raw(rec, sizeof(trace_record_t));
+            } else {
+                dump_record(rec);
+            }
+        }
+    }
+    
+    dump_to_serial = 0;
+    trace_enabled = was_enabled;
+}
+
+// Show whether tracing is on and how full the rings are
+void trace_show_status() {
+    print("Tracing: ");
+    set_color(trace_enabled ? COLOR_GREEN : COLOR_YELLOW, COLOR_BLACK);
+    print(trace_enabled ? "on" : "off");
+    set_color(COLOR_WHITE, COLOR_BLACK);
+    print("\n");
+    
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++) {
+        print("  cpu");
+        print_int(cpu);
+        print(": ");
+        print_int(ring_count(&rings[cpu]));
+        print("/");
+        print_int(TRACE_RECORDS);
+        print(" records");
+        if (rings[cpu].head > TRACE_RECORDS) {
+            print(", ");
+            print_int(rings[cpu].head - TRACE_RECORDS);
+            print(" overwritten");
+        }
+        print("\n");
+    }
+}
@@ -0,0 +1,53 @@
+// trace.h - Binary event tracing
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_RECORDS 1024             // Records per CPU ring (power of two)
+#define TRACE_CPUS 1
+#define TRACE_RAW_MAGIC 0x4352544D     // "MTRC", starts a raw serial dump
+
+// Events
+#define TRACE_DISPATCH 1               // a=pid, b=remaining burst
+#define TRACE_PREEMPT  2               // a=pid, b=remaining burst
+#define TRACE_COMPLETE 3               // a=pid, b=turnaround
+#define TRACE_FAULT    4               // a=pid, b=page
+#define TRACE_EVICT    5               // a=pid, b=page
+#define TRACE_KEY      6               // a=character, b=scancode
+#define TRACE_EVENT_COUNT 7
+
+// Dump formats
+#define TRACE_DUMP_TEXT 0              // Text on the console
+#define TRACE_DUMP_SERIAL 1            // Text on COM1
+#define TRACE_DUMP_RAW 2               // Binary records on COM1
+
+// Fixed-size record
+typedef struct {
+    unsigned long long tsc;
+    unsigned char event;
+    unsigned char cpu;
+    unsigned short a;
+    unsigned int b;
+} trace_record_t;
+
+// Per-CPU ring; the oldest records are overwritten when it is full
+typedef struct {
+    trace_record_t records[TRACE_RECORDS];
+    unsigned int head;                 // Records written since trace_start
+} trace_ring_t;
+
+extern int trace_enabled;
+
+// Tracepoint: a single not-taken branch while tracing is off
+#define TRACE(event, a, b) \
+    do { \
+        if (__builtin_expect(trace_enabled, 0)) trace_record(event, a, b); \
+    } while (0)
+
+// Tracing functions
+void trace_record(int event, int a, int b);
+void trace_start();
+void trace_stop();
+void trace_dump(int format);
+void trace_show_status();
+
+#endif
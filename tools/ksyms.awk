@@ -0,0 +1,28 @@
+# ksyms.awk - Turn "nm -n" output into the kernel symbol table (ksyms.h)
+#
+# Keeps text symbols, one per address. Assembler local labels
+# (gdt_flush.reload_cs) are dropped; compiler clones such as
+# foo.constprop.0 are kept since they are separate functions.
+
+BEGIN {
+    print "// ksyms.c - Generated by tools/ksyms.awk, do not edit"
+    print "#include \"ksyms.h\""
+    print ""
+    print "const ksym_t ksyms[] = {"
+    count = 0
+}
+
+$2 ~ /^[tTwW]$/ {
+    if ($3 ~ /\./ && $3 !~ /\.(constprop|isra|part|cold)/) next
+    if ($1 == last) next
+    last = $1
+    printf "    {0x%s, \"%s\"},\n", $1, $3
+    count++
+}
+
+END {
+    if (count == 0) print "    {0, 0},"
+    print "};"
+    print ""
+    print "const int ksym_count = " count ";"
+}
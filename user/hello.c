@@ -0,0 +1,30 @@
+// hello.c - Sample user program for exec, built as a static ELF
+//
+// Runs in ring 3 and talks to the kernel only through int 0x80. The
+// lookup table makes the file much larger than the code: exec maps it
+// but the simulated pager only reads the pages the program touches.
+
+#define SYS_WRITE 0
+#define SYS_EXIT 2
+#define TABLE_SIZE 65536
+
+static const unsigned char table[TABLE_SIZE] = { 1, 2, 3, 4 };
+static char message[] = "Hello from an ELF program\n";
+
+static int syscall(int number, int arg1, int arg2) {
+    int ret;
+    __asm__ volatile ("int $0x80"
+                      : "=a"(ret)
+                      : "a"(number), "b"(arg1), "S"(arg2)
+                      : "memory");
+    return ret;
+}
+
+void _start(void) {
+    int len = 0;
+    while (message[len]) len++;
+    syscall(SYS_WRITE, (int)message, len);
+    syscall(SYS_EXIT, table[len & (TABLE_SIZE - 1)], 0);
+    while (1) {
+    }
+}